@@ -0,0 +1,114 @@
+//
+// BatchConverter.h
+//
+// Copyright (c) 2007-2010 Lukhnos D. Liu (http://lukhnos.org)
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef BatchConverter_h
+#define BatchConverter_h
+
+#include "BlockReadingBuilder.h"
+#include "Walker.h"
+
+namespace Formosa {
+    namespace Gramambular {
+        using namespace std;
+
+        // converts whole sentences of readings at a time: the grid is built
+        // in one pass and walked once, and the converter keeps the builder's
+        // and the walker's buffers from one sentence to the next; a converter
+        // belongs to one thread, and ParallelConverter runs several
+        class BatchConverter {
+        public:
+            BatchConverter(LanguageModel *inLM, const string& inJoinSeparator);
+
+            // the walker points into the builder's grid
+            BatchConverter(const BatchConverter&) = delete;
+            BatchConverter& operator=(const BatchConverter&) = delete;
+
+            // passes the values of the best path to inOutput, front to back,
+            // as inOutput(const KeyValuePair&); a reading the model has no
+            // unigram for is passed through as both key and value
+            template <class Output> void convert(const vector<string>& inReadings, Output inOutput);
+
+            // the values of the best path, concatenated
+            const string convert(const vector<string>& inReadings);
+
+            BlockReadingBuilder& builder();
+
+        protected:
+            BlockReadingBuilder m_builder;
+            Walker m_walker;
+            // the unigram of a reading passed through
+            vector<Unigram> m_passThrough;
+        };
+
+        inline BatchConverter::BatchConverter(LanguageModel *inLM, const string& inJoinSeparator)
+            : m_builder(inLM)
+            , m_walker(&m_builder.grid())
+            , m_passThrough(1)
+        {
+            m_builder.setJoinSeparator(inJoinSeparator);
+
+            // well below any real score, so that it only wins where nothing else is there
+            m_passThrough[0].score = -99.0;
+        }
+
+        template <class Output> inline void BatchConverter::convert(const vector<string>& inReadings, Output inOutput)
+        {
+            m_builder.setReadings(inReadings);
+
+            Grid& grid = m_builder.grid();
+            for (size_t i = 0 ; i < inReadings.size() ; i++) {
+                if (!grid.nodeAtLocationSpanningLength(i, 1)) {
+                    m_passThrough[0].keyValue.key = inReadings[i];
+                    m_passThrough[0].keyValue.value = inReadings[i];
+                    grid.insertNode(Node(inReadings[i], m_passThrough, vector<Bigram>()), i, 1);
+                }
+            }
+
+            const vector<NodeAnchor> path = m_walker.reverseViterbiWalk(grid.width());
+            for (vector<NodeAnchor>::const_reverse_iterator ai = path.rbegin() ; ai != path.rend() ; ++ai) {
+                inOutput((*ai).node->currentKeyValue());
+            }
+        }
+
+        inline const string BatchConverter::convert(const vector<string>& inReadings)
+        {
+            string result;
+            convert(inReadings, [&result](const KeyValuePair& inKeyValue) {
+                result += inKeyValue.value;
+            });
+            return result;
+        }
+
+        inline BlockReadingBuilder& BatchConverter::builder()
+        {
+            return m_builder;
+        }
+    };
+};
+
+#endif
@@ -28,6 +28,7 @@
 #ifndef Bigram_h
 #define Bigram_h
 
+#include <vector>
 #include "KeyValuePair.h"
 
 namespace Formosa {
@@ -0,0 +1,281 @@
+//
+// BigramWalker.h
+//
+// Copyright (c) 2007-2010 Lukhnos D. Liu (http://lukhnos.org)
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef BigramWalker_h
+#define BigramWalker_h
+
+#include <limits>
+#include "Grid.h"
+
+namespace Formosa {
+    namespace Gramambular {
+        using namespace std;
+
+        // A walker that picks a candidate for every node on the way. The
+        // score of a candidate is the language model's bigram score given the
+        // candidate picked for the node before it, or its unigram score if the
+        // model has no such bigram. Nodes are left untouched: the picked
+        // candidates are handed back alongside the path. A node with a fixed
+        // candidate keeps it, with the node's own score.
+        //
+        // The scores of every pair of adjacent nodes are kept between walks,
+        // and like IncrementalWalker, the walker asks the grid for the
+        // earliest location an edit has touched and drops the scores from
+        // there on. Walking resets the grid's change marker, so only one such
+        // walker should follow a grid.
+        class BigramWalker {
+        public:
+            BigramWalker(Grid* inGrid, LanguageModel* inLM);
+
+            // same path form as Walker::reverseWalk(); outKeyValues gets the
+            // candidate picked for each node in the path, in the same order
+            const vector<NodeAnchor> reverseWalk(size_t inLocation, vector<KeyValuePair>& outKeyValues, double inAccumulatedScore = 0.0);
+
+            // call this if the language model changes
+            void clearBigramCache();
+
+        protected:
+            // a node, by its index among the nodes ending at its location,
+            // with one of its candidates, and the best path ending with it;
+            // a fixed node has one state, with its selected candidate
+            struct State {
+                size_t node;
+                size_t candidate;
+                double score;
+                double transitionScore;
+                size_t previous;
+            };
+
+            // What is kept for the nodes ending at a location. For each node,
+            // in the grid's order, and each node ending where it starts,
+            // there is a table of scores by preceeding candidate and then by
+            // candidate; a pair without a bigram has the candidate's unigram
+            // score. firstPairs[n] indexes the first of node n's tables in
+            // tableOffsets. The nodes and states are refilled every walk.
+            struct Location {
+                vector<NodeAnchor> nodes;
+                vector<size_t> firstPairs;
+                vector<size_t> tableOffsets;
+                vector<double> scores;
+                vector<State> states;
+            };
+
+            void buildTables(size_t inLocation);
+
+            Grid* m_grid;
+            LanguageModel* m_LM;
+
+            // tables are valid for the locations below m_validLocation
+            vector<Location> m_locations;
+            size_t m_validLocation;
+
+            // buffers for building the tables
+            vector<Bigram> m_bigrams;
+            vector<char> m_foundPairs;
+        };
+
+        inline BigramWalker::BigramWalker(Grid* inGrid, LanguageModel* inLM)
+            : m_grid(inGrid)
+            , m_LM(inLM)
+            , m_validLocation(0)
+        {
+        }
+
+        inline void BigramWalker::clearBigramCache()
+        {
+            m_validLocation = 0;
+        }
+
+        inline void BigramWalker::buildTables(size_t inLocation)
+        {
+            Location& location = m_locations[inLocation];
+            location.firstPairs.clear();
+            location.tableOffsets.clear();
+            location.scores.clear();
+
+            for (vector<NodeAnchor>::const_iterator ni = location.nodes.begin() ; ni != location.nodes.end() ; ++ni) {
+                location.firstPairs.push_back(location.tableOffsets.size());
+                const Node* node = (*ni).node;
+                if (!node) {
+                    continue;
+                }
+
+                const vector<Unigram>& unigrams = node->unigrams();
+                const vector<NodeAnchor>& previousNodes = m_locations[(*ni).location].nodes;
+                for (vector<NodeAnchor>::const_iterator pi = previousNodes.begin() ; pi != previousNodes.end() ; ++pi) {
+                    size_t offset = location.scores.size();
+                    location.tableOffsets.push_back(offset);
+                    if (!(*pi).node) {
+                        continue;
+                    }
+
+                    const vector<Unigram>& previousUnigrams = (*pi).node->unigrams();
+                    for (size_t p = 0 ; p < previousUnigrams.size() ; p++) {
+                        for (size_t c = 0 ; c < unigrams.size() ; c++) {
+                            location.scores.push_back(unigrams[c].score);
+                        }
+                    }
+
+                    // the best bigram for a pair of values goes to every pair
+                    // of candidates with those values
+                    m_foundPairs.assign(previousUnigrams.size() * unigrams.size(), 0);
+                    BigramView bigrams = m_LM->bigramViewForKeys((*pi).node->key(), node->key(), m_bigrams);
+                    for (const Bigram* bi = bigrams.begin() ; bi != bigrams.end() ; ++bi) {
+                        for (size_t p = 0 ; p < previousUnigrams.size() ; p++) {
+                            if (previousUnigrams[p].keyValue.value != (*bi).preceedingKeyValue.value) {
+                                continue;
+                            }
+
+                            for (size_t c = 0 ; c < unigrams.size() ; c++) {
+                                size_t pair = p * unigrams.size() + c;
+                                if (unigrams[c].keyValue.value == (*bi).keyValue.value && (!m_foundPairs[pair] || (*bi).score > location.scores[offset + pair])) {
+                                    location.scores[offset + pair] = (*bi).score;
+                                    m_foundPairs[pair] = 1;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        inline const vector<NodeAnchor> BigramWalker::reverseWalk(size_t inLocation, vector<KeyValuePair>& outKeyValues, double inAccumulatedScore)
+        {
+            vector<NodeAnchor> result;
+            outKeyValues.clear();
+
+            if (m_grid->earliestChangedLocation() < m_validLocation) {
+                m_validLocation = m_grid->earliestChangedLocation();
+            }
+            m_grid->resetEarliestChangedLocation();
+
+            if (!inLocation || inLocation > m_grid->width()) {
+                return result;
+            }
+
+            const size_t none = numeric_limits<size_t>::max();
+
+            if (m_locations.size() < inLocation + 1) {
+                m_locations.resize(inLocation + 1);
+            }
+
+            // a state's previous is an index into the states ending where its node starts
+            m_locations[0].nodes.clear();
+            m_locations[0].states.clear();
+
+            for (size_t l = 1 ; l <= inLocation ; l++) {
+                Location& location = m_locations[l];
+                m_grid->nodesEndingAt(l, location.nodes);
+                location.states.clear();
+
+                if (l >= m_validLocation) {
+                    buildTables(l);
+                }
+
+                for (size_t n = 0 ; n < location.nodes.size() ; n++) {
+                    const NodeAnchor& anchor = location.nodes[n];
+                    const Node* node = anchor.node;
+                    if (!node) {
+                        continue;
+                    }
+
+                    size_t firstCandidate = 0;
+                    size_t candidateEnd = node->unigrams().size();
+                    if (node->isCandidateFixed()) {
+                        firstCandidate = node->selectedUnigramIndex();
+                        candidateEnd = firstCandidate + 1;
+                    }
+
+                    // as in Walker::reverseWalk(), a path ends where nothing ends before it
+                    const vector<State>& previousStates = m_locations[anchor.location].states;
+                    size_t candidateCount = node->unigrams().size();
+
+                    for (size_t c = firstCandidate ; c < candidateEnd ; c++) {
+                        State state;
+                        state.node = n;
+                        state.candidate = c;
+                        state.previous = none;
+                        state.transitionScore = node->isCandidateFixed() ? node->score() : node->unigrams()[c].score;
+                        state.score = state.transitionScore;
+
+                        for (size_t pi = 0 ; pi < previousStates.size() ; pi++) {
+                            const State& previous = previousStates[pi];
+
+                            double transitionScore = state.transitionScore;
+                            if (!node->isCandidateFixed() && previous.candidate < m_locations[anchor.location].nodes[previous.node].node->unigrams().size()) {
+                                size_t offset = location.tableOffsets[location.firstPairs[n] + previous.node];
+                                transitionScore = location.scores[offset + previous.candidate * candidateCount + c];
+                            }
+
+                            double score = previous.score + transitionScore;
+                            if (state.previous == none || score > state.score) {
+                                state.previous = pi;
+                                state.transitionScore = transitionScore;
+                                state.score = score;
+                            }
+                        }
+
+                        location.states.push_back(state);
+                    }
+                }
+            }
+
+            if (inLocation + 1 > m_validLocation) {
+                m_validLocation = inLocation + 1;
+            }
+
+            const vector<State>& lastStates = m_locations[inLocation].states;
+            size_t best = none;
+            for (size_t si = 0 ; si < lastStates.size() ; si++) {
+                if (best == none || lastStates[si].score > lastStates[best].score) {
+                    best = si;
+                }
+            }
+
+            double accumulatedScore = inAccumulatedScore;
+            for (size_t l = inLocation, si = best ; si != none ; ) {
+                const State& state = m_locations[l].states[si];
+
+                NodeAnchor anchor = m_locations[l].nodes[state.node];
+                accumulatedScore = accumulatedScore + state.transitionScore;
+                anchor.accumulatedScore = accumulatedScore;
+                result.push_back(anchor);
+
+                const Node* node = anchor.node;
+                outKeyValues.push_back(node->isCandidateFixed() ? node->currentKeyValue() : node->unigrams()[state.candidate].keyValue);
+
+                l = anchor.location;
+                si = state.previous;
+            }
+
+            return result;
+        }
+    };
+};
+
+#endif
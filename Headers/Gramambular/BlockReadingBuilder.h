@@ -45,6 +45,10 @@ namespace Formosa {
             size_t cursorIndex() const;
             void setCursorIndex(size_t inNewIndex);
             void insertReadingAtCursor(const string& inReading);
+            // replaces all readings and builds the grid in one left-to-right
+            // pass, leaving the cursor at the end; for converting text that
+            // is known up front, this saves rebuilding the window per reading
+            void setReadings(const vector<string>& inReadings);
             bool deleteReadingBeforeCursor();   // backspace
             bool deleteReadingAfterCursor();    // delete
             
@@ -52,15 +56,27 @@ namespace Formosa {
             
             void setJoinSeparator(const string& separator);
             const string joinSeparator() const;
+
+            // the most readings joined into one key; unless set, this is the
+            // longest key the language model has for the join separator, or
+            // MaximumBuildSpanLength if the model can't tell; setting it to 0
+            // goes back to that
+            size_t maximumBuildSpanLength() const;
+            void setMaximumBuildSpanLength(size_t inLength);
             
             Grid& grid();
                         
         protected:
             void build();
+            // looks up and inserts the spans that start in [inBegin, inEnd)
+            // and end no later than inEnd
+            void buildSpans(size_t inBegin, size_t inEnd);
             
             static const string Join(vector<string>::const_iterator begin, vector<string>::const_iterator end, const string& separator);
             
             static const size_t MaximumBuildSpanLength = 4;
+
+            void updateMaximumBuildSpanLength();
             
             size_t m_cursorIndex;
             vector<string> m_readings;
@@ -68,12 +84,24 @@ namespace Formosa {
             Grid m_grid;
             LanguageModel *m_LM;
             string m_joinSeparator;
+
+            // holds the joined readings while building, kept to reuse its storage
+            string m_combinedReading;
+
+            // the buffer for unigram views, emptied after each build
+            vector<Unigram> m_unigrams;
+
+            size_t m_maximumBuildSpanLength;
+            bool m_maximumBuildSpanLengthIsSet;
         };
         
         inline BlockReadingBuilder::BlockReadingBuilder(LanguageModel *inLM)
             : m_LM(inLM)
             , m_cursorIndex(0)
+            , m_maximumBuildSpanLength(MaximumBuildSpanLength)
+            , m_maximumBuildSpanLengthIsSet(false)
         {
+            updateMaximumBuildSpanLength();
         }
         
         inline void BlockReadingBuilder::clear()
@@ -108,6 +136,22 @@ namespace Formosa {
             m_cursorIndex++;   
         }
         
+        inline void BlockReadingBuilder::setReadings(const vector<string>& inReadings)
+        {
+            m_grid.clear();
+            m_grid.reserve(inReadings.size(), m_maximumBuildSpanLength);
+            for (size_t i = 0 ; i < inReadings.size() ; i++) {
+                m_grid.expandGridByOneAtLocation(i);
+            }
+
+            m_readings = inReadings;
+            m_cursorIndex = m_readings.size();
+
+            if (m_LM) {
+                buildSpans(0, m_readings.size());
+            }
+        }
+
         inline bool BlockReadingBuilder::deleteReadingBeforeCursor()
         {
             if (!m_cursorIndex) {
@@ -154,6 +198,7 @@ namespace Formosa {
         inline void BlockReadingBuilder::setJoinSeparator(const string& separator)
         {
             m_joinSeparator = separator;
+            updateMaximumBuildSpanLength();
         }
         
         inline const string BlockReadingBuilder::joinSeparator() const
@@ -161,6 +206,28 @@ namespace Formosa {
             return m_joinSeparator;
         }
 
+        inline size_t BlockReadingBuilder::maximumBuildSpanLength() const
+        {
+            return m_maximumBuildSpanLength;
+        }
+
+        inline void BlockReadingBuilder::setMaximumBuildSpanLength(size_t inLength)
+        {
+            m_maximumBuildSpanLength = inLength;
+            m_maximumBuildSpanLengthIsSet = inLength != 0;
+            updateMaximumBuildSpanLength();
+        }
+
+        inline void BlockReadingBuilder::updateMaximumBuildSpanLength()
+        {
+            if (m_maximumBuildSpanLengthIsSet) {
+                return;
+            }
+
+            size_t length = m_LM ? m_LM->maximumKeySpanLength(m_joinSeparator) : 0;
+            m_maximumBuildSpanLength = length ? length : MaximumBuildSpanLength;
+        }
+
         inline Grid& BlockReadingBuilder::grid()
         {
             return m_grid;
@@ -173,32 +240,79 @@ namespace Formosa {
             }
             
             size_t begin = 0;
-            size_t end = m_cursorIndex + MaximumBuildSpanLength;
+            size_t end = m_cursorIndex + m_maximumBuildSpanLength;
             
-            if (m_cursorIndex < MaximumBuildSpanLength) {
+            if (m_cursorIndex < m_maximumBuildSpanLength) {
                 begin = 0;
             }
             else {
-                begin = m_cursorIndex - MaximumBuildSpanLength;
+                begin = m_cursorIndex - m_maximumBuildSpanLength;
             }
             
             if (end > m_readings.size()) {
                 end = m_readings.size();
             }
+
+            buildSpans(begin, end);
+        }
+
+        inline void BlockReadingBuilder::buildSpans(size_t inBegin, size_t inEnd)
+        {
+            // with a model that can walk its keys, spans that are not keys
+            // are skipped without a lookup, and a start position is done as
+            // soon as no longer key can begin there
+            size_t root = 0;
+            bool walksKeys = m_LM->keyPrefixRoot(root);
             
-            for (size_t p = begin ; p < end ; p++) {
-                for (size_t q = 1 ; q <= MaximumBuildSpanLength && p+q <= end ; q++) {
-                    string combinedReading = Join(m_readings.begin() + p, m_readings.begin() + p + q, m_joinSeparator);
+            for (size_t p = inBegin ; p < inEnd ; p++) {
+                // same as Join(), one reading at a time
+                m_combinedReading.clear();
+                size_t state = root;
+
+                for (size_t q = 1 ; q <= m_maximumBuildSpanLength && p+q <= inEnd ; q++) {
+                    if (q > 1) {
+                        m_combinedReading += m_joinSeparator;
+                    }
+                    m_combinedReading += m_readings[p + q - 1];
+
+                    if (walksKeys) {
+                        if ((q > 1 && !m_LM->advanceKeyPrefix(state, m_joinSeparator)) || !m_LM->advanceKeyPrefix(state, m_readings[p + q - 1])) {
+                            break;
+                        }
+
+                        if (!m_LM->hasUnigramsForKeyPrefix(state)) {
+                            continue;
+                        }
+                    }
                     
-                    if (m_LM->hasUnigramsForKey(combinedReading) && !m_grid.hasNodeAtLocationSpanningLengthMatchingKey(p, q, combinedReading)) {
-                        Node n(combinedReading, m_LM->unigramsForKeys(combinedReading), vector<Bigram>());                        
-                        m_grid.insertNode(n, p, q);
+                    // the grid check is cheap and usually true for the nodes left from the last build
+                    if (m_grid.hasNodeAtLocationSpanningLengthMatchingKey(p, q, m_combinedReading)) {
+                        continue;
+                    }
+
+                    UnigramView unigrams = m_LM->unigramViewForKey(m_combinedReading, m_unigrams);
+                    if (unigrams.empty()) {
+                        continue;
                     }
+
+                    // grams read into the buffer move into the node; grams
+                    // in the model's own storage are copied once
+                    vector<Unigram> nodeUnigrams;
+                    if (!m_unigrams.empty() && unigrams.begin() == &m_unigrams[0]) {
+                        nodeUnigrams.swap(m_unigrams);
+                    }
+                    else {
+                        nodeUnigrams.assign(unigrams.begin(), unigrams.end());
+                    }
+
+                    m_grid.insertNode(Node(m_combinedReading, std::move(nodeUnigrams), vector<Bigram>()), p, q);
                 }
             }
+
+            m_unigrams.clear();
         }
         
-        const string BlockReadingBuilder::Join(vector<string>::const_iterator begin, vector<string>::const_iterator end, const string& separator)
+        inline const string BlockReadingBuilder::Join(vector<string>::const_iterator begin, vector<string>::const_iterator end, const string& separator)
         {
             string result;
             for (vector<string>::const_iterator iter = begin ; iter != end ; ) {
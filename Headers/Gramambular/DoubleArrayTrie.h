@@ -0,0 +1,325 @@
+//
+// DoubleArrayTrie.h
+//
+// Copyright (c) 2007-2010 Lukhnos D. Liu (http://lukhnos.org)
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef DoubleArrayTrie_h
+#define DoubleArrayTrie_h
+
+#include <stdint.h>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Formosa {
+    namespace Gramambular {
+        using namespace std;
+
+        // A static byte-wise trie over a set of keys, stored as a double
+        // array: from a node s, the child for byte c sits at base[s] + c + 1
+        // if its check points back at s, and the key ending at s, if any, at
+        // base[s] with code 0. A lookup costs one array access per key byte
+        // and no string comparisons.
+        //
+        // Each key maps to its index in the sorted key list the trie was
+        // built from. The units can be written out as they are and attached
+        // to again from read-only memory, such as a mapped file.
+        class DoubleArrayTrie {
+        public:
+            struct Unit {
+                int32_t base;
+                int32_t check;
+            };
+
+            DoubleArrayTrie();
+
+            // the keys must be sorted byte-wise and unique
+            bool build(const vector<string>& inSortedKeys);
+
+            // uses inCount units at inUnits, which must outlive the trie
+            void attach(const Unit* inUnits, size_t inCount);
+
+            const Unit* units() const;
+            size_t unitCount() const;
+
+            bool find(const string& inKey, uint32_t& outValue) const;
+
+            // finds the keys that are prefixes of the given bytes, shortest
+            // first, as (prefix length, value) pairs; returns their count
+            size_t commonPrefixSearch(const char* inBytes, size_t inLength, vector<pair<size_t, uint32_t> >& outMatches) const;
+
+            // for walking keys a piece at a time: start at RootNode(), then
+            // advance by each piece; false means no key starts with what has
+            // been consumed so far, and ioNode is left unchanged
+            static size_t RootNode();
+            bool advance(size_t& ioNode, const char* inBytes, size_t inLength) const;
+            bool valueAtNode(size_t inNode, uint32_t& outValue) const;
+
+        protected:
+            bool insertChildren(size_t inNode, const vector<string>& inKeys, size_t inBegin, size_t inEnd, size_t inDepth);
+            size_t findBase(const vector<size_t>& inCodes);
+            void reserveUnits(size_t inCount);
+
+            vector<Unit> m_units;
+            vector<bool> m_used;
+            size_t m_nextCheckPosition;
+
+            const Unit* m_array;
+            size_t m_count;
+        };
+
+        inline DoubleArrayTrie::DoubleArrayTrie()
+            : m_nextCheckPosition(0)
+            , m_array(0)
+            , m_count(0)
+        {
+        }
+
+        inline size_t DoubleArrayTrie::RootNode()
+        {
+            return 0;
+        }
+
+        inline bool DoubleArrayTrie::build(const vector<string>& inSortedKeys)
+        {
+            for (size_t i = 1 ; i < inSortedKeys.size() ; i++) {
+                if (!(inSortedKeys[i - 1] < inSortedKeys[i])) {
+                    return false;
+                }
+            }
+
+            m_units.clear();
+            m_used.clear();
+            m_nextCheckPosition = 0;
+            m_array = 0;
+            m_count = 0;
+
+            reserveUnits(1);
+            m_units[0].base = 0;
+            m_units[0].check = -1;
+            m_used[0] = true;
+
+            if (inSortedKeys.size() && !insertChildren(0, inSortedKeys, 0, inSortedKeys.size(), 0)) {
+                m_units.clear();
+                m_used.clear();
+                return false;
+            }
+
+            // trims the free tail
+            size_t last = m_units.size();
+            while (last > 1 && !m_used[last - 1]) {
+                last--;
+            }
+            m_units.resize(last);
+            m_used.clear();
+
+            m_array = &m_units[0];
+            m_count = m_units.size();
+            return true;
+        }
+
+        inline void DoubleArrayTrie::attach(const Unit* inUnits, size_t inCount)
+        {
+            m_units.clear();
+            m_used.clear();
+            m_array = inUnits;
+            m_count = inCount;
+        }
+
+        inline const DoubleArrayTrie::Unit* DoubleArrayTrie::units() const
+        {
+            return m_array;
+        }
+
+        inline size_t DoubleArrayTrie::unitCount() const
+        {
+            return m_count;
+        }
+
+        inline bool DoubleArrayTrie::advance(size_t& ioNode, const char* inBytes, size_t inLength) const
+        {
+            size_t node = ioNode;
+            for (size_t i = 0 ; i < inLength ; i++) {
+                if (node >= m_count) {
+                    return false;
+                }
+
+                // the unsigned arithmetic also rejects negative (leaf) bases
+                size_t next = (size_t)(uint32_t)m_array[node].base + (unsigned char)inBytes[i] + 1;
+                if (next >= m_count || m_array[next].check != (int32_t)node) {
+                    return false;
+                }
+
+                node = next;
+            }
+
+            ioNode = node;
+            return true;
+        }
+
+        inline bool DoubleArrayTrie::valueAtNode(size_t inNode, uint32_t& outValue) const
+        {
+            if (inNode >= m_count) {
+                return false;
+            }
+
+            size_t leaf = (size_t)(uint32_t)m_array[inNode].base;
+            if (leaf >= m_count || m_array[leaf].check != (int32_t)inNode || m_array[leaf].base >= 0) {
+                return false;
+            }
+
+            outValue = (uint32_t)(-(m_array[leaf].base + 1));
+            return true;
+        }
+
+        inline bool DoubleArrayTrie::find(const string& inKey, uint32_t& outValue) const
+        {
+            size_t node = RootNode();
+            return advance(node, inKey.data(), inKey.size()) && valueAtNode(node, outValue);
+        }
+
+        inline size_t DoubleArrayTrie::commonPrefixSearch(const char* inBytes, size_t inLength, vector<pair<size_t, uint32_t> >& outMatches) const
+        {
+            outMatches.clear();
+
+            size_t node = RootNode();
+            uint32_t value;
+            for (size_t i = 0 ; ; i++) {
+                if (valueAtNode(node, value)) {
+                    outMatches.push_back(make_pair(i, value));
+                }
+
+                if (i == inLength || !advance(node, inBytes + i, 1)) {
+                    break;
+                }
+            }
+
+            return outMatches.size();
+        }
+
+        inline void DoubleArrayTrie::reserveUnits(size_t inCount)
+        {
+            if (inCount > m_units.size()) {
+                Unit free;
+                free.base = 0;
+                free.check = -1;
+                m_units.resize(inCount, free);
+                m_used.resize(inCount, false);
+            }
+        }
+
+        inline size_t DoubleArrayTrie::findBase(const vector<size_t>& inCodes)
+        {
+            // scans from the first position not known to be mostly full
+            size_t position = m_nextCheckPosition > inCodes[0] ? m_nextCheckPosition : inCodes[0];
+            bool first = true;
+            size_t occupied = 0;
+
+            for ( ; ; position++) {
+                reserveUnits(position + 1);
+                if (m_used[position]) {
+                    occupied++;
+                    continue;
+                }
+
+                if (first) {
+                    m_nextCheckPosition = position;
+                    first = false;
+                }
+
+                // children must not land on the root
+                size_t base = position - inCodes[0];
+                if (!base) {
+                    continue;
+                }
+
+                reserveUnits(base + inCodes.back() + 1);
+                bool fits = true;
+                for (size_t i = 1 ; i < inCodes.size() ; i++) {
+                    if (m_used[base + inCodes[i]]) {
+                        fits = false;
+                        break;
+                    }
+                }
+
+                if (fits) {
+                    // stop rescanning a stretch that has filled up
+                    if (occupied * 20 >= (position - m_nextCheckPosition + 1) * 19) {
+                        m_nextCheckPosition = position;
+                    }
+                    return base;
+                }
+            }
+        }
+
+        inline bool DoubleArrayTrie::insertChildren(size_t inNode, const vector<string>& inKeys, size_t inBegin, size_t inEnd, size_t inDepth)
+        {
+            // codes are 0 for a key ending here and byte + 1 otherwise; the
+            // keys are sorted, so each code's keys are contiguous and in order
+            vector<size_t> codes;
+            vector<size_t> groupEnds;
+            for (size_t i = inBegin ; i < inEnd ; i++) {
+                size_t code = inDepth < inKeys[i].size() ? (size_t)(unsigned char)inKeys[i][inDepth] + 1 : 0;
+                if (codes.size() && codes.back() == code) {
+                    groupEnds.back() = i + 1;
+                }
+                else {
+                    codes.push_back(code);
+                    groupEnds.push_back(i + 1);
+                }
+            }
+
+            size_t base = findBase(codes);
+            if (base + codes.back() > (size_t)numeric_limits<int32_t>::max() || inKeys.size() > (size_t)numeric_limits<int32_t>::max()) {
+                return false;
+            }
+
+            m_units[inNode].base = (int32_t)base;
+            for (size_t i = 0 ; i < codes.size() ; i++) {
+                m_used[base + codes[i]] = true;
+                m_units[base + codes[i]].check = (int32_t)inNode;
+            }
+
+            size_t groupBegin = inBegin;
+            for (size_t i = 0 ; i < codes.size() ; i++) {
+                size_t child = base + codes[i];
+                if (!codes[i]) {
+                    m_units[child].base = -(int32_t)groupBegin - 1;
+                }
+                else if (!insertChildren(child, inKeys, groupBegin, groupEnds[i], inDepth + 1)) {
+                    return false;
+                }
+
+                groupBegin = groupEnds[i];
+            }
+
+            return true;
+        }
+    };
+};
+
+#endif
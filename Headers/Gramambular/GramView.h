@@ -0,0 +1,107 @@
+//
+// GramView.h
+//
+// Copyright (c) 2007-2010 Lukhnos D. Liu (http://lukhnos.org)
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef GramView_h
+#define GramView_h
+
+#include <cstddef>
+#include "Bigram.h"
+#include "Unigram.h"
+
+namespace Formosa {
+    namespace Gramambular {
+        // A read-only range of grams in storage someone else owns, usually a
+        // language model; copying a view copies two pointers.
+        template <class T> class GramView {
+        public:
+            typedef const T* const_iterator;
+
+            GramView();
+            GramView(const T* inBegin, const T* inEnd);
+            GramView(const vector<T>& inGrams);
+
+            const_iterator begin() const;
+            const_iterator end() const;
+            size_t size() const;
+            bool empty() const;
+            const T& operator[](size_t inIndex) const;
+
+        protected:
+            const T* m_begin;
+            const T* m_end;
+        };
+
+        typedef GramView<Unigram> UnigramView;
+        typedef GramView<Bigram> BigramView;
+
+        template <class T> inline GramView<T>::GramView()
+            : m_begin(0)
+            , m_end(0)
+        {
+        }
+
+        template <class T> inline GramView<T>::GramView(const T* inBegin, const T* inEnd)
+            : m_begin(inBegin)
+            , m_end(inEnd)
+        {
+        }
+
+        template <class T> inline GramView<T>::GramView(const vector<T>& inGrams)
+            : m_begin(inGrams.empty() ? 0 : &inGrams[0])
+            , m_end(inGrams.empty() ? 0 : &inGrams[0] + inGrams.size())
+        {
+        }
+
+        template <class T> inline typename GramView<T>::const_iterator GramView<T>::begin() const
+        {
+            return m_begin;
+        }
+
+        template <class T> inline typename GramView<T>::const_iterator GramView<T>::end() const
+        {
+            return m_end;
+        }
+
+        template <class T> inline size_t GramView<T>::size() const
+        {
+            return m_end - m_begin;
+        }
+
+        template <class T> inline bool GramView<T>::empty() const
+        {
+            return m_begin == m_end;
+        }
+
+        template <class T> inline const T& GramView<T>::operator[](size_t inIndex) const
+        {
+            return m_begin[inIndex];
+        }
+    };
+};
+
+#endif
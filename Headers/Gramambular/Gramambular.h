@@ -28,13 +28,21 @@
 #ifndef Gramambular_h
 #define Gramambular_h
 
+#include "BatchConverter.h"
 #include "Bigram.h"
+#include "BigramWalker.h"
 #include "BlockReadingBuilder.h"
+#include "DoubleArrayTrie.h"
+#include "GramView.h"
 #include "Grid.h"
+#include "IncrementalWalker.h"
 #include "KeyValuePair.h"
 #include "LanguageModel.h"
+#include "MappedLanguageModel.h"
 #include "Node.h"
 #include "NodeAnchor.h"
+#include "ParallelConverter.h"
+#include "SharedLanguageModel.h"
 #include "Span.h"
 #include "Unigram.h"
 #include "Walker.h"
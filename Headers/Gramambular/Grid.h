@@ -28,6 +28,8 @@
 #ifndef Grid_h
 #define Grid_h
 
+#include <deque>
+#include <limits>
 #include <map>
 #include "NodeAnchor.h"
 #include "Span.h"
@@ -35,50 +37,107 @@
 namespace Formosa {
     namespace Gramambular {
         
+        // The grid keeps one slot per (location, spanning length) in a single
+        // array, location-major, so that the nodes ending at or crossing a
+        // location sit a few slots apart. Slots hold indices into a node
+        // arena; arena nodes never move, so Node pointers handed out stay
+        // valid until their node is removed from the grid.
         class Grid {
         public:
+            Grid();
+
             void clear();
             void insertNode(const Node& inNode, size_t inLocation, size_t inSpanningLength);
+            void insertNode(Node&& inNode, size_t inLocation, size_t inSpanningLength);
             bool hasNodeAtLocationSpanningLengthMatchingKey(size_t inLocation, size_t inSpanningLength, const string& inKey);
+            Node* nodeAtLocationSpanningLength(size_t inLocation, size_t inSpanningLength);
 
             void expandGridByOneAtLocation(size_t inLocation);
+            // makes room for a grid inWidth wide with spans of up to
+            // inLongestSpanningLength, so that filling it doesn't reallocate
+            void reserve(size_t inWidth, size_t inLongestSpanningLength);
             void shrinkGridByOneAtLocation(size_t inLocation);
 
             size_t width() const;
             vector<NodeAnchor> nodesEndingAt(size_t inLocation);
             vector<NodeAnchor> nodesCrossingOrEndingAt(size_t inLocation);
+
+            // same as above, but replace the contents of outAnchors instead;
+            // once a buffer has grown to fit, querying does not allocate
+            void nodesEndingAt(size_t inLocation, vector<NodeAnchor>& outAnchors);
+            void nodesCrossingOrEndingAt(size_t inLocation, vector<NodeAnchor>& outAnchors);
             
             const string dumpDOT();
             
+            // the smallest location at which nodesEndingAt() may have changed
+            // since the last reset; walkers that cache per-location results use
+            // this to recompute only what an edit has touched
+            size_t earliestChangedLocation() const;
+            void resetEarliestChangedLocation();
+
         protected:
-            vector<Span> m_spans;
+            void markChangedLocation(size_t inLocation);
+
+            // widens every location to inSpanningLength slots
+            void setLongestSpanningLength(size_t inSpanningLength);
+
+            // returns the arena node for the slot, taking a free one if the slot is empty
+            Node& nodeForInsertion(size_t inLocation, size_t inSpanningLength);
+
+            // removes the nodes starting at inLocation longer than inSpanningLength
+            void removeNodesLongerThan(size_t inLocation, size_t inSpanningLength);
+
+            size_t m_width;
+
+            // slots per location; no node spans further than this
+            size_t m_longestSpanningLength;
+
+            // node arena index + 1 for every (location, length), 0 if empty
+            vector<size_t> m_slots;
+            deque<Node> m_nodes;
+            vector<size_t> m_freeNodes;
+
+            size_t m_earliestChangedLocation;
         };
         
+        inline Grid::Grid()
+            : m_width(0)
+            , m_longestSpanningLength(0)
+            , m_earliestChangedLocation(0)
+        {
+        }
+
         inline void Grid::clear()
         {
-            m_spans.clear();
+            m_width = 0;
+            m_longestSpanningLength = 0;
+            m_slots.clear();
+            m_nodes.clear();
+            m_freeNodes.clear();
+            markChangedLocation(0);
         }
         
         inline void Grid::insertNode(const Node& inNode, size_t inLocation, size_t inSpanningLength)
-        {            
-            if (inLocation >= m_spans.size()) {
-                size_t diff = inLocation - m_spans.size() + 1;
-                
-                for (size_t i = 0 ; i < diff ; i++) {
-                    m_spans.push_back(Span());
-                }
+        {
+            if (!inSpanningLength) {
+                return;
             }
 
-            m_spans[inLocation].insertNodeOfLength(inNode, inSpanningLength);
+            nodeForInsertion(inLocation, inSpanningLength) = inNode;
         }
 
-        inline bool Grid::hasNodeAtLocationSpanningLengthMatchingKey(size_t inLocation, size_t inSpanningLength, const string& inKey)
+        inline void Grid::insertNode(Node&& inNode, size_t inLocation, size_t inSpanningLength)
         {
-            if (inLocation > m_spans.size()) {
-                return false;
+            if (!inSpanningLength) {
+                return;
             }
-            
-            const Node *n = m_spans[inLocation].nodeOfLength(inSpanningLength);
+
+            nodeForInsertion(inLocation, inSpanningLength) = std::move(inNode);
+        }
+
+        inline bool Grid::hasNodeAtLocationSpanningLengthMatchingKey(size_t inLocation, size_t inSpanningLength, const string& inKey)
+        {
+            const Node *n = nodeAtLocationSpanningLength(inLocation, inSpanningLength);
             if (!n) {
                 return false;
             }
@@ -86,93 +145,126 @@ namespace Formosa {
             return inKey == n->key();
         }
 
+        inline Node* Grid::nodeAtLocationSpanningLength(size_t inLocation, size_t inSpanningLength)
+        {
+            if (inLocation >= m_width || !inSpanningLength || inSpanningLength > m_longestSpanningLength) {
+                return 0;
+            }
+
+            size_t slot = m_slots[inLocation * m_longestSpanningLength + inSpanningLength - 1];
+            return slot ? &m_nodes[slot - 1] : 0;
+        }
+
         inline void Grid::expandGridByOneAtLocation(size_t inLocation)
         {
-            if (!inLocation || inLocation == m_spans.size()) {
-                m_spans.insert(m_spans.begin() + inLocation, Span());
+            if (inLocation > m_width) {
+                return;
             }
-            else {
-                m_spans.insert(m_spans.begin() + inLocation, Span());
+
+            m_slots.insert(m_slots.begin() + inLocation * m_longestSpanningLength, m_longestSpanningLength, 0);
+            m_width++;
+
+            if (inLocation && inLocation + 1 != m_width) {
                 for (size_t i = 0 ; i < inLocation ; i++) {
                     // zaps overlapping spans
-                    m_spans[i].removeNodeOfLengthGreaterThan(inLocation - i);
+                    removeNodesLongerThan(i, inLocation - i);
                 }
             }
+
+            // nodes ending at or before inLocation are left untouched
+            markChangedLocation(inLocation + 1);
         }
         
+        inline void Grid::reserve(size_t inWidth, size_t inLongestSpanningLength)
+        {
+            if (inLongestSpanningLength > m_longestSpanningLength) {
+                setLongestSpanningLength(inLongestSpanningLength);
+            }
+
+            m_slots.reserve(inWidth * m_longestSpanningLength);
+        }
+
         inline void Grid::shrinkGridByOneAtLocation(size_t inLocation)
         {
-            if (inLocation >= m_spans.size()) {
+            if (inLocation >= m_width) {
                 return;
             }
-            
-            m_spans.erase(m_spans.begin() + inLocation);
+
+            removeNodesLongerThan(inLocation, 0);
+            m_slots.erase(m_slots.begin() + inLocation * m_longestSpanningLength, m_slots.begin() + (inLocation + 1) * m_longestSpanningLength);
+            m_width--;
+
             for (size_t i = 0 ; i < inLocation ; i++) {
                 // zaps overlapping spans
-                m_spans[i].removeNodeOfLengthGreaterThan(inLocation - i);
+                removeNodesLongerThan(i, inLocation - i);
             }
+
+            markChangedLocation(inLocation + 1);
         }
 
         inline size_t Grid::width() const
         {
-            return m_spans.size();
+            return m_width;
         }
         
         inline vector<NodeAnchor> Grid::nodesEndingAt(size_t inLocation)
         {
             vector<NodeAnchor> result;
-            
-            if (m_spans.size() && inLocation <= m_spans.size()) {
-                for (size_t i = 0 ; i < inLocation ; i++) {
-                    Span& span = m_spans[i];
-                    if (i + span.maximumLength() >= inLocation) {
-                        Node *np = span.nodeOfLength(inLocation - i);
-                        if (np) {
-                            NodeAnchor na;
-                            na.node = np;
-                            na.location = i;
-                            na.spanningLength = inLocation - i;
-                            
-                            result.push_back(na);
-                        }
-                    }
-                }
-            }
-            
+            result.reserve(m_longestSpanningLength);
+            nodesEndingAt(inLocation, result);
             return result;
         }
 
         inline vector<NodeAnchor> Grid::nodesCrossingOrEndingAt(size_t inLocation)
         {
             vector<NodeAnchor> result;
-            
-            if (m_spans.size() && inLocation <= m_spans.size()) {
-                for (size_t i = 0 ; i < inLocation ; i++) {
-                    Span& span = m_spans[i];
-                    
-                    if (i + span.maximumLength() >= inLocation) {
+            nodesCrossingOrEndingAt(inLocation, result);
+            return result;
+        }
 
-                        for (size_t j = 1, m = span.maximumLength(); j <= m ; j++) { 
-                            
-                            if (i + j < inLocation) {
-                                continue;
-                            }
+        inline void Grid::nodesEndingAt(size_t inLocation, vector<NodeAnchor>& outAnchors)
+        {
+            outAnchors.clear();
+
+            if (m_width && inLocation <= m_width) {
+                // no span longer than the longest one ever inserted can reach inLocation
+                size_t begin = inLocation > m_longestSpanningLength ? inLocation - m_longestSpanningLength : 0;
+
+                for (size_t i = begin ; i < inLocation ; i++) {
+                    size_t slot = m_slots[i * m_longestSpanningLength + inLocation - i - 1];
+                    if (slot) {
+                        NodeAnchor na;
+                        na.node = &m_nodes[slot - 1];
+                        na.location = i;
+                        na.spanningLength = inLocation - i;
+                        
+                        outAnchors.push_back(na);
+                    }
+                }
+            }
+        }
+
+        inline void Grid::nodesCrossingOrEndingAt(size_t inLocation, vector<NodeAnchor>& outAnchors)
+        {
+            outAnchors.clear();
+
+            if (m_width && inLocation <= m_width) {
+                size_t begin = inLocation > m_longestSpanningLength ? inLocation - m_longestSpanningLength : 0;
+
+                for (size_t i = begin ; i < inLocation ; i++) {
+                    for (size_t j = inLocation - i ; j <= m_longestSpanningLength ; j++) {
+                        size_t slot = m_slots[i * m_longestSpanningLength + j - 1];
+                        if (slot) {
+                            NodeAnchor na;
+                            na.node = &m_nodes[slot - 1];
+                            na.location = i;
+                            na.spanningLength = inLocation - i;
                             
-                            Node *np = span.nodeOfLength(j);
-                            if (np) {
-                                NodeAnchor na;
-                                na.node = np;
-                                na.location = i;
-                                na.spanningLength = inLocation - i;
-                                
-                                result.push_back(na);
-                            }
+                            outAnchors.push_back(na);
                         }
                     }
                 }
             }
-            
-            return result;
         }
 
         
@@ -183,10 +275,9 @@ namespace Formosa {
             sst << "graph [ rankdir=LR ];" << endl;
             sst << "BOS;" << endl;
             
-            for (size_t p = 0 ; p < m_spans.size() ; p++) {
-                Span& span = m_spans[p];
-                for (size_t ni = 0 ; ni <= span.maximumLength() ; ni++) {
-                    Node* np = span.nodeOfLength(ni);
+            for (size_t p = 0 ; p < m_width ; p++) {
+                for (size_t ni = 1 ; ni <= m_longestSpanningLength ; ni++) {
+                    Node* np = nodeAtLocationSpanningLength(p, ni);
                     if (np) {
                         if (!p) {
                             sst << "BOS -> " << np->key() << ";" << endl;
@@ -194,17 +285,16 @@ namespace Formosa {
                         
                         sst << np->key() << ";" << endl;
                         
-                        if (p + ni < m_spans.size()) {
-                            Span& dstSpan = m_spans[p+ni];
-                            for (size_t q = 0 ; q <= dstSpan.maximumLength() ; q++) {
-                                Node *dn = dstSpan.nodeOfLength(q);
+                        if (p + ni < m_width) {
+                            for (size_t q = 1 ; q <= m_longestSpanningLength ; q++) {
+                                Node *dn = nodeAtLocationSpanningLength(p + ni, q);
                                 if (dn) {
                                     sst << np->key() << " -> " << dn->key() << ";" << endl;
                                 }
                             }
                         }
                         
-                        if (p + ni == m_spans.size()) {
+                        if (p + ni == m_width) {
                             sst << np->key() << " -> " << "EOS;" << endl;
                         }
                     }
@@ -215,6 +305,77 @@ namespace Formosa {
             sst << "}";
             return sst.str();
         }        
+
+        inline size_t Grid::earliestChangedLocation() const
+        {
+            return m_earliestChangedLocation;
+        }
+
+        inline void Grid::resetEarliestChangedLocation()
+        {
+            m_earliestChangedLocation = numeric_limits<size_t>::max();
+        }
+
+        inline void Grid::markChangedLocation(size_t inLocation)
+        {
+            if (inLocation < m_earliestChangedLocation) {
+                m_earliestChangedLocation = inLocation;
+            }
+        }
+
+        inline void Grid::setLongestSpanningLength(size_t inSpanningLength)
+        {
+            vector<size_t> slots(m_width * inSpanningLength, 0);
+            for (size_t i = 0 ; i < m_width ; i++) {
+                for (size_t j = 0 ; j < m_longestSpanningLength ; j++) {
+                    slots[i * inSpanningLength + j] = m_slots[i * m_longestSpanningLength + j];
+                }
+            }
+
+            m_slots.swap(slots);
+            m_longestSpanningLength = inSpanningLength;
+        }
+
+        inline Node& Grid::nodeForInsertion(size_t inLocation, size_t inSpanningLength)
+        {
+            if (inSpanningLength > m_longestSpanningLength) {
+                setLongestSpanningLength(inSpanningLength);
+            }
+
+            if (inLocation >= m_width) {
+                m_width = inLocation + 1;
+                m_slots.resize(m_width * m_longestSpanningLength, 0);
+            }
+
+            markChangedLocation(inLocation + inSpanningLength);
+
+            size_t& slot = m_slots[inLocation * m_longestSpanningLength + inSpanningLength - 1];
+            if (!slot) {
+                if (m_freeNodes.size()) {
+                    slot = m_freeNodes.back() + 1;
+                    m_freeNodes.pop_back();
+                }
+                else {
+                    m_nodes.push_back(Node());
+                    slot = m_nodes.size();
+                }
+            }
+
+            return m_nodes[slot - 1];
+        }
+
+        inline void Grid::removeNodesLongerThan(size_t inLocation, size_t inSpanningLength)
+        {
+            for (size_t j = inSpanningLength ; j < m_longestSpanningLength ; j++) {
+                size_t& slot = m_slots[inLocation * m_longestSpanningLength + j];
+                if (slot) {
+                    // frees the node's strings now rather than when the arena node is reused
+                    m_nodes[slot - 1] = Node();
+                    m_freeNodes.push_back(slot - 1);
+                    slot = 0;
+                }
+            }
+        }
     };
 };
 
@@ -0,0 +1,156 @@
+//
+// IncrementalWalker.h
+//
+// Copyright (c) 2007-2010 Lukhnos D. Liu (http://lukhnos.org)
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef IncrementalWalker_h
+#define IncrementalWalker_h
+
+#include "Grid.h"
+
+namespace Formosa {
+    namespace Gramambular {
+        using namespace std;
+
+        // A walker that keeps the best path ending at each location between
+        // walks. Before each walk it asks the grid for the earliest location
+        // an edit has touched and recomputes only from there on, so typing at
+        // the end of a sentence costs a handful of locations per keystroke
+        // instead of the whole sentence. Only one IncrementalWalker should
+        // follow a grid, as walking resets the grid's change marker.
+        class IncrementalWalker {
+        public:
+            IncrementalWalker(Grid* inGrid);
+
+            // node scores can change without the grid knowing, e.g. after
+            // Node::selectCandidateAtIndex(); call this for the location the
+            // node starts at
+            void invalidateFromLocation(size_t inLocation);
+
+            // same result as Walker::reverseWalk(grid->width(), inAccumulatedScore)
+            const vector<NodeAnchor> reverseWalk(double inAccumulatedScore = 0.0);
+
+        protected:
+            void update();
+
+            Grid* m_grid;
+
+            // best scores and last spanning lengths for the best paths ending
+            // at each location, valid below m_validLocation; a length of 0
+            // means nothing ends there
+            vector<double> m_bestScores;
+            vector<size_t> m_bestSpanningLengths;
+            size_t m_validLocation;
+
+            // reused for every location's nodes
+            vector<NodeAnchor> m_nodes;
+        };
+
+        inline IncrementalWalker::IncrementalWalker(Grid* inGrid)
+            : m_grid(inGrid)
+            , m_validLocation(0)
+        {
+        }
+
+        inline void IncrementalWalker::invalidateFromLocation(size_t inLocation)
+        {
+            // the best path ending at inLocation itself does not include a node starting there
+            if (inLocation + 1 < m_validLocation) {
+                m_validLocation = inLocation + 1;
+            }
+        }
+
+        inline const vector<NodeAnchor> IncrementalWalker::reverseWalk(double inAccumulatedScore)
+        {
+            update();
+
+            vector<NodeAnchor> result;
+            double accumulatedScore = inAccumulatedScore;
+            for (size_t l = m_grid->width() ; l && m_bestSpanningLengths[l] ; l -= m_bestSpanningLengths[l]) {
+                NodeAnchor anchor;
+                anchor.location = l - m_bestSpanningLengths[l];
+                anchor.spanningLength = m_bestSpanningLengths[l];
+                anchor.node = m_grid->nodeAtLocationSpanningLength(anchor.location, anchor.spanningLength);
+
+                accumulatedScore = accumulatedScore + anchor.node->score();
+                anchor.accumulatedScore = accumulatedScore;
+                result.push_back(anchor);
+            }
+
+            return result;
+        }
+
+        inline void IncrementalWalker::update()
+        {
+            size_t width = m_grid->width();
+
+            if (m_grid->earliestChangedLocation() < m_validLocation) {
+                m_validLocation = m_grid->earliestChangedLocation();
+            }
+            m_grid->resetEarliestChangedLocation();
+
+            if (m_validLocation > width + 1) {
+                m_validLocation = width + 1;
+            }
+
+            m_bestScores.resize(width + 1);
+            m_bestSpanningLengths.resize(width + 1);
+
+            if (!m_validLocation) {
+                m_bestScores[0] = 0.0;
+                m_bestSpanningLengths[0] = 0;
+                m_validLocation = 1;
+            }
+
+            // same recurrence as Walker::reverseViterbiWalk()
+            for (size_t l = m_validLocation ; l <= width ; l++) {
+                m_grid->nodesEndingAt(l, m_nodes);
+
+                double bestScore = 0.0;
+                size_t bestSpanningLength = 0;
+
+                for (vector<NodeAnchor>::const_iterator ni = m_nodes.begin() ; ni != m_nodes.end() ; ++ni) {
+                    if (!(*ni).node) {
+                        continue;
+                    }
+
+                    double score = (*ni).node->score() + m_bestScores[l - (*ni).spanningLength];
+                    if (!bestSpanningLength || score > bestScore) {
+                        bestScore = score;
+                        bestSpanningLength = (*ni).spanningLength;
+                    }
+                }
+
+                m_bestScores[l] = bestScore;
+                m_bestSpanningLengths[l] = bestSpanningLength;
+            }
+
+            m_validLocation = width + 1;
+        }
+    };
+};
+
+#endif
@@ -30,6 +30,7 @@
 
 #include <vector>
 #include "Bigram.h"
+#include "GramView.h"
 #include "Unigram.h"
 
 namespace Formosa {
@@ -44,7 +45,91 @@ namespace Formosa {
             virtual const vector<Bigram> bigramsForKeys(const string &preceedingKey, const string& key) = 0;
             virtual const vector<Unigram> unigramsForKeys(const string &key) = 0;
             virtual bool hasUnigramsForKey(const string& key) = 0;
+
+            // The same grams as above, found with a single lookup; an empty
+            // view means there are none. A model that keeps its grams in
+            // memory returns a view into its own storage; otherwise the grams
+            // are put into ioBuffer, which the caller owns, and the view is
+            // into that. A view is valid until ioBuffer is used again or the
+            // model changes. The defaults fill ioBuffer from the methods above.
+            virtual const UnigramView unigramViewForKey(const string& key, vector<Unigram>& ioBuffer);
+            virtual const BigramView bigramViewForKeys(const string& preceedingKey, const string& key, vector<Bigram>& ioBuffer);
+
+            // Optional prefix traversal over the model's keys, so that a
+            // builder can learn which spans of readings are keys by walking
+            // the readings once instead of looking up every span. A model
+            // that supports it gives a starting state from keyPrefixRoot();
+            // advanceKeyPrefix() returns false, leaving the state as it was,
+            // once no key starts with what has been consumed. The defaults
+            // say the model doesn't support it.
+            virtual bool keyPrefixRoot(size_t& outState) const;
+            virtual bool advanceKeyPrefix(size_t& ioState, const string& inPiece) const;
+            virtual bool hasUnigramsForKeyPrefix(size_t inState) const;
+
+            // the most readings any key with unigrams is made of, when keys
+            // join readings with the separator; 0, the default, means unknown
+            virtual size_t maximumKeySpanLength(const string& separator) const;
+
+            // The const query path, for sharing one model between threads.
+            // A model that returns true from hasConstQueries() answers these,
+            // and the const methods above, without changing any of its state,
+            // so any number of threads may call them at once as long as none
+            // modifies the model (loads, closes it) meanwhile. The grams are
+            // put into the caller's vectors, replacing what was there. The
+            // methods above that aren't const are not part of it. The defaults don't
+            // support it and find nothing; see SharedLanguageModel.h for
+            // using a model through this path.
+            virtual bool hasConstQueries() const;
+            virtual void readUnigramsForKey(const string& key, vector<Unigram>& outUnigrams) const;
+            virtual void readBigramsForKeys(const string& preceedingKey, const string& key, vector<Bigram>& outBigrams) const;
         };
+
+        inline const UnigramView LanguageModel::unigramViewForKey(const string& key, vector<Unigram>& ioBuffer)
+        {
+            ioBuffer = unigramsForKeys(key);
+            return UnigramView(ioBuffer);
+        }
+
+        inline const BigramView LanguageModel::bigramViewForKeys(const string& preceedingKey, const string& key, vector<Bigram>& ioBuffer)
+        {
+            ioBuffer = bigramsForKeys(preceedingKey, key);
+            return BigramView(ioBuffer);
+        }
+
+        inline bool LanguageModel::keyPrefixRoot(size_t& /* outState */) const
+        {
+            return false;
+        }
+
+        inline bool LanguageModel::advanceKeyPrefix(size_t& /* ioState */, const string& /* inPiece */) const
+        {
+            return false;
+        }
+
+        inline bool LanguageModel::hasUnigramsForKeyPrefix(size_t /* inState */) const
+        {
+            return false;
+        }
+
+        inline size_t LanguageModel::maximumKeySpanLength(const string& /* separator */) const
+        {
+            return 0;
+        }
+
+        inline bool LanguageModel::hasConstQueries() const
+        {
+            return false;
+        }
+
+        inline void LanguageModel::readUnigramsForKey(const string& /* key */, vector<Unigram>& outUnigrams) const
+        {
+            outUnigrams.clear();
+        }
+
+        inline void LanguageModel::readBigramsForKeys(const string& /* preceedingKey */, const string& /* key */, vector<Bigram>& outBigrams) const
+        {
+            outBigrams.clear();
+        }
     };
 };
 
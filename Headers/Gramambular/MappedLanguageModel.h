@@ -0,0 +1,705 @@
+//
+// MappedLanguageModel.h
+//
+// Copyright (c) 2007-2010 Lukhnos D. Liu (http://lukhnos.org)
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef MappedLanguageModel_h
+#define MappedLanguageModel_h
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include "DoubleArrayTrie.h"
+#include "LanguageModel.h"
+
+#ifdef _WIN32
+    #include <iterator>
+    #include <vector>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace Formosa {
+    namespace Gramambular {
+        using namespace std;
+
+        // A language model that reads a compiled binary file in place. The
+        // file is mapped into memory, so opening it costs the same however
+        // large the lexicon is, and processes using the same file share its
+        // pages. Compile() produces the file from the text format SimpleLM
+        // reads: "key value score" lines for unigrams, and optionally
+        // "preceedingKey preceedingValue key value score" lines for bigrams.
+        //
+        // The file holds a header, the unigram and bigram records, a key
+        // table sorted by key bytes, a double-array trie over the keys and a
+        // string pool. Keys are found through the trie, which maps each one
+        // to its key table index, and a key's unigrams and bigrams are
+        // contiguous runs of records. Numbers are in the byte order of the compiling
+        // machine; open() rejects a file of the other order.
+        class MappedLanguageModel : public LanguageModel {
+        public:
+            MappedLanguageModel();
+            ~MappedLanguageModel();
+
+            bool open(const string& inPath);
+            void close();
+            bool isOpen() const;
+
+            virtual const vector<Bigram> bigramsForKeys(const string &preceedingKey, const string& key);
+            virtual const vector<Unigram> unigramsForKeys(const string &key);
+            virtual bool hasUnigramsForKey(const string& key);
+
+            // the records hold offsets into the string pool and not grams,
+            // so the grams are read straight into the caller's buffer
+            virtual const UnigramView unigramViewForKey(const string& key, vector<Unigram>& ioBuffer);
+            virtual const BigramView bigramViewForKeys(const string& preceedingKey, const string& key, vector<Bigram>& ioBuffer);
+
+            // traverses the key index
+            virtual bool keyPrefixRoot(size_t& outState) const;
+            virtual bool advanceKeyPrefix(size_t& ioState, const string& inPiece) const;
+            virtual bool hasUnigramsForKeyPrefix(size_t inState) const;
+
+            // counts separators in every key, once per separator
+            virtual size_t maximumKeySpanLength(const string& separator) const;
+
+            // the mapped data is never written, so an open model can be
+            // shared by threads through the const path
+            virtual bool hasConstQueries() const;
+            virtual void readUnigramsForKey(const string& key, vector<Unigram>& outUnigrams) const;
+            virtual void readBigramsForKeys(const string& preceedingKey, const string& key, vector<Bigram>& outBigrams) const;
+
+            // returns false, with the offending line in outError, if the source can't be parsed
+            static bool Compile(istream& inSource, ostream& outBinary, string& outError);
+
+            // the key index, for prefix searches over the model's keys
+            const DoubleArrayTrie& keyIndex() const;
+
+        protected:
+            struct Header {
+                char magic[8];
+                uint32_t byteOrderMark;
+                uint32_t version;
+                uint32_t keyCount;
+                uint32_t unigramCount;
+                uint32_t bigramCount;
+                uint32_t stringPoolSize;
+                uint64_t keyTableOffset;
+                uint64_t unigramTableOffset;
+                uint64_t bigramTableOffset;
+                uint64_t stringPoolOffset;
+                uint32_t trieUnitCount;
+                uint32_t reserved;
+                uint64_t trieOffset;
+            };
+
+            struct KeyRecord {
+                uint32_t keyOffset;
+                uint32_t keyLength;
+                uint32_t firstUnigram;
+                uint32_t unigramCount;
+                uint32_t firstBigram;
+                uint32_t bigramCount;
+            };
+
+            struct UnigramRecord {
+                uint32_t valueOffset;
+                uint32_t valueLength;
+                double score;
+            };
+
+            // a key's bigrams are sorted by preceedingKeyIndex
+            struct BigramRecord {
+                uint32_t preceedingKeyIndex;
+                uint32_t preceedingValueOffset;
+                uint32_t preceedingValueLength;
+                uint32_t valueOffset;
+                uint32_t valueLength;
+                uint32_t reserved;
+                double score;
+            };
+
+            static const char* Magic();
+            static const uint32_t ByteOrderMark = 0x01020304;
+            static const uint32_t Version = 2;
+
+            // returns the index of inKey in the key table, or the key count if there is none
+            size_t indexOfKey(const string& inKey) const;
+            const string stringAt(uint32_t inOffset, uint32_t inLength) const;
+            bool mapData(const string& inPath);
+            bool validate() const;
+
+            const char* m_data;
+            size_t m_size;
+
+            const Header* m_header;
+            const KeyRecord* m_keys;
+            const UnigramRecord* m_unigrams;
+            const BigramRecord* m_bigrams;
+            const char* m_strings;
+            DoubleArrayTrie m_keyIndex;
+
+            // counted on first use; the lock lets threads sharing the model ask
+            mutable map<string, size_t> m_maximumKeySpanLengths;
+            mutable mutex m_maximumKeySpanLengthsLock;
+
+        #ifdef _WIN32
+            // no mapping on Windows; the file is read into memory instead
+            vector<char> m_buffer;
+        #endif
+        };
+
+        inline MappedLanguageModel::MappedLanguageModel()
+            : m_data(0)
+            , m_size(0)
+            , m_header(0)
+            , m_keys(0)
+            , m_unigrams(0)
+            , m_bigrams(0)
+            , m_strings(0)
+        {
+        }
+
+        inline MappedLanguageModel::~MappedLanguageModel()
+        {
+            close();
+        }
+
+        inline const char* MappedLanguageModel::Magic()
+        {
+            return "GRAMLM\0";
+        }
+
+        inline bool MappedLanguageModel::open(const string& inPath)
+        {
+            close();
+
+            if (!mapData(inPath)) {
+                return false;
+            }
+
+            if (!validate()) {
+                close();
+                return false;
+            }
+
+            m_header = reinterpret_cast<const Header*>(m_data);
+            m_keys = reinterpret_cast<const KeyRecord*>(m_data + m_header->keyTableOffset);
+            m_unigrams = reinterpret_cast<const UnigramRecord*>(m_data + m_header->unigramTableOffset);
+            m_bigrams = reinterpret_cast<const BigramRecord*>(m_data + m_header->bigramTableOffset);
+            m_strings = m_data + m_header->stringPoolOffset;
+            m_keyIndex.attach(reinterpret_cast<const DoubleArrayTrie::Unit*>(m_data + m_header->trieOffset), m_header->trieUnitCount);
+            return true;
+        }
+
+        inline void MappedLanguageModel::close()
+        {
+            if (m_data) {
+            #ifdef _WIN32
+                m_buffer.clear();
+            #else
+                munmap(const_cast<char*>(m_data), m_size);
+            #endif
+            }
+
+            m_data = 0;
+            m_size = 0;
+            m_header = 0;
+            m_keys = 0;
+            m_unigrams = 0;
+            m_bigrams = 0;
+            m_strings = 0;
+            m_keyIndex.attach(0, 0);
+            lock_guard<mutex> lock(m_maximumKeySpanLengthsLock);
+            m_maximumKeySpanLengths.clear();
+        }
+
+        inline bool MappedLanguageModel::isOpen() const
+        {
+            return m_header != 0;
+        }
+
+        inline bool MappedLanguageModel::mapData(const string& inPath)
+        {
+        #ifdef _WIN32
+            ifstream ifs(inPath.c_str(), ios::binary);
+            if (!ifs) {
+                return false;
+            }
+
+            m_buffer.assign(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+            if (m_buffer.empty()) {
+                return false;
+            }
+
+            m_data = &m_buffer[0];
+            m_size = m_buffer.size();
+            return true;
+        #else
+            int fd = ::open(inPath.c_str(), O_RDONLY);
+            if (fd == -1) {
+                return false;
+            }
+
+            struct stat st;
+            if (fstat(fd, &st) == -1 || !st.st_size) {
+                ::close(fd);
+                return false;
+            }
+
+            void* data = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+
+            if (data == MAP_FAILED) {
+                return false;
+            }
+
+            m_data = (const char*)data;
+            m_size = (size_t)st.st_size;
+            return true;
+        #endif
+        }
+
+        inline bool MappedLanguageModel::validate() const
+        {
+            if (m_size < sizeof(Header)) {
+                return false;
+            }
+
+            const Header* header = reinterpret_cast<const Header*>(m_data);
+            if (memcmp(header->magic, Magic(), sizeof(header->magic)) || header->byteOrderMark != ByteOrderMark || header->version != Version) {
+                return false;
+            }
+
+            // the tables must lie within the file; records are checked as they are read
+            if (header->keyTableOffset > m_size || (m_size - header->keyTableOffset) / sizeof(KeyRecord) < header->keyCount) {
+                return false;
+            }
+
+            if (header->unigramTableOffset > m_size || (m_size - header->unigramTableOffset) / sizeof(UnigramRecord) < header->unigramCount) {
+                return false;
+            }
+
+            if (header->bigramTableOffset > m_size || (m_size - header->bigramTableOffset) / sizeof(BigramRecord) < header->bigramCount) {
+                return false;
+            }
+
+            if (header->stringPoolOffset > m_size || m_size - header->stringPoolOffset < header->stringPoolSize) {
+                return false;
+            }
+
+            if (header->trieOffset > m_size || (m_size - header->trieOffset) / sizeof(DoubleArrayTrie::Unit) < header->trieUnitCount) {
+                return false;
+            }
+
+            // the records are read in place, so their tables have to be aligned
+            return !(header->keyTableOffset % 8 || header->unigramTableOffset % 8 || header->bigramTableOffset % 8 || header->trieOffset % 8);
+        }
+
+        inline size_t MappedLanguageModel::indexOfKey(const string& inKey) const
+        {
+            uint32_t index;
+            if (!m_keyIndex.find(inKey, index) || index >= m_header->keyCount) {
+                return m_header->keyCount;
+            }
+
+            return index;
+        }
+
+        inline const DoubleArrayTrie& MappedLanguageModel::keyIndex() const
+        {
+            return m_keyIndex;
+        }
+
+        inline const string MappedLanguageModel::stringAt(uint32_t inOffset, uint32_t inLength) const
+        {
+            if (inOffset > m_header->stringPoolSize || inLength > m_header->stringPoolSize - inOffset) {
+                return string();
+            }
+
+            return string(m_strings + inOffset, inLength);
+        }
+
+        inline const vector<Bigram> MappedLanguageModel::bigramsForKeys(const string &preceedingKey, const string& key)
+        {
+            vector<Bigram> result;
+            readBigramsForKeys(preceedingKey, key, result);
+            return result;
+        }
+
+        inline const vector<Unigram> MappedLanguageModel::unigramsForKeys(const string &key)
+        {
+            vector<Unigram> result;
+            readUnigramsForKey(key, result);
+            return result;
+        }
+
+        inline const UnigramView MappedLanguageModel::unigramViewForKey(const string& key, vector<Unigram>& ioBuffer)
+        {
+            readUnigramsForKey(key, ioBuffer);
+            return UnigramView(ioBuffer);
+        }
+
+        inline const BigramView MappedLanguageModel::bigramViewForKeys(const string& preceedingKey, const string& key, vector<Bigram>& ioBuffer)
+        {
+            readBigramsForKeys(preceedingKey, key, ioBuffer);
+            return BigramView(ioBuffer);
+        }
+
+        inline bool MappedLanguageModel::hasConstQueries() const
+        {
+            return true;
+        }
+
+        inline void MappedLanguageModel::readBigramsForKeys(const string& preceedingKey, const string& key, vector<Bigram>& outBigrams) const
+        {
+            outBigrams.clear();
+            if (!isOpen()) {
+                return;
+            }
+
+            size_t keyIndex = indexOfKey(key);
+            size_t preceedingKeyIndex = indexOfKey(preceedingKey);
+            if (keyIndex == m_header->keyCount || preceedingKeyIndex == m_header->keyCount) {
+                return;
+            }
+
+            const KeyRecord& record = m_keys[keyIndex];
+            if (record.firstBigram > m_header->bigramCount || record.bigramCount > m_header->bigramCount - record.firstBigram) {
+                return;
+            }
+
+            const BigramRecord* begin = m_bigrams + record.firstBigram;
+            const BigramRecord* end = begin + record.bigramCount;
+            for (const BigramRecord* bi = begin ; bi != end ; ++bi) {
+                if ((*bi).preceedingKeyIndex < preceedingKeyIndex) {
+                    continue;
+                }
+
+                if ((*bi).preceedingKeyIndex > preceedingKeyIndex) {
+                    break;
+                }
+
+                Bigram bigram;
+                bigram.preceedingKeyValue.key = preceedingKey;
+                bigram.preceedingKeyValue.value = stringAt((*bi).preceedingValueOffset, (*bi).preceedingValueLength);
+                bigram.keyValue.key = key;
+                bigram.keyValue.value = stringAt((*bi).valueOffset, (*bi).valueLength);
+                bigram.score = (*bi).score;
+                outBigrams.push_back(bigram);
+            }
+        }
+
+        inline void MappedLanguageModel::readUnigramsForKey(const string& key, vector<Unigram>& outUnigrams) const
+        {
+            outUnigrams.clear();
+            if (!isOpen()) {
+                return;
+            }
+
+            size_t keyIndex = indexOfKey(key);
+            if (keyIndex == m_header->keyCount) {
+                return;
+            }
+
+            const KeyRecord& record = m_keys[keyIndex];
+            if (record.firstUnigram > m_header->unigramCount || record.unigramCount > m_header->unigramCount - record.firstUnigram) {
+                return;
+            }
+
+            outUnigrams.reserve(record.unigramCount);
+            const UnigramRecord* begin = m_unigrams + record.firstUnigram;
+            const UnigramRecord* end = begin + record.unigramCount;
+            for (const UnigramRecord* ui = begin ; ui != end ; ++ui) {
+                Unigram unigram;
+                unigram.keyValue.key = key;
+                unigram.keyValue.value = stringAt((*ui).valueOffset, (*ui).valueLength);
+                unigram.score = (*ui).score;
+                outUnigrams.push_back(unigram);
+            }
+        }
+
+        inline bool MappedLanguageModel::hasUnigramsForKey(const string& key)
+        {
+            if (!isOpen()) {
+                return false;
+            }
+
+            // keys that only precede bigrams are in the table without unigrams
+            size_t keyIndex = indexOfKey(key);
+            return keyIndex != m_header->keyCount && m_keys[keyIndex].unigramCount;
+        }
+
+        inline bool MappedLanguageModel::keyPrefixRoot(size_t& outState) const
+        {
+            if (!isOpen()) {
+                return false;
+            }
+
+            outState = DoubleArrayTrie::RootNode();
+            return true;
+        }
+
+        inline bool MappedLanguageModel::advanceKeyPrefix(size_t& ioState, const string& inPiece) const
+        {
+            return isOpen() && m_keyIndex.advance(ioState, inPiece.data(), inPiece.size());
+        }
+
+        inline bool MappedLanguageModel::hasUnigramsForKeyPrefix(size_t inState) const
+        {
+            uint32_t keyIndex;
+            if (!isOpen() || !m_keyIndex.valueAtNode(inState, keyIndex) || keyIndex >= m_header->keyCount) {
+                return false;
+            }
+
+            return m_keys[keyIndex].unigramCount != 0;
+        }
+
+        inline size_t MappedLanguageModel::maximumKeySpanLength(const string& separator) const
+        {
+            // without a separator there is no telling where readings end
+            if (!isOpen() || !separator.size()) {
+                return 0;
+            }
+
+            lock_guard<mutex> lock(m_maximumKeySpanLengthsLock);
+
+            map<string, size_t>::const_iterator f = m_maximumKeySpanLengths.find(separator);
+            if (f != m_maximumKeySpanLengths.end()) {
+                return (*f).second;
+            }
+
+            size_t maximum = 0;
+            for (size_t i = 0 ; i < m_header->keyCount ; i++) {
+                const KeyRecord& record = m_keys[i];
+                if (!record.unigramCount || record.keyOffset > m_header->stringPoolSize || record.keyLength > m_header->stringPoolSize - record.keyOffset) {
+                    continue;
+                }
+
+                const char* key = m_strings + record.keyOffset;
+                const char* keyEnd = key + record.keyLength;
+                size_t length = 1;
+                for (const char* p = search(key, keyEnd, separator.begin(), separator.end()) ; p != keyEnd ; p = search(p + separator.size(), keyEnd, separator.begin(), separator.end())) {
+                    length++;
+                }
+
+                if (length > maximum) {
+                    maximum = length;
+                }
+            }
+
+            m_maximumKeySpanLengths[separator] = maximum;
+            return maximum;
+        }
+
+        inline bool MappedLanguageModel::Compile(istream& inSource, ostream& outBinary, string& outError)
+        {
+            struct SourceBigram {
+                string preceedingKey;
+                string preceedingValue;
+                string value;
+                double score;
+            };
+
+            struct SourceKey {
+                vector<pair<string, double> > unigrams;
+                vector<SourceBigram> bigrams;
+            };
+
+            // a map keeps the keys in the byte order indexOfKey() searches in
+            map<string, SourceKey> keys;
+            size_t lineNumber = 0;
+            string line;
+
+            while (getline(inSource, line)) {
+                lineNumber++;
+                if (!line.size() || line[0] == '#') {
+                    continue;
+                }
+
+                istringstream fields(line);
+                vector<string> p;
+                string field;
+                while (fields >> field) {
+                    p.push_back(field);
+                }
+
+                if (!p.size()) {
+                    continue;
+                }
+
+                double score = 0.0;
+                istringstream scoreField(p.back());
+                if ((p.size() != 3 && p.size() != 5) || !(scoreField >> score)) {
+                    stringstream error;
+                    error << "line " << lineNumber << ": expected \"key value score\" or \"preceedingKey preceedingValue key value score\"";
+                    outError = error.str();
+                    return false;
+                }
+
+                if (p.size() == 3) {
+                    keys[p[0]].unigrams.push_back(make_pair(p[1], score));
+                }
+                else {
+                    SourceBigram bigram;
+                    bigram.preceedingKey = p[0];
+                    bigram.preceedingValue = p[1];
+                    bigram.value = p[3];
+                    bigram.score = score;
+                    keys[p[2]].bigrams.push_back(bigram);
+                    keys[p[0]];
+                }
+            }
+
+            string strings;
+            map<string, uint32_t> stringOffsets;
+            vector<KeyRecord> keyRecords;
+            vector<UnigramRecord> unigramRecords;
+            vector<BigramRecord> bigramRecords;
+            map<string, uint32_t> keyIndices;
+
+            struct Pool {
+                static uint32_t Add(const string& inString, string& ioStrings, map<string, uint32_t>& ioOffsets) {
+                    map<string, uint32_t>::const_iterator f = ioOffsets.find(inString);
+                    if (f != ioOffsets.end()) {
+                        return (*f).second;
+                    }
+
+                    uint32_t offset = (uint32_t)ioStrings.size();
+                    ioStrings += inString;
+                    ioOffsets[inString] = offset;
+                    return offset;
+                }
+            };
+
+            vector<string> sortedKeys;
+            uint32_t keyIndex = 0;
+            for (map<string, SourceKey>::const_iterator ki = keys.begin() ; ki != keys.end() ; ++ki) {
+                keyIndices[(*ki).first] = keyIndex++;
+                sortedKeys.push_back((*ki).first);
+            }
+
+            DoubleArrayTrie trie;
+            if (!trie.build(sortedKeys)) {
+                outError = "too many keys";
+                return false;
+            }
+
+            for (map<string, SourceKey>::const_iterator ki = keys.begin() ; ki != keys.end() ; ++ki) {
+                const SourceKey& source = (*ki).second;
+
+                KeyRecord record;
+                record.keyOffset = Pool::Add((*ki).first, strings, stringOffsets);
+                record.keyLength = (uint32_t)(*ki).first.size();
+                record.firstUnigram = (uint32_t)unigramRecords.size();
+                record.unigramCount = (uint32_t)source.unigrams.size();
+                record.firstBigram = (uint32_t)bigramRecords.size();
+                record.bigramCount = (uint32_t)source.bigrams.size();
+                keyRecords.push_back(record);
+
+                for (vector<pair<string, double> >::const_iterator ui = source.unigrams.begin() ; ui != source.unigrams.end() ; ++ui) {
+                    UnigramRecord unigram;
+                    unigram.valueOffset = Pool::Add((*ui).first, strings, stringOffsets);
+                    unigram.valueLength = (uint32_t)(*ui).first.size();
+                    unigram.score = (*ui).second;
+                    unigramRecords.push_back(unigram);
+                }
+
+                size_t firstBigram = bigramRecords.size();
+                for (vector<SourceBigram>::const_iterator bi = source.bigrams.begin() ; bi != source.bigrams.end() ; ++bi) {
+                    BigramRecord bigram;
+                    bigram.preceedingKeyIndex = keyIndices[(*bi).preceedingKey];
+                    bigram.preceedingValueOffset = Pool::Add((*bi).preceedingValue, strings, stringOffsets);
+                    bigram.preceedingValueLength = (uint32_t)(*bi).preceedingValue.size();
+                    bigram.valueOffset = Pool::Add((*bi).value, strings, stringOffsets);
+                    bigram.valueLength = (uint32_t)(*bi).value.size();
+                    bigram.reserved = 0;
+                    bigram.score = (*bi).score;
+                    bigramRecords.push_back(bigram);
+                }
+
+                struct ByPreceedingKey {
+                    bool operator()(const BigramRecord& inA, const BigramRecord& inB) const {
+                        return inA.preceedingKeyIndex < inB.preceedingKeyIndex;
+                    }
+                };
+                stable_sort(bigramRecords.begin() + firstBigram, bigramRecords.end(), ByPreceedingKey());
+            }
+
+            if (strings.size() > numeric_limits<uint32_t>::max() || keyRecords.size() > numeric_limits<uint32_t>::max() || unigramRecords.size() > numeric_limits<uint32_t>::max() || bigramRecords.size() > numeric_limits<uint32_t>::max()) {
+                outError = "source too large";
+                return false;
+            }
+
+            Header header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, Magic(), sizeof(header.magic));
+            header.byteOrderMark = ByteOrderMark;
+            header.version = Version;
+            header.keyCount = (uint32_t)keyRecords.size();
+            header.unigramCount = (uint32_t)unigramRecords.size();
+            header.bigramCount = (uint32_t)bigramRecords.size();
+            header.stringPoolSize = (uint32_t)strings.size();
+
+            // every record size is a multiple of 8, so the tables stay aligned
+            header.unigramTableOffset = sizeof(Header);
+            header.bigramTableOffset = header.unigramTableOffset + unigramRecords.size() * sizeof(UnigramRecord);
+            header.keyTableOffset = header.bigramTableOffset + bigramRecords.size() * sizeof(BigramRecord);
+            header.trieUnitCount = (uint32_t)trie.unitCount();
+            header.trieOffset = header.keyTableOffset + keyRecords.size() * sizeof(KeyRecord);
+            header.stringPoolOffset = header.trieOffset + trie.unitCount() * sizeof(DoubleArrayTrie::Unit);
+
+            outBinary.write((const char*)&header, sizeof(header));
+            if (unigramRecords.size()) {
+                outBinary.write((const char*)&unigramRecords[0], unigramRecords.size() * sizeof(UnigramRecord));
+            }
+            if (bigramRecords.size()) {
+                outBinary.write((const char*)&bigramRecords[0], bigramRecords.size() * sizeof(BigramRecord));
+            }
+            if (keyRecords.size()) {
+                outBinary.write((const char*)&keyRecords[0], keyRecords.size() * sizeof(KeyRecord));
+            }
+            outBinary.write((const char*)trie.units(), trie.unitCount() * sizeof(DoubleArrayTrie::Unit));
+            outBinary.write(strings.data(), strings.size());
+
+            if (!outBinary) {
+                outError = "write failed";
+                return false;
+            }
+
+            return true;
+        }
+    };
+};
+
+#endif
@@ -28,7 +28,9 @@
 #ifndef Node_h
 #define Node_h
 
+#include <algorithm>
 #include <limits>
+#include <map>
 #include <vector>
 #include "LanguageModel.h"
 
@@ -39,13 +41,17 @@ namespace Formosa {
         class Node {
         public:
             Node();
-            Node(const string& inKey, const vector<Unigram>& inUnigrams, const vector<Bigram>& inBigrams);
+            // inUnigrams is taken by value so that a temporary from the
+            // language model can be moved in rather than copied
+            Node(const string& inKey, vector<Unigram> inUnigrams, const vector<Bigram>& inBigrams);
             
             void primeNodeWithPreceedingKeyValues(const vector<KeyValuePair>& inKeyValues);
             
             bool isCandidateFixed() const;
             const vector<KeyValuePair>& candidates() const;
+            const vector<Unigram>& unigrams() const;
             void selectCandidateAtIndex(size_t inIndex = 0, bool inFix = true);
+            size_t selectedUnigramIndex() const;
             
             const string& key() const;
             double score() const;
@@ -59,7 +65,6 @@ namespace Formosa {
             
             vector<Unigram> m_unigrams;
             vector<KeyValuePair> m_candidates;
-            map<string, size_t> m_valueUnigramIndexMap;
             map<KeyValuePair, vector<Bigram> > m_preceedingGramBigramMap;
             
             bool m_candidateFixed;
@@ -77,15 +82,17 @@ namespace Formosa {
         }
 
         inline Node::Node()
-            : m_candidateFixed(false)
+            : m_LM(0)
+            , m_candidateFixed(false)
             , m_selectedUnigramIndex(0)
             , m_score(0.0)
         {
         }
 
-        inline Node::Node(const string& inKey, const vector<Unigram>& inUnigrams, const vector<Bigram>& inBigrams)
-            : m_key(inKey)
-            , m_unigrams(inUnigrams)
+        inline Node::Node(const string& inKey, vector<Unigram> inUnigrams, const vector<Bigram>& inBigrams)
+            : m_LM(0)
+            , m_key(inKey)
+            , m_unigrams(std::move(inUnigrams))
             , m_candidateFixed(false)
             , m_selectedUnigramIndex(0)
             , m_score(0.0)
@@ -96,11 +103,8 @@ namespace Formosa {
                 m_score = m_unigrams[0].score;
             }
             
-            size_t i = 0;
+            m_candidates.reserve(m_unigrams.size());
             for (vector<Unigram>::const_iterator ui = m_unigrams.begin() ; ui != m_unigrams.end() ; ++ui) {
-                m_valueUnigramIndexMap[(*ui).keyValue.value] = i;
-                i++;
-                
                 m_candidates.push_back((*ui).keyValue);
             }
             
@@ -123,10 +127,14 @@ namespace Formosa {
                         for (vector<Bigram>::const_iterator bi = bigrams.begin() ; bi != bigrams.end() ; ++bi) {
                             const Bigram& bigram = *bi;
                             if (bigram.score > max) {
-                                map<string, size_t>::const_iterator uf = m_valueUnigramIndexMap.find((*bi).keyValue.value);
-                                if (uf != m_valueUnigramIndexMap.end()) {
-                                    newIndex = (*uf).second;
-                                    max = bigram.score;
+                                // a node has a handful of candidates, so a scan beats keeping a map;
+                                // scanning from the end picks the last of duplicate values
+                                for (size_t ui = m_unigrams.size() ; ui-- > 0 ; ) {
+                                    if (m_unigrams[ui].keyValue.value == bigram.keyValue.value) {
+                                        newIndex = ui;
+                                        max = bigram.score;
+                                        break;
+                                    }
                                 }
                             }
                         }
@@ -153,6 +161,11 @@ namespace Formosa {
             return m_candidates;
         }
 
+        inline const vector<Unigram>& Node::unigrams() const
+        {
+            return m_unigrams;
+        }
+
         inline void Node::selectCandidateAtIndex(size_t inIndex, bool inFix)
         {
             if (inIndex >= m_unigrams.size()) {
@@ -166,6 +179,11 @@ namespace Formosa {
             m_score = 99;
         }        
         
+        inline size_t Node::selectedUnigramIndex() const
+        {
+            return m_selectedUnigramIndex;
+        }
+
         inline const string& Node::key() const
         {
             return m_key;
@@ -0,0 +1,195 @@
+//
+// ParallelConverter.h
+//
+// Copyright (c) 2007-2010 Lukhnos D. Liu (http://lukhnos.org)
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef ParallelConverter_h
+#define ParallelConverter_h
+
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "BatchConverter.h"
+#include "SharedLanguageModel.h"
+
+namespace Formosa {
+    namespace Gramambular {
+        using namespace std;
+
+        // Converts many sentences at once on several threads that all read
+        // one shared model through its const path (see LanguageModel.h).
+        // Every thread has its own reader and BatchConverter, and starts with
+        // an even share of the sentences; a thread that runs out takes the
+        // back half of what another thread has left, so threads that happen
+        // to get short sentences help out those that got long ones.
+        class ParallelConverter {
+        public:
+            // inThreadCount 0 means one thread per core; the model must have
+            // const queries and outlive the converter
+            ParallelConverter(const LanguageModel* inSharedModel, const string& inJoinSeparator, size_t inThreadCount = 0);
+
+            ParallelConverter(const ParallelConverter&) = delete;
+            ParallelConverter& operator=(const ParallelConverter&) = delete;
+
+            size_t threadCount() const;
+
+            // converts inSentences[i] into outResults[i], as BatchConverter
+            // does; the calling thread is one of the threads
+            void convert(const vector<vector<string> >& inSentences, vector<string>& outResults);
+
+            // the same for the first inCount sentences only, so that a
+            // caller can keep reusing one vector of sentences
+            void convert(const vector<vector<string> >& inSentences, size_t inCount, vector<string>& outResults);
+
+        protected:
+            // the sentences a thread has left, [begin, end); the owner takes
+            // from the front, other threads steal from the back
+            struct WorkRange {
+                mutex lock;
+                size_t begin;
+                size_t end;
+            };
+
+            void work(size_t inThread, const vector<vector<string> >& inSentences, vector<string>& outResults);
+            bool takeSentence(size_t inThread, size_t& outIndex);
+            bool stealSentences(size_t inThread);
+
+            vector<unique_ptr<LanguageModelReader> > m_readers;
+            vector<unique_ptr<BatchConverter> > m_converters;
+            vector<WorkRange> m_ranges;
+        };
+
+        inline ParallelConverter::ParallelConverter(const LanguageModel* inSharedModel, const string& inJoinSeparator, size_t inThreadCount)
+        {
+            if (!inThreadCount) {
+                inThreadCount = thread::hardware_concurrency();
+            }
+
+            if (!inThreadCount) {
+                inThreadCount = 1;
+            }
+
+            for (size_t i = 0 ; i < inThreadCount ; i++) {
+                m_readers.push_back(unique_ptr<LanguageModelReader>(new LanguageModelReader(inSharedModel)));
+                m_converters.push_back(unique_ptr<BatchConverter>(new BatchConverter(m_readers.back().get(), inJoinSeparator)));
+            }
+
+            vector<WorkRange>(inThreadCount).swap(m_ranges);
+        }
+
+        inline size_t ParallelConverter::threadCount() const
+        {
+            return m_converters.size();
+        }
+
+        inline void ParallelConverter::convert(const vector<vector<string> >& inSentences, vector<string>& outResults)
+        {
+            convert(inSentences, inSentences.size(), outResults);
+        }
+
+        inline void ParallelConverter::convert(const vector<vector<string> >& inSentences, size_t inCount, vector<string>& outResults)
+        {
+            if (inCount > inSentences.size()) {
+                inCount = inSentences.size();
+            }
+
+            outResults.resize(inCount);
+
+            size_t count = m_ranges.size();
+            for (size_t i = 0 ; i < count ; i++) {
+                m_ranges[i].begin = inCount * i / count;
+                m_ranges[i].end = inCount * (i + 1) / count;
+            }
+
+            vector<thread> threads;
+            for (size_t i = 1 ; i < count && i < inCount ; i++) {
+                threads.push_back(thread(&ParallelConverter::work, this, i, ref(inSentences), ref(outResults)));
+            }
+
+            work(0, inSentences, outResults);
+
+            for (size_t i = 0 ; i < threads.size() ; i++) {
+                threads[i].join();
+            }
+        }
+
+        inline void ParallelConverter::work(size_t inThread, const vector<vector<string> >& inSentences, vector<string>& outResults)
+        {
+            BatchConverter& converter = *m_converters[inThread];
+            size_t index;
+
+            do {
+                while (takeSentence(inThread, index)) {
+                    outResults[index] = converter.convert(inSentences[index]);
+                }
+            } while (stealSentences(inThread));
+        }
+
+        inline bool ParallelConverter::takeSentence(size_t inThread, size_t& outIndex)
+        {
+            WorkRange& range = m_ranges[inThread];
+            lock_guard<mutex> lock(range.lock);
+            if (range.begin == range.end) {
+                return false;
+            }
+
+            outIndex = range.begin++;
+            return true;
+        }
+
+        inline bool ParallelConverter::stealSentences(size_t inThread)
+        {
+            size_t count = m_ranges.size();
+            for (size_t i = 1 ; i < count ; i++) {
+                WorkRange& victim = m_ranges[(inThread + i) % count];
+                size_t begin;
+                size_t end;
+                {
+                    lock_guard<mutex> lock(victim.lock);
+                    if (victim.begin == victim.end) {
+                        continue;
+                    }
+
+                    begin = victim.end - (victim.end - victim.begin + 1) / 2;
+                    end = victim.end;
+                    victim.end = begin;
+                }
+
+                // sentences in flight here are invisible to other thieves,
+                // which at worst makes one of them stop a little early
+                WorkRange& range = m_ranges[inThread];
+                lock_guard<mutex> lock(range.lock);
+                range.begin = begin;
+                range.end = end;
+                return true;
+            }
+
+            return false;
+        }
+    };
+};
+
+#endif
@@ -0,0 +1,236 @@
+//
+// SharedLanguageModel.h
+//
+// Copyright (c) 2007-2010 Lukhnos D. Liu (http://lukhnos.org)
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef SharedLanguageModel_h
+#define SharedLanguageModel_h
+
+#include <mutex>
+#include "LanguageModel.h"
+
+namespace Formosa {
+    namespace Gramambular {
+        using namespace std;
+
+        // A thread's own front for a model shared between threads. It answers
+        // everything through the shared model's const path, reading views
+        // into the caller's buffer, so builders and walkers on different
+        // threads can each have a reader over one model. The shared model
+        // must have const queries (wrap one that hasn't in a
+        // SynchronizedLanguageModel), and must outlive its readers.
+        class LanguageModelReader : public LanguageModel {
+        public:
+            LanguageModelReader(const LanguageModel* inSharedModel);
+
+            virtual const vector<Bigram> bigramsForKeys(const string &preceedingKey, const string& key);
+            virtual const vector<Unigram> unigramsForKeys(const string &key);
+            virtual bool hasUnigramsForKey(const string& key);
+            virtual const UnigramView unigramViewForKey(const string& key, vector<Unigram>& ioBuffer);
+            virtual const BigramView bigramViewForKeys(const string& preceedingKey, const string& key, vector<Bigram>& ioBuffer);
+
+            virtual bool keyPrefixRoot(size_t& outState) const;
+            virtual bool advanceKeyPrefix(size_t& ioState, const string& inPiece) const;
+            virtual bool hasUnigramsForKeyPrefix(size_t inState) const;
+            virtual size_t maximumKeySpanLength(const string& separator) const;
+
+            virtual bool hasConstQueries() const;
+            virtual void readUnigramsForKey(const string& key, vector<Unigram>& outUnigrams) const;
+            virtual void readBigramsForKeys(const string& preceedingKey, const string& key, vector<Bigram>& outBigrams) const;
+
+        protected:
+            const LanguageModel* m_sharedModel;
+
+            // for hasUnigramsForKey()
+            vector<Unigram> m_unigrams;
+        };
+
+        // Gives any model a const path by taking a lock around every query,
+        // for sharing a model that keeps state as it answers (a cache, a
+        // database handle). Threads then take turns in the model, so this is
+        // for models that are cheap to query or rarely queried; one that
+        // can be read concurrently should have const queries of its own.
+        class SynchronizedLanguageModel : public LanguageModel {
+        public:
+            SynchronizedLanguageModel(LanguageModel* inModel);
+
+            virtual const vector<Bigram> bigramsForKeys(const string &preceedingKey, const string& key);
+            virtual const vector<Unigram> unigramsForKeys(const string &key);
+            virtual bool hasUnigramsForKey(const string& key);
+
+            virtual bool keyPrefixRoot(size_t& outState) const;
+            virtual bool advanceKeyPrefix(size_t& ioState, const string& inPiece) const;
+            virtual bool hasUnigramsForKeyPrefix(size_t inState) const;
+            virtual size_t maximumKeySpanLength(const string& separator) const;
+
+            virtual bool hasConstQueries() const;
+            virtual void readUnigramsForKey(const string& key, vector<Unigram>& outUnigrams) const;
+            virtual void readBigramsForKeys(const string& preceedingKey, const string& key, vector<Bigram>& outBigrams) const;
+
+        protected:
+            LanguageModel* m_model;
+            mutable mutex m_lock;
+        };
+
+        inline LanguageModelReader::LanguageModelReader(const LanguageModel* inSharedModel)
+            : m_sharedModel(inSharedModel)
+        {
+        }
+
+        inline const vector<Bigram> LanguageModelReader::bigramsForKeys(const string &preceedingKey, const string& key)
+        {
+            vector<Bigram> result;
+            m_sharedModel->readBigramsForKeys(preceedingKey, key, result);
+            return result;
+        }
+
+        inline const vector<Unigram> LanguageModelReader::unigramsForKeys(const string &key)
+        {
+            vector<Unigram> result;
+            m_sharedModel->readUnigramsForKey(key, result);
+            return result;
+        }
+
+        inline bool LanguageModelReader::hasUnigramsForKey(const string& key)
+        {
+            m_sharedModel->readUnigramsForKey(key, m_unigrams);
+            return !m_unigrams.empty();
+        }
+
+        inline const UnigramView LanguageModelReader::unigramViewForKey(const string& key, vector<Unigram>& ioBuffer)
+        {
+            m_sharedModel->readUnigramsForKey(key, ioBuffer);
+            return UnigramView(ioBuffer);
+        }
+
+        inline const BigramView LanguageModelReader::bigramViewForKeys(const string& preceedingKey, const string& key, vector<Bigram>& ioBuffer)
+        {
+            m_sharedModel->readBigramsForKeys(preceedingKey, key, ioBuffer);
+            return BigramView(ioBuffer);
+        }
+
+        inline bool LanguageModelReader::keyPrefixRoot(size_t& outState) const
+        {
+            return m_sharedModel->keyPrefixRoot(outState);
+        }
+
+        inline bool LanguageModelReader::advanceKeyPrefix(size_t& ioState, const string& inPiece) const
+        {
+            return m_sharedModel->advanceKeyPrefix(ioState, inPiece);
+        }
+
+        inline bool LanguageModelReader::hasUnigramsForKeyPrefix(size_t inState) const
+        {
+            return m_sharedModel->hasUnigramsForKeyPrefix(inState);
+        }
+
+        inline size_t LanguageModelReader::maximumKeySpanLength(const string& separator) const
+        {
+            return m_sharedModel->maximumKeySpanLength(separator);
+        }
+
+        inline bool LanguageModelReader::hasConstQueries() const
+        {
+            return m_sharedModel->hasConstQueries();
+        }
+
+        inline void LanguageModelReader::readUnigramsForKey(const string& key, vector<Unigram>& outUnigrams) const
+        {
+            m_sharedModel->readUnigramsForKey(key, outUnigrams);
+        }
+
+        inline void LanguageModelReader::readBigramsForKeys(const string& preceedingKey, const string& key, vector<Bigram>& outBigrams) const
+        {
+            m_sharedModel->readBigramsForKeys(preceedingKey, key, outBigrams);
+        }
+
+        inline SynchronizedLanguageModel::SynchronizedLanguageModel(LanguageModel* inModel)
+            : m_model(inModel)
+        {
+        }
+
+        inline const vector<Bigram> SynchronizedLanguageModel::bigramsForKeys(const string &preceedingKey, const string& key)
+        {
+            lock_guard<mutex> lock(m_lock);
+            return m_model->bigramsForKeys(preceedingKey, key);
+        }
+
+        inline const vector<Unigram> SynchronizedLanguageModel::unigramsForKeys(const string &key)
+        {
+            lock_guard<mutex> lock(m_lock);
+            return m_model->unigramsForKeys(key);
+        }
+
+        inline bool SynchronizedLanguageModel::hasUnigramsForKey(const string& key)
+        {
+            lock_guard<mutex> lock(m_lock);
+            return m_model->hasUnigramsForKey(key);
+        }
+
+        inline bool SynchronizedLanguageModel::keyPrefixRoot(size_t& outState) const
+        {
+            lock_guard<mutex> lock(m_lock);
+            return m_model->keyPrefixRoot(outState);
+        }
+
+        inline bool SynchronizedLanguageModel::advanceKeyPrefix(size_t& ioState, const string& inPiece) const
+        {
+            lock_guard<mutex> lock(m_lock);
+            return m_model->advanceKeyPrefix(ioState, inPiece);
+        }
+
+        inline bool SynchronizedLanguageModel::hasUnigramsForKeyPrefix(size_t inState) const
+        {
+            lock_guard<mutex> lock(m_lock);
+            return m_model->hasUnigramsForKeyPrefix(inState);
+        }
+
+        inline size_t SynchronizedLanguageModel::maximumKeySpanLength(const string& separator) const
+        {
+            lock_guard<mutex> lock(m_lock);
+            return m_model->maximumKeySpanLength(separator);
+        }
+
+        inline bool SynchronizedLanguageModel::hasConstQueries() const
+        {
+            return true;
+        }
+
+        inline void SynchronizedLanguageModel::readUnigramsForKey(const string& key, vector<Unigram>& outUnigrams) const
+        {
+            lock_guard<mutex> lock(m_lock);
+            outUnigrams = m_model->unigramsForKeys(key);
+        }
+
+        inline void SynchronizedLanguageModel::readBigramsForKeys(const string& preceedingKey, const string& key, vector<Bigram>& outBigrams) const
+        {
+            lock_guard<mutex> lock(m_lock);
+            outBigrams = m_model->bigramsForKeys(preceedingKey, key);
+        }
+    };
+};
+
+#endif
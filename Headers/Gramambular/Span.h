@@ -76,14 +76,15 @@ namespace Formosa {
             }
             
             size_t max = 0;
-            for (map<size_t, Node>::iterator i = m_lengthNodeMap.begin() ; i != m_lengthNodeMap.end() ; ++i) {
+            for (map<size_t, Node>::iterator i = m_lengthNodeMap.begin() ; i != m_lengthNodeMap.end() ; ) {
                 if ((*i).first > inLength) {
-                    m_lengthNodeMap.erase(i);
+                    m_lengthNodeMap.erase(i++);
                 }
                 else {
                     if ((*i).first > max) {
                         max = (*i).first;
                     }
+                    ++i;
                 }
             }
             
@@ -29,6 +29,7 @@
 #define Walker_h
 
 #include <algorithm>
+#include <queue>
 #include "Grid.h"
 
 namespace Formosa {
@@ -39,9 +40,45 @@ namespace Formosa {
         public:
             Walker(Grid* inGrid);
             const vector<NodeAnchor> reverseWalk(size_t inLocation, double inAccumulatedScore = 0.0);            
+
+            // returns the same path as reverseWalk(), but finds it with dynamic
+            // programming (best score and back-pointer per location) instead of
+            // enumerating every path, so the cost is linear in the grid width
+            const vector<NodeAnchor> reverseViterbiWalk(size_t inLocation, double inAccumulatedScore = 0.0);
+
+            // returns up to inCount paths, best first, each in the same form as
+            // reverseWalk(); paths are grown backwards from inLocation and the
+            // best-scoring partial path is always expanded first, so only the
+            // part of the grid needed for the top inCount paths is visited
+            const vector<vector<NodeAnchor> > reverseNBestWalk(size_t inLocation, size_t inCount, double inAccumulatedScore = 0.0);
             
         protected:
+            // a path being grown backwards: anchor is its first node, and the
+            // rest of the path follows through next, an index into the
+            // hypothesis list (or none for the path's last node)
+            struct PartialPath {
+                NodeAnchor anchor;
+                size_t next;
+            };
+
+            struct QueuedPath {
+                double estimatedScore;
+                size_t sequence;
+                size_t index;
+                bool complete;
+
+                bool operator<(const QueuedPath& inAnother) const;
+            };
+
+            // prepares a node buffer for every location up to inLocation
+            void reserveNodeBuffers(size_t inLocation);
+
             Grid* m_grid;
+
+            // nodes ending at each location, refilled by each walk; reverseWalk()
+            // recurses into smaller locations only, so every level of the
+            // recursion has a buffer of its own
+            vector<vector<NodeAnchor> > m_nodesEndingAt;
         };
         
         inline Walker::Walker(Grid* inGrid)
@@ -57,7 +94,9 @@ namespace Formosa {
             
             vector<vector<NodeAnchor> > paths;
 
-            vector<NodeAnchor> nodes = m_grid->nodesEndingAt(inLocation);
+            reserveNodeBuffers(inLocation);
+            vector<NodeAnchor>& nodes = m_nodesEndingAt[inLocation];
+            m_grid->nodesEndingAt(inLocation, nodes);
             
             for (vector<NodeAnchor>::iterator ni = nodes.begin() ; ni != nodes.end() ; ++ni) {
                 if (!(*ni).node) {
@@ -85,6 +124,163 @@ namespace Formosa {
             
             return *result;
         }
+
+        inline const vector<NodeAnchor> Walker::reverseViterbiWalk(size_t inLocation, double inAccumulatedScore)
+        {
+            if (!inLocation || inLocation > m_grid->width()) {
+                return vector<NodeAnchor>();
+            }
+
+            // bestAnchors[l] is the last node of the best path ending at l; an
+            // anchor without a node means nothing ends at l, and just like in
+            // reverseWalk() a path reaching such a location stops there
+            vector<double> bestScores(inLocation + 1, 0.0);
+            vector<NodeAnchor> bestAnchors(inLocation + 1);
+            reserveNodeBuffers(inLocation);
+
+            for (size_t l = 1 ; l <= inLocation ; l++) {
+                vector<NodeAnchor>& nodes = m_nodesEndingAt[l];
+                m_grid->nodesEndingAt(l, nodes);
+
+                for (vector<NodeAnchor>::const_iterator ni = nodes.begin() ; ni != nodes.end() ; ++ni) {
+                    if (!(*ni).node) {
+                        continue;
+                    }
+
+                    // ties go to the first node, as reverseWalk() only replaces its pick on a strictly higher score
+                    double score = (*ni).node->score() + bestScores[l - (*ni).spanningLength];
+                    if (!bestAnchors[l].node || score > bestScores[l]) {
+                        bestScores[l] = score;
+                        bestAnchors[l] = *ni;
+                    }
+                }
+            }
+
+            // accumulate from the end backwards, in the same order as reverseWalk()
+            vector<NodeAnchor> result;
+            double accumulatedScore = inAccumulatedScore;
+            for (size_t l = inLocation ; l && bestAnchors[l].node ; l -= bestAnchors[l].spanningLength) {
+                NodeAnchor anchor = bestAnchors[l];
+                accumulatedScore = accumulatedScore + anchor.node->score();
+                anchor.accumulatedScore = accumulatedScore;
+                result.push_back(anchor);
+            }
+
+            return result;
+        }
+
+        inline bool Walker::QueuedPath::operator<(const QueuedPath& inAnother) const
+        {
+            // priority_queue pops the largest element; on equal scores, the path queued first wins
+            if (estimatedScore != inAnother.estimatedScore) {
+                return estimatedScore < inAnother.estimatedScore;
+            }
+
+            return sequence > inAnother.sequence;
+        }
+
+        inline const vector<vector<NodeAnchor> > Walker::reverseNBestWalk(size_t inLocation, size_t inCount, double inAccumulatedScore)
+        {
+            vector<vector<NodeAnchor> > results;
+
+            if (!inLocation || inLocation > m_grid->width() || !inCount) {
+                return results;
+            }
+
+            // the forward pass of reverseViterbiWalk() gives, for every
+            // location, the best score any path can still add before it,
+            // which is an exact estimate of how a partial path can end
+            vector<double> bestScores(inLocation + 1, 0.0);
+            reserveNodeBuffers(inLocation);
+            m_nodesEndingAt[0].clear();
+
+            for (size_t l = 1 ; l <= inLocation ; l++) {
+                vector<NodeAnchor>& nodes = m_nodesEndingAt[l];
+                m_grid->nodesEndingAt(l, nodes);
+                bool found = false;
+
+                for (vector<NodeAnchor>::const_iterator ni = nodes.begin() ; ni != nodes.end() ; ++ni) {
+                    if (!(*ni).node) {
+                        continue;
+                    }
+
+                    double score = (*ni).node->score() + bestScores[l - (*ni).spanningLength];
+                    if (!found || score > bestScores[l]) {
+                        bestScores[l] = score;
+                        found = true;
+                    }
+                }
+            }
+
+            vector<PartialPath> paths;
+            priority_queue<QueuedPath> queue;
+            size_t sequence = 0;
+            const size_t none = numeric_limits<size_t>::max();
+
+            // seeds the queue with the last nodes of all paths
+            size_t next = none;
+            size_t location = inLocation;
+            double suffixScore = inAccumulatedScore;
+
+            while (results.size() < inCount) {
+                const vector<NodeAnchor>& nodes = m_nodesEndingAt[location];
+                for (vector<NodeAnchor>::const_iterator ni = nodes.begin() ; ni != nodes.end() ; ++ni) {
+                    if (!(*ni).node) {
+                        continue;
+                    }
+
+                    PartialPath path;
+                    path.anchor = *ni;
+                    path.anchor.accumulatedScore = suffixScore + (*ni).node->score();
+                    path.next = next;
+                    paths.push_back(path);
+
+                    // as in reverseWalk(), a path also ends where nothing ends before it
+                    size_t start = (*ni).location;
+
+                    QueuedPath queued;
+                    queued.estimatedScore = path.anchor.accumulatedScore + bestScores[start];
+                    queued.sequence = sequence++;
+                    queued.index = paths.size() - 1;
+                    queued.complete = !start || m_nodesEndingAt[start].empty();
+                    queue.push(queued);
+                }
+
+                if (queue.empty()) {
+                    break;
+                }
+
+                QueuedPath best = queue.top();
+                queue.pop();
+
+                if (best.complete) {
+                    vector<NodeAnchor> result;
+                    for (size_t i = best.index ; i != none ; i = paths[i].next) {
+                        result.insert(result.begin(), paths[i].anchor);
+                    }
+
+                    results.push_back(result);
+
+                    // nothing to expand; pick the next best path before growing any further
+                    location = 0;
+                    continue;
+                }
+
+                next = best.index;
+                location = paths[best.index].anchor.location;
+                suffixScore = paths[best.index].anchor.accumulatedScore;
+            }
+
+            return results;
+        }
+
+        inline void Walker::reserveNodeBuffers(size_t inLocation)
+        {
+            // only ever grows, so buffers keep their capacity between walks
+            if (m_nodesEndingAt.size() <= inLocation) {
+                m_nodesEndingAt.resize(inLocation + 1);
+            }
+        }
     };
 };
 
@@ -28,6 +28,7 @@
 #ifndef Mandarin_h
 #define Mandarin_h
 
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -257,12 +258,109 @@ namespace Formosa {
         }        
         
         typedef BopomofoSyllable BPMF;
-        
+
+        // The romanized forms of every syllable in the absoluteOrder() space,
+        // generated once from the BPMF functions above, plus perfect-hash
+        // indexes from those strings back to syllables. Every answer is the
+        // one the BPMF function would give: strings the table never generated
+        // (upper case, "ba1", partial input) go to the BPMF parser, and
+        // syllables outside the absoluteOrder() space map to an empty string.
+        class BopomofoSyllableTable {
+        public:
+            static const BopomofoSyllableTable* SharedTable();
+
+            const string& hanyuPinyinString(const BPMF& syllable, bool includesTone, bool useVForUUmlaut) const;
+            const string& PHTString(const BPMF& syllable, bool includesTone) const;
+            const BPMF syllableFromHanyuPinyin(const string& str) const;
+            const BPMF syllableFromPHT(const string& str) const;
+
+            // exact lookups of the strings the table generated; false for any
+            // other string, without falling back to the BPMF parsers
+            bool findHanyuPinyin(const char* str, size_t length, BPMF& syllable) const;
+            bool findPHT(const char* str, size_t length, BPMF& syllable) const;
+
+            // 22 consonants * 4 middle vowels * 14 vowels * 5 tones
+            static const size_t Size = 6160;
+
+        protected:
+            BopomofoSyllableTable();
+
+            // the syllable's absoluteOrder(), or Size if it has a component
+            // that the absoluteOrder() space cannot encode
+            static size_t Order(const BPMF& syllable);
+
+            // hash and displace: a key lands in bucket hash(key, 0) % buckets
+            // and then in slot hash(key, displacement[bucket]) % slots, with
+            // the displacements chosen so that no two keys share a slot
+            class ReverseIndex {
+            public:
+                void build(const vector<const string*>& keys, const BPMF (*parse)(const string&));
+                bool find(const char* key, size_t length, BPMF& syllable) const;
+
+            protected:
+                struct Slot {
+                    const string* key;
+                    BPMF syllable;
+                };
+
+                static unsigned int Hash(const char* key, size_t length, unsigned int seed);
+
+                vector<unsigned int> m_displacements;
+                vector<Slot> m_slots;
+            };
+
+            // indexed by absoluteOrder(); the toneless form of a syllable is
+            // the one stored for its Tone1 order
+            vector<string> m_hanyuPinyin;
+            vector<string> m_hanyuPinyinWithV;
+            vector<string> m_PHT;
+
+            ReverseIndex m_hanyuPinyinIndex;
+            ReverseIndex m_PHTIndex;
+        };
+
+        // Converts text made of whitespace-separated syllables from one form
+        // to another, appending to an output buffer that can be reused across
+        // calls. Whitespace is copied as is, and so is any token that isn't a
+        // syllable in the source form. Hanyu Pinyin and PHT tokens must be in
+        // the lower case forms that BPMF generates, with or without a tone;
+        // without includesTone, tones are dropped from any form written.
+        class BopomofoTransliterator {
+        public:
+            enum Form {
+                ComposedString,
+                HanyuPinyin,
+                PHT,
+                AbsoluteOrderString
+            };
+
+            BopomofoTransliterator(Form from, Form to, bool includesTone = true, bool useVForUUmlaut = false);
+
+            void transliterate(const char* input, size_t length, string& output) const;
+            const string transliterate(const string& input) const;
+
+        protected:
+            bool parse(const char* token, size_t length, BPMF& syllable) const;
+            bool append(const BPMF& syllable, string& output) const;
+
+            Form m_from;
+            Form m_to;
+            bool m_includesTone;
+            bool m_useVForUUmlaut;
+            const BopomofoSyllableTable* m_table;
+        };
+
         typedef map<char, vector<BPMF::Component> > BopomofoKeyToComponentMap;
         typedef map<BPMF::Component, char> BopomofoComponentToKeyMap;
         
         class BopomofoKeyboardLayout {
         public:
+            // The layouts are built on first use, once even if several threads
+            // ask at the same time, and are never deleted; FinalizeLayouts()
+            // does nothing and is kept for existing callers.
+            // HanyuPinyinLayout() is essentially an empty layout, but we use
+            // pointer semantic to tell the differences--and pass on the
+            // responsibility to BopomofoReadingBuffer
             static void FinalizeLayouts();
             static const BopomofoKeyboardLayout* StandardLayout();
             static const BopomofoKeyboardLayout* ETenLayout();
@@ -280,6 +378,27 @@ namespace Formosa {
                 for (BopomofoKeyToComponentMap::const_iterator miter = m_keyToComponent.begin() ; miter != m_keyToComponent.end() ; ++miter)
                     for (vector<BPMF::Component>::const_iterator viter = (*miter).second.begin() ; viter != (*miter).second.end() ; ++viter)
                         m_componentToKey[*viter] = (*miter).first;
+
+                // the same mappings in arrays, for lookups that neither search
+                // nor copy
+                memset(m_keyComponents, 0, sizeof(m_keyComponents));
+                memset(m_keyComponentCounts, 0, sizeof(m_keyComponentCounts));
+                memset(m_componentKeys, 0, sizeof(m_componentKeys));
+                for (BopomofoKeyToComponentMap::const_iterator miter = m_keyToComponent.begin() ; miter != m_keyToComponent.end() ; ++miter) {
+                    unsigned char key = (unsigned char)(*miter).first;
+                    const vector<BPMF::Component>& components = (*miter).second;
+                    m_keyComponentCounts[key] = (unsigned char)(components.size() < 255 ? components.size() : 255);
+                    for (size_t i = 0 ; i < components.size() && i < 3 ; i++)
+                        m_keyComponents[key][i] = components[i];
+                }
+
+                for (BopomofoComponentToKeyMap::const_iterator citer = m_componentToKey.begin() ; citer != m_componentToKey.end() ; ++citer) {
+                    size_t index = ComponentKeyIndex((*citer).first);
+                    if (index < ComponentKeyCount)
+                        m_componentKeys[index] = (*citer).second;
+                }
+
+                compileKeySequenceAutomaton();
             }
             
             const string name() const
@@ -289,6 +408,10 @@ namespace Formosa {
             
             char componentToKey(BPMF::Component component) const
             {
+                size_t index = ComponentKeyIndex(component);
+                if (index < ComponentKeyCount)
+                    return m_componentKeys[index];
+
                 BopomofoComponentToKeyMap::const_iterator iter = m_componentToKey.find(component);
                 return (iter == m_componentToKey.end()) ? 0 : (*iter).second;
             }
@@ -298,23 +421,48 @@ namespace Formosa {
                 BopomofoKeyToComponentMap::const_iterator iter = m_keyToComponent.find(key);
                 return (iter == m_keyToComponent.end()) ? vector<BPMF::Component>() : (*iter).second;
             }
+
+            // how many components the key stands for, without copying them
+            size_t keyComponentCount(char key) const
+            {
+                return m_keyComponentCounts[(unsigned char)key];
+            }
             
             const string keySequenceFromSyllable(BPMF syllable) const
             {
-                string sequence;
+                char sequence[4];
+                return string(sequence, keySequenceFromSyllable(syllable, sequence));
+            }
+
+            // writes at most 4 keys and returns how many
+            size_t keySequenceFromSyllable(BPMF syllable, char* sequence) const
+            {
+                size_t length = 0;
                 
                 BPMF::Component c;
                 char k;
-                #define STKS_COMBINE(component) if ((c = component)) { if ((k = componentToKey(c))) sequence += string(1, k); }
+                #define STKS_COMBINE(component) if ((c = component)) { if ((k = componentToKey(c))) sequence[length++] = k; }
                 STKS_COMBINE(syllable.consonantComponent());
                 STKS_COMBINE(syllable.middleVowelComponent());
                 STKS_COMBINE(syllable.vowelComponent());
                 STKS_COMBINE(syllable.toneMarkerComponent());
                 #undef STKS_COMBINE
-                return sequence;
+                return length;
             }
             
+            // Runs the layout's key sequence automaton, which is compiled from
+            // the heuristics below and gives the same syllable for every
+            // sequence, with one table lookup per key.
             const BPMF syllableFromKeySequence(const string& sequence) const
+            {
+                return syllableFromKeySequence(sequence.data(), sequence.length());
+            }
+
+            const BPMF syllableFromKeySequence(const char* sequence, size_t length) const;
+            
+            // The original parser, which looks behind and ahead of each key;
+            // kept as the definition that the automaton is checked against.
+            const BPMF heuristicSyllableFromKeySequence(const string& sequence) const
             {
                 BPMF syllable;
                 
@@ -454,17 +602,58 @@ namespace Formosa {
                 return false;
             }
 
+            // Builds a deterministic automaton over the layout's keys. The
+            // heuristics decide some keys by what comes after them, so a state
+            // holds every reading of the keys so far that some continuation
+            // could still pick; see Mandarin.cpp.
+            void compileKeySequenceAutomaton();
+
+            // a component's place in m_componentKeys: consonants, middle
+            // vowels, vowels, then tones, with Tone1 being component 0; a value
+            // that spans more than one kind is left to the map
+            static const size_t ComponentKeyCount = 60;
+            static size_t ComponentKeyIndex(BPMF::Component component)
+            {
+                if (!component)
+                    return 52;
+                if (component == (component & BPMF::ConsonantMask))
+                    return component;
+                if (component == (component & BPMF::MiddleVowelMask))
+                    return 32 + (component >> 5);
+                if (component == (component & BPMF::VowelMask))
+                    return 36 + (component >> 7);
+                if (component == (component & BPMF::ToneMarkerMask))
+                    return 52 + (component >> 11);
+                return ComponentKeyCount;
+            }
+
             string m_name;
             BopomofoKeyToComponentMap m_keyToComponent;
             BopomofoComponentToKeyMap m_componentToKey;
 
-            static const BopomofoKeyboardLayout* c_StandardLayout;
-            static const BopomofoKeyboardLayout* c_ETenLayout;
-            static const BopomofoKeyboardLayout* c_HsuLayout;
-            static const BopomofoKeyboardLayout* c_ETen26Layout;                                    
+            // up to 3 components for each key byte (the heuristics never look
+            // past the third), and the key for each component
+            BPMF::Component m_keyComponents[256][3];
+            unsigned char m_keyComponentCounts[256];
+            char m_componentKeys[ComponentKeyCount];
+
+            // A state of the automaton holds a few syllables, one for each
+            // reading it keeps. A transition names the next state and, for each
+            // of its syllables, the current syllable it starts from and which
+            // of the key's components it adds, if any (-1).
+            static const size_t MaxKeySequenceReadings = 4;
+            struct KeySequenceTransition {
+                unsigned short state;
+                unsigned char sources[MaxKeySequenceReadings];
+                signed char components[MaxKeySequenceReadings];
+            };
 
-            // this is essentially an empty layout, but we use pointer semantic to tell the differences--and pass on the responsibility to BopomofoReadingBuffer
-            static const BopomofoKeyboardLayout* c_HanyuPinyinLayout;                                    
+            // keys that the heuristics can tell apart get a class of their
+            // own; every other key is class 0
+            unsigned char m_keyClasses[256];
+            size_t m_keyClassCount;
+            vector<KeySequenceTransition> m_keySequenceTransitions;
+            vector<unsigned char> m_keySequenceEndings;
         };
         
         class BopomofoReadingBuffer {
@@ -492,7 +681,7 @@ namespace Formosa {
             bool isValidKey(char k) const
             {
                 if (!m_pinyinMode) {                
-                    return m_layout ? (m_layout->keyToComponents(k)).size() > 0 : false;
+                    return m_layout ? m_layout->keyComponentCount(k) > 0 : false;
                 }
                 
                 char lk = tolower(k);
@@ -526,8 +715,10 @@ namespace Formosa {
                     return true;
                 }
 
-                string sequence = m_layout->keySequenceFromSyllable(m_syllable) + string(1, k);
-                m_syllable = m_layout->syllableFromKeySequence(sequence);
+                char sequence[5];
+                size_t length = m_layout->keySequenceFromSyllable(m_syllable, sequence);
+                sequence[length++] = k;
+                m_syllable = m_layout->syllableFromKeySequence(sequence, length);
                 return true;
             }
             
@@ -551,10 +742,10 @@ namespace Formosa {
                     return;
                 }
                 
-                string sequence = m_layout->keySequenceFromSyllable(m_syllable);
-                if (sequence.length()) {
-                    sequence = sequence.substr(0, sequence.length() - 1);
-                    m_syllable = m_layout->syllableFromKeySequence(sequence);
+                char sequence[4];
+                size_t length = m_layout->keySequenceFromSyllable(m_syllable, sequence);
+                if (length) {
+                    m_syllable = m_layout->syllableFromKeySequence(sequence, length - 1);
                 }
             }
             
@@ -54,8 +54,8 @@ namespace Formosa {
             virtual unsigned int cursor();
             virtual unsigned int setCursor(unsigned int c);
             virtual void clear();
-            virtual bool empty();
-            virtual unsigned int numberOfCodepoints();
+            virtual bool empty() const;
+            virtual unsigned int numberOfCodepoints() const;
             virtual bool insertCharacterAt(unsigned int i, char c);
             virtual bool removeCodepointAt(unsigned int i);
             virtual const string composedForm();
@@ -80,26 +80,62 @@ namespace Formosa {
             DiacriticGivenAfterVowel = 1
         };
 
+    	// A symbol is a letter, or one of the two-letter vowels and nasal
+    	// nn, ou, oo and ii. It is kept as an ID and not as a string: a
+    	// letter's ID is the letter in lower case, the two-letter symbols
+    	// have the IDs after 255, and each upper case letter sets a bit.
+    	// Strings that make no symbol give the empty symbol.
     	class RomanizationSymbol {
     	public:
+    		enum {
+    			NoSymbol = 256,
+    			NNSymbol,
+    			OUSymbol,
+    			OOSymbol,
+    			IISymbol
+    		};
+
     		RomanizationSymbol();
     		RomanizationSymbol(const string &s, SyllableType t);
+    		RomanizationSymbol(char c, SyllableType t);
     		RomanizationSymbol(const RomanizationSymbol &s);
     		void setType(SyllableType t);
     		const RomanizationSymbol& operator=(const RomanizationSymbol &s);
     		const string symbol() const;
     		const string symbolInLowerCase() const;
+
+    		// the symbol is left as it is if s makes no symbol
     		const string setSymbol(const string& s);
+    		bool setLetters(const char* letters, unsigned int length);
+
+    		// makes a two-letter symbol out of a letter and c
+    		bool appendLetter(char c);
+    		void appendSymbol(string& output) const;
+
+    		// writes the letters, at most two, and returns how many
+    		unsigned int copyLetters(char* letters) const;
+    		unsigned int symbolID() const;
+    		unsigned int length() const;
+    		char letterAt(unsigned int i) const;
     		const string composedForm(bool forcePOJStyle = false, bool usePOJLegacyOu = false) const;
+    		void appendComposedForm(string& output, bool forcePOJStyle = false, bool usePOJLegacyOu = false) const;
     		unsigned int composedLength() const;
     		unsigned int tone() const;
     		unsigned int setTone(unsigned int t);
     		bool isUpperCase() const;
 		
     	protected:
-    		unsigned int _tone;
-    		SyllableType _type;
-    		string _symbol;
+    		// an empty slice means the symbol is shown as it is
+    		const VowelHelper::ComposedVowel composedVowel(bool forcePOJStyle, bool usePOJLegacyOU) const;
+
+    		unsigned short _symbolID;
+    		unsigned char _upperCaseLetters;
+
+    		// VowelHelper's ID of the letters, so that composing the symbol
+    		// doesn't spell it out
+    		unsigned char _vowelID;
+    		unsigned char _tone;
+    		unsigned char _type;
     	};
 
 
@@ -109,6 +145,10 @@ namespace Formosa {
     	class RomanizationSyllable : public Composable
         {
         public:
+    		// the symbols are kept in the syllable; inserting a symbol
+    		// into a full syllable fails
+    		enum { MaxSymbols = 32 };
+
     		RomanizationSyllable();
     		RomanizationSyllable(const RomanizationSyllable &s);
     		const RomanizationSyllable& operator=(const RomanizationSyllable &s);
@@ -120,6 +160,7 @@ namespace Formosa {
             virtual bool empty() const;
             virtual unsigned int numberOfCodepoints() const;
             virtual const string composedForm();
+    		void appendComposedForm(string& output);
     		void setCursor(unsigned int c);
     		unsigned int cursor() const;
     		bool cursorHome();
@@ -140,6 +181,12 @@ namespace Formosa {
     		// returns a normalized string that represents the "internal form" for querying the database
     		// implies normalization
     		const string normalizedQueryData(unsigned int finalTone = 0);
+
+    		// the same query data, written into output, which must have room
+    		// for MaxQueryDataLength bytes; returns the number of bytes written
+    		// and leaves the syllable as it is
+    		enum { MaxQueryDataLength = MaxSymbols * 2 + 1 };
+    		size_t writeNormalizedQueryData(char* output, unsigned int finalTone = 0) const;
 	
     		// normalization is an "identpotent" function, ie. the result should
     		// be the same no matter how many times you call it--this being a very
@@ -148,6 +195,11 @@ namespace Formosa {
         		
     		RomanizationSyllable convertToPOJSyllable();
     		RomanizationSyllable convertToTLSyllable();
+
+    		// convert into a syllable the caller keeps, so that its storage
+    		// can be reused; the syllable is cleared first
+    		void convertToPOJSyllable(RomanizationSyllable& syllable);
+    		void convertToTLSyllable(RomanizationSyllable& syllable);
 		
 		
     	protected:
@@ -165,17 +217,21 @@ namespace Formosa {
     		// previous symbol--always check with hasPreviousSymbolAtCursor() !
     		RomanizationSymbol& previousSymbolAtCursor();
 
-    		// always assumes that the given input is in all lower case
-    		unsigned int findSymbol(const char *s) const;
-    		unsigned int findSymbolPair(const char *s1, const char *s2) const;
-    		unsigned int findSymbolTriple(const char *s1, const char *s2, const char *s3) const;
+    		bool insertSymbolAt(unsigned int i, const RomanizationSymbol &s);
+    		void removeSymbolAt(unsigned int i);
+
+    		// finds symbols by their IDs
+    		unsigned int findSymbol(unsigned int s) const;
+    		unsigned int findSymbolPair(unsigned int s1, unsigned int s2) const;
+    		unsigned int findSymbolTriple(unsigned int s1, unsigned int s2, unsigned int s3) const;
 		
     		SyllableType _inputType;
     		DiacriticInputOption _inputOption;
     		bool _forcePOJStyle;
     		bool _usePOJLegacyOU;
 		        
-    		vector<RomanizationSymbol> _symvec;
+    		RomanizationSymbol _symbols[MaxSymbols];
+    		unsigned int _symbolCount;
     		unsigned int _cursor;
     		unsigned int _preparedTone;
     	};
@@ -186,11 +242,53 @@ namespace Formosa {
     		const RomanizationSyllable convertToTLFromTLPA(unsigned int finalTone = 0);
     		const RomanizationSyllable convertToTLFromDT(unsigned int finalTone = 0);
 
+    		// the syllable is cleared first, and keeps its other options
+    		void convertToTLFromTLPA(RomanizationSyllable& syllable, unsigned int finalTone = 0);
+    		void convertToTLFromDT(RomanizationSyllable& syllable, unsigned int finalTone = 0);
+
     	protected:
     		char charWithCaseAccordingTo(char c, char ref) const;
     		char charWithCaseAccordingTo(char c, const string &r) const;
     		const string toLowerString(const string &s) const;
     	};
+
+    	// Converts running text from one romanization to another, syllable
+    	// by syllable, in one pass. Words are runs of Latin letters, composed
+    	// vowels and tone numbers; a word ends at a hyphen, so each syllable
+    	// of a hyphenated word is converted on its own, and a tone number
+    	// ends a syllable. Everything else -- spaces, punctuation, numbers,
+    	// other scripts, and words that make no syllable -- is copied as it
+    	// is. Each syllable keeps the case of its letters. The syllables are
+    	// built in scratch syllables that the transliterator keeps, so one
+    	// transliterator must not be used by two threads at once.
+    	class RomanizationTransliterator
+    	{
+    	public:
+    		RomanizationTransliterator(SyllableType from, SyllableType to, bool forcePOJStyle = false, bool usePOJLegacyOU = false);
+
+    		// POJ, TL, TLPA and DT convert to POJ and TL; POJ, TL and Hakka
+    		// PFS convert to themselves, which only composes them
+    		static bool canTransliterate(SyllableType from, SyllableType to);
+
+    		// appends the converted text to output; text the transliterator
+    		// can't convert is copied
+    		void transliterate(const char* text, size_t length, string& output);
+    		const string transliterate(const string& text);
+
+    	protected:
+    		bool transliterateSyllable(const char* syllable, size_t length, unsigned int tone, string& output);
+
+    		SyllableType _from;
+    		SyllableType _to;
+    		bool _forcePOJStyle;
+    		bool _usePOJLegacyOU;
+    		bool _canTransliterate;
+
+    		string _decomposed;
+    		FreeFormSyllable _freeForm;
+    		RomanizationSyllable _source;
+    		RomanizationSyllable _converted;
+    	};
     };
 };
 
@@ -42,6 +42,7 @@
 
 #include <string>
 #include <map>
+#include <vector>
 
 namespace Formosa {
     namespace TaiwaneseRomanization {
@@ -57,24 +58,78 @@ namespace Formosa {
         
         class VowelHelper {
         public:
+            // a composed vowel is a slice of a table that lives as long as
+            // the program does; an empty slice means the vowel can't be composed
+            struct ComposedVowel {
+                const char* data;
+                size_t length;
+                unsigned int codepoints;
+            };
+
+            static const ComposedVowel composedVowel(const char* vowel, size_t length, unsigned int tone, bool usePOJStyleOUAndNN, bool usePOJStyleNinthToneMark = false, bool composeII = false, bool usePOJLegacyOU = false);
+
+            // the same lookup by an ID, for callers that keep the ID of a
+            // spelling instead of the spelling; a spelling that is no vowel
+            // has the ID NoVowel
+            enum { NoVowel = 255 };
+            static unsigned char vowelIDForVowel(const char* vowel, size_t length);
+            static const ComposedVowel composedVowelFromID(unsigned char vowelID, unsigned int tone, bool usePOJStyleOUAndNN, bool usePOJStyleNinthToneMark = false, bool composeII = false, bool usePOJLegacyOU = false);
             static const string symbolForVowel(const string& vowel, unsigned int tone, bool usePOJStyleOUAndNN, bool usePOJStyleNinthToneMark = false, bool composeII = false, bool usePOJLegacyOU = false);
 
+            // the map lookup that the composed vowel table is built from
+            static const string referenceSymbolForVowel(const string& vowel, unsigned int tone, bool usePOJStyleOUAndNN, bool usePOJStyleNinthToneMark = false, bool composeII = false, bool usePOJLegacyOU = false);
+
             static char diacriticShorthandFromTone(unsigned int tone);
             static unsigned int toneFromDiacriticShorthand(char shorthand);
             static bool isDiacriticShorthand(char shorthand);
             static const string uppercasedVowelFromVowel(const string& vowel);
 
+            // output must have room for length + 1 bytes; returns the number of bytes written
+            static size_t queryFormFromComposedForm(const char* composed, size_t length, char* output);
             static const string queryFormFromComposedForm(const string& composed);            
             static VowelDecompositionState& vowelDecompositionGroundState();
+
+            // the walk over the decomposition states that the flat table is compiled from
+            static const string referenceQueryFormFromComposedForm(const string& composed);
         private:
+            struct ComposedVowelSlice {
+                unsigned short offset;
+                unsigned char length;
+                unsigned char codepoints;
+            };
+
+            static size_t vowelID(const char* vowel, size_t length);
+            static const string vowelFromID(size_t id);
+            static void populateComposedVowelTable();
+            static void buildComposedVowelTable();
+
+            // a state of the compiled decomposition table; state 0 is the
+            // ground state, which no transition leads back to
+            struct CompiledDecompositionState {
+                unsigned char symbolLength;
+                char symbol[2];
+                unsigned char tone;
+            };
+
             static map<string, map<unsigned int, string> >* c_vowelTable;
+            static string* c_composedVowelPool;
+            static ComposedVowelSlice* c_composedVowels;
             static map<string, string>* c_toUppercasedVowelTable;
             static VowelDecompositionState *c_groundState;
+            static unsigned char c_decompositionByteClasses[256];
+            static size_t c_decompositionClassCount;
+            static unsigned short* c_decompositionTransitions;
+            static CompiledDecompositionState* c_decompositionStates;
             
+            // safe to call from any thread; the tables are built only once
             static void populateVowelTables();
+            static void buildVowelTables();
             
             static void addStringToState(const string& s, const string &repSymbol, unsigned int repTone, VowelDecompositionState& startState);
             static void populateDecompositionStateMachine();
+            static void buildDecompositionStateMachine();
+            static void populateDecompositionTable();
+            static void compileDecompositionTable();
         };
     };
 };
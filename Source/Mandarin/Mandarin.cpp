@@ -26,6 +26,7 @@
 //
 
 #include <cctype>
+#include <cstring>
 #include <algorithm>
 #include "Mandarin.h"
 
@@ -62,18 +63,85 @@ public:
     }
 };
 
-class BopomofoCharacterMap {
+// The Bopomofo symbols as UTF-8, in dense tables built at compile time.
+// Components are numbered in the order of their code points: consonants
+// from U+3105 (ㄅ), vowels from U+311A (ㄚ), middle vowels from U+3127 (ㄧ);
+// the tone marks are spacing modifier letters. Every symbol is 3 bytes
+// (E3 84 xx), except the tone marks, which are 2 (CB xx).
+class BopomofoCharacterTable {
 public:
-    static const BopomofoCharacterMap& SharedInstance();
+    struct Character {
+        char bytes[3];
+        unsigned char length;
+    };
 
-    map<BPMF::Component, string> componentToCharacter;
-    map<string, BPMF::Component> characterToComponent;
+    constexpr BopomofoCharacterTable()
+        : consonants()
+        , middleVowels()
+        , vowels()
+        , tones()
+        , componentsByThirdByte()
+        , tonesBySecondByte()
+    {
+        for (unsigned int i = 0 ; i < 32 ; i++) {
+            consonants[i] = Character{{0, 0, 0}, 0};
+        }
+
+        for (unsigned int i = 0 ; i < 16 ; i++) {
+            vowels[i] = Character{{0, 0, 0}, 0};
+        }
+
+        for (unsigned int i = 0 ; i < 8 ; i++) {
+            tones[i] = Character{{0, 0, 0}, 0};
+        }
+
+        for (unsigned int i = 1 ; i < 22 ; i++) {
+            consonants[i] = Symbol(0x3104 + i);
+            componentsByThirdByte[(0x3104 + i) & 0x3f] = i;
+        }
+
+        for (unsigned int i = 1 ; i < 4 ; i++) {
+            middleVowels[i] = Symbol(0x3126 + i);
+            componentsByThirdByte[(0x3126 + i) & 0x3f] = i << 5;
+        }
+
+        for (unsigned int i = 1 ; i < 14 ; i++) {
+            vowels[i] = Symbol(0x3119 + i);
+            componentsByThirdByte[(0x3119 + i) & 0x3f] = i << 7;
+        }
+
+        const unsigned int toneMarks[5] = {0, 0x02ca, 0x02c7, 0x02cb, 0x02d9};
+        for (unsigned int i = 1 ; i < 5 ; i++) {
+            tones[i] = Mark(toneMarks[i]);
+            tonesBySecondByte[toneMarks[i] & 0x3f] = i << 11;
+        }
+    }
+
+    // as large as the masks, so that any syllable can index them; entries
+    // that are no component are empty
+    Character consonants[32];
+    Character middleVowels[4];
+    Character vowels[16];
+    Character tones[8];
 
-protected:
-    BopomofoCharacterMap();
-    static BopomofoCharacterMap* c_map;
+    // the component of E3 84 xx and of CB xx, by the low bits of xx
+    unsigned short componentsByThirdByte[64];
+    unsigned short tonesBySecondByte[64];
+
+private:
+    static constexpr Character Symbol(unsigned int codePoint)
+    {
+        return Character{{(char)(0xe0 | (codePoint >> 12)), (char)(0x80 | ((codePoint >> 6) & 0x3f)), (char)(0x80 | (codePoint & 0x3f))}, 3};
+    }
+
+    static constexpr Character Mark(unsigned int codePoint)
+    {
+        return Character{{(char)(0xc0 | (codePoint >> 6)), (char)(0x80 | (codePoint & 0x3f)), 0}, 2};
+    }
 };
 
+static constexpr BopomofoCharacterTable BopomofoCharacters;
+
 const BPMF BPMF::FromHanyuPinyin(const string& str)
 {
     if (!str.length()) {
@@ -599,147 +667,713 @@ const BPMF BPMF::FromPHT(const string& str)
 const BPMF BPMF::FromComposedString(const string& str)
 {
     BPMF syllable;
-    vector<string> components = OVUTF8Helper::SplitStringByCodePoint(str);
-    for (vector<string>::iterator iter = components.begin() ; iter != components.end() ; ++iter) {
-	
-		const map<string, BPMF::Component>& charToComp = BopomofoCharacterMap::SharedInstance().characterToComponent;
-		map<string, BPMF::Component>::const_iterator result = charToComp.find(*iter);
-		if (result != charToComp.end())
-        	syllable += BPMF((*result).second);
+    const unsigned char* p = (const unsigned char*)str.data();
+    const unsigned char* end = p + str.length();
+
+    while (p != end) {
+        Component component = 0;
+        size_t length = 1;
+
+        if (*p == 0xe3 && end - p >= 3) {
+            length = 3;
+            if (p[1] == 0x84 && (p[2] & 0xc0) == 0x80) {
+                component = BopomofoCharacters.componentsByThirdByte[p[2] & 0x3f];
+            }
+        }
+        else if (*p == 0xcb && end - p >= 2) {
+            length = 2;
+            if ((p[1] & 0xc0) == 0x80) {
+                component = BopomofoCharacters.tonesBySecondByte[p[1] & 0x3f];
+            }
+        }
+        else if (*p >= 0xc0) {
+            // skips other characters whole
+            length = *p >= 0xf0 ? 4 : (*p >= 0xe0 ? 3 : 2);
+            if (length > (size_t)(end - p)) {
+                length = end - p;
+            }
+        }
+
+        if (component) {
+            syllable += BPMF(component);
+        }
+
+        p += length;
     }
-    
+
     return syllable;
 }
 
 const string BPMF::composedString() const
 {
-    string result;
-    #define APPEND(c) if (m_syllable & c) result += (*BopomofoCharacterMap::SharedInstance().componentToCharacter.find(m_syllable & c)).second
-    APPEND(ConsonantMask);
-    APPEND(MiddleVowelMask);
-    APPEND(VowelMask);
-    APPEND(ToneMarkerMask);
+    // at most three symbols and a tone mark, which fits in a short string;
+    // a symbol is always copied as 3 bytes
+    char buffer[12];
+    size_t length = 0;
+
+    #define APPEND(table, index) if (index) { const BopomofoCharacterTable::Character& c = BopomofoCharacters.table[index]; buffer[length] = c.bytes[0]; buffer[length + 1] = c.bytes[1]; buffer[length + 2] = c.bytes[2]; length += c.length; }
+    APPEND(consonants, m_syllable & ConsonantMask);
+    APPEND(middleVowels, (m_syllable & MiddleVowelMask) >> 5);
+    APPEND(vowels, (m_syllable & VowelMask) >> 7);
+    APPEND(tones, (m_syllable & ToneMarkerMask) >> 11);
     #undef APPEND
-    return result;
+
+    return string(buffer, length);
 }
 
-BopomofoCharacterMap* BopomofoCharacterMap::c_map = 0;
+const BopomofoSyllableTable* BopomofoSyllableTable::SharedTable()
+{
+    static const BopomofoSyllableTable* table = new BopomofoSyllableTable;
+    return table;
+}
 
-const BopomofoCharacterMap& BopomofoCharacterMap::SharedInstance()
+BopomofoSyllableTable::BopomofoSyllableTable()
+    : m_hanyuPinyin(Size)
+    , m_hanyuPinyinWithV(Size)
+    , m_PHT(Size)
 {
-    if (!c_map)        
-        c_map = new BopomofoCharacterMap();
-        
-    return *c_map;
-}
-
-BopomofoCharacterMap::BopomofoCharacterMap()    
-{
-#ifndef _MSC_VER
-    characterToComponent["ㄅ"] = BPMF::B;
-    characterToComponent["ㄆ"] = BPMF::P;
-    characterToComponent["ㄇ"] = BPMF::M;
-    characterToComponent["ㄈ"] = BPMF::F;
-    characterToComponent["ㄉ"] = BPMF::D;
-    characterToComponent["ㄊ"] = BPMF::T;
-    characterToComponent["ㄋ"] = BPMF::N;
-    characterToComponent["ㄌ"] = BPMF::L;
-    characterToComponent["ㄎ"] = BPMF::K;
-    characterToComponent["ㄍ"] = BPMF::G;
-    characterToComponent["ㄏ"] = BPMF::H;
-    characterToComponent["ㄐ"] = BPMF::J;
-    characterToComponent["ㄑ"] = BPMF::Q;
-    characterToComponent["ㄒ"] = BPMF::X;
-    characterToComponent["ㄓ"] = BPMF::ZH;
-    characterToComponent["ㄔ"] = BPMF::CH;
-    characterToComponent["ㄕ"] = BPMF::SH;
-    characterToComponent["ㄖ"] = BPMF::R;
-    characterToComponent["ㄗ"] = BPMF::Z;
-    characterToComponent["ㄘ"] = BPMF::C;
-    characterToComponent["ㄙ"] = BPMF::S;
-    characterToComponent["ㄧ"] = BPMF::I;
-    characterToComponent["ㄨ"] = BPMF::U;
-    characterToComponent["ㄩ"] = BPMF::UE;
-    characterToComponent["ㄚ"] = BPMF::A;
-    characterToComponent["ㄛ"] = BPMF::O;
-    characterToComponent["ㄜ"] = BPMF::ER;
-    characterToComponent["ㄝ"] = BPMF::E;
-    characterToComponent["ㄞ"] = BPMF::AI;
-    characterToComponent["ㄟ"] = BPMF::EI;
-    characterToComponent["ㄠ"] = BPMF::AO;
-    characterToComponent["ㄡ"] = BPMF::OU;
-    characterToComponent["ㄢ"] = BPMF::AN;
-    characterToComponent["ㄣ"] = BPMF::EN;
-    characterToComponent["ㄤ"] = BPMF::ANG;
-    characterToComponent["ㄥ"] = BPMF::ENG;
-    characterToComponent["ㄦ"] = BPMF::ERR;
-    characterToComponent["ˊ"] = BPMF::Tone2;
-    characterToComponent["ˇ"] = BPMF::Tone3;
-    characterToComponent["ˋ"] = BPMF::Tone4;
-    characterToComponent["˙"] = BPMF::Tone5;
-#else
-    characterToComponent["\xe3\x84\x85"] = BPMF::B;
-    characterToComponent["\xe3\x84\x86"] = BPMF::P;
-    characterToComponent["\xe3\x84\x87"] = BPMF::M;
-    characterToComponent["\xe3\x84\x88"] = BPMF::F;
-    characterToComponent["\xe3\x84\x89"] = BPMF::D;
-    characterToComponent["\xe3\x84\x8a"] = BPMF::T;
-    characterToComponent["\xe3\x84\x8b"] = BPMF::N;
-    characterToComponent["\xe3\x84\x8c"] = BPMF::L;
-    characterToComponent["\xe3\x84\x8e"] = BPMF::K;
-    characterToComponent["\xe3\x84\x8d"] = BPMF::G;
-    characterToComponent["\xe3\x84\x8f"] = BPMF::H;
-    characterToComponent["\xe3\x84\x90"] = BPMF::J;
-    characterToComponent["\xe3\x84\x91"] = BPMF::Q;
-    characterToComponent["\xe3\x84\x92"] = BPMF::X;
-    characterToComponent["\xe3\x84\x93"] = BPMF::ZH;
-    characterToComponent["\xe3\x84\x94"] = BPMF::CH;
-    characterToComponent["\xe3\x84\x95"] = BPMF::SH;
-    characterToComponent["\xe3\x84\x96"] = BPMF::R;
-    characterToComponent["\xe3\x84\x97"] = BPMF::Z;
-    characterToComponent["\xe3\x84\x98"] = BPMF::C;
-    characterToComponent["\xe3\x84\x99"] = BPMF::S;
-    characterToComponent["\xe3\x84\xa7"] = BPMF::I;
-    characterToComponent["\xe3\x84\xa8"] = BPMF::U;
-    characterToComponent["\xe3\x84\xa9"] = BPMF::UE;
-    characterToComponent["\xe3\x84\x9a"] = BPMF::A;
-    characterToComponent["\xe3\x84\x9b"] = BPMF::O;
-    characterToComponent["\xe3\x84\x9c"] = BPMF::ER;
-    characterToComponent["\xe3\x84\x9d"] = BPMF::E;
-    characterToComponent["\xe3\x84\x9e"] = BPMF::AI;
-    characterToComponent["\xe3\x84\x9f"] = BPMF::EI;
-    characterToComponent["\xe3\x84\xa0"] = BPMF::AO;
-    characterToComponent["\xe3\x84\xa1"] = BPMF::OU;
-    characterToComponent["\xe3\x84\xa2"] = BPMF::AN;
-    characterToComponent["\xe3\x84\xa3"] = BPMF::EN;
-    characterToComponent["\xe3\x84\xa4"] = BPMF::ANG;
-    characterToComponent["\xe3\x84\xa5"] = BPMF::ENG;
-    characterToComponent["\xe3\x84\xa6"] = BPMF::ERR;
-    characterToComponent["\xcb\x8a"] = BPMF::Tone2;
-    characterToComponent["\xcb\x87"] = BPMF::Tone3;
-    characterToComponent["\xcb\x8b"] = BPMF::Tone4;
-    characterToComponent["\xcb\x99"] = BPMF::Tone5;
-#endif
-    
-    for (map<string, BPMF::Component>::iterator iter = characterToComponent.begin() ; iter != characterToComponent.end() ; ++iter)
-        componentToCharacter[(*iter).second] = (*iter).first;
+    for (size_t order = 0; order < Size; order++) {
+        BPMF syllable = BPMF::FromAbsoluteOrder((short)order);
+        m_hanyuPinyin[order] = syllable.HanyuPinyinString(true, false);
+        m_hanyuPinyinWithV[order] = syllable.HanyuPinyinString(true, true);
+        m_PHT[order] = syllable.PHTString(true);
+    }
+
+    // many orders share a string (tones without a digit, combinations that
+    // romanize alike), so each distinct string becomes one key
+    struct KeyLess {
+        bool operator()(const string* a, const string* b) const { return *a < *b; }
+    };
+    struct KeyEqual {
+        bool operator()(const string* a, const string* b) const { return *a == *b; }
+    };
+
+    vector<const string*> keys;
+    for (size_t order = 0; order < Size; order++) {
+        if (!m_hanyuPinyin[order].empty()) {
+            keys.push_back(&m_hanyuPinyin[order]);
+            keys.push_back(&m_hanyuPinyinWithV[order]);
+        }
+    }
+    sort(keys.begin(), keys.end(), KeyLess());
+    keys.erase(unique(keys.begin(), keys.end(), KeyEqual()), keys.end());
+    m_hanyuPinyinIndex.build(keys, BPMF::FromHanyuPinyin);
+
+    keys.clear();
+    for (size_t order = 0; order < Size; order++) {
+        if (!m_PHT[order].empty()) {
+            keys.push_back(&m_PHT[order]);
+        }
+    }
+    sort(keys.begin(), keys.end(), KeyLess());
+    keys.erase(unique(keys.begin(), keys.end(), KeyEqual()), keys.end());
+    m_PHTIndex.build(keys, BPMF::FromPHT);
+}
+
+size_t BopomofoSyllableTable::Order(const BPMF& syllable)
+{
+    size_t order = (size_t)syllable.absoluteOrder();
+    if (order >= Size || BPMF::FromAbsoluteOrder((short)order) != syllable) {
+        return Size;
+    }
+    return order;
+}
+
+const string& BopomofoSyllableTable::hanyuPinyinString(const BPMF& syllable, bool includesTone, bool useVForUUmlaut) const
+{
+    static const string empty;
+    size_t order = Order(syllable);
+    if (order == Size) {
+        return empty;
+    }
+
+    if (!includesTone) {
+        order %= 22 * 4 * 14;
+    }
+    return useVForUUmlaut ? m_hanyuPinyinWithV[order] : m_hanyuPinyin[order];
+}
+
+const string& BopomofoSyllableTable::PHTString(const BPMF& syllable, bool includesTone) const
+{
+    static const string empty;
+    size_t order = Order(syllable);
+    if (order == Size) {
+        return empty;
+    }
+
+    if (!includesTone) {
+        order %= 22 * 4 * 14;
+    }
+    return m_PHT[order];
+}
+
+const BPMF BopomofoSyllableTable::syllableFromHanyuPinyin(const string& str) const
+{
+    BPMF syllable;
+    if (m_hanyuPinyinIndex.find(str.data(), str.length(), syllable)) {
+        return syllable;
+    }
+    return BPMF::FromHanyuPinyin(str);
+}
+
+const BPMF BopomofoSyllableTable::syllableFromPHT(const string& str) const
+{
+    BPMF syllable;
+    if (m_PHTIndex.find(str.data(), str.length(), syllable)) {
+        return syllable;
+    }
+    return BPMF::FromPHT(str);
+}
+
+bool BopomofoSyllableTable::findHanyuPinyin(const char* str, size_t length, BPMF& syllable) const
+{
+    return m_hanyuPinyinIndex.find(str, length, syllable);
+}
+
+bool BopomofoSyllableTable::findPHT(const char* str, size_t length, BPMF& syllable) const
+{
+    return m_PHTIndex.find(str, length, syllable);
+}
+
+unsigned int BopomofoSyllableTable::ReverseIndex::Hash(const char* key, size_t length, unsigned int seed)
+{
+    // FNV-1a from a seeded basis, then a final mix so that nearby seeds
+    // scatter the same key far apart
+    unsigned int hash = 2166136261U ^ (seed * 0x9e3779b9U);
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 16777619U;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bU;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+void BopomofoSyllableTable::ReverseIndex::build(const vector<const string*>& keys, const BPMF (*parse)(const string&))
+{
+    // about four keys per bucket, and a fifth more slots than keys; the
+    // keys must be distinct
+    size_t bucketCount = keys.size() / 4 + 1;
+    size_t slotCount = keys.size() + keys.size() / 5 + 1;
+
+    vector<vector<const string*> > buckets(bucketCount);
+    for (vector<const string*>::const_iterator i = keys.begin() ; i != keys.end() ; ++i) {
+        buckets[Hash((*i)->data(), (*i)->length(), 0) % bucketCount].push_back(*i);
+    }
+
+    // place the largest buckets first, while most slots are still free
+    vector<size_t> bucketOrder(bucketCount);
+    for (size_t i = 0; i < bucketCount; i++) {
+        bucketOrder[i] = i;
+    }
+    stable_sort(bucketOrder.begin(), bucketOrder.end(), [&buckets](size_t a, size_t b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    Slot emptySlot = { 0, BPMF() };
+    m_displacements.assign(bucketCount, 0);
+    m_slots.assign(slotCount, emptySlot);
+
+    vector<size_t> taken;
+    for (vector<size_t>::const_iterator b = bucketOrder.begin() ; b != bucketOrder.end() ; ++b) {
+        const vector<const string*>& bucket = buckets[*b];
+        if (bucket.empty()) {
+            break;
+        }
+
+        for (unsigned int displacement = 1; ; displacement++) {
+            taken.clear();
+            for (vector<const string*>::const_iterator k = bucket.begin() ; k != bucket.end() ; ++k) {
+                size_t slot = Hash((*k)->data(), (*k)->length(), displacement) % slotCount;
+                if (m_slots[slot].key || std::find(taken.begin(), taken.end(), slot) != taken.end()) {
+                    break;
+                }
+                taken.push_back(slot);
+            }
+
+            if (taken.size() == bucket.size()) {
+                m_displacements[*b] = displacement;
+                for (size_t i = 0; i < bucket.size(); i++) {
+                    m_slots[taken[i]].key = bucket[i];
+                    m_slots[taken[i]].syllable = parse(*bucket[i]);
+                }
+                break;
+            }
+        }
+    }
+}
+
+bool BopomofoSyllableTable::ReverseIndex::find(const char* key, size_t length, BPMF& syllable) const
+{
+    if (m_slots.empty()) {
+        return false;
+    }
+
+    unsigned int displacement = m_displacements[Hash(key, length, 0) % m_displacements.size()];
+    const Slot& slot = m_slots[Hash(key, length, displacement) % m_slots.size()];
+    if (!slot.key || slot.key->compare(0, string::npos, key, length)) {
+        return false;
+    }
+
+    syllable = slot.syllable;
+    return true;
+}
+
+BopomofoTransliterator::BopomofoTransliterator(Form from, Form to, bool includesTone, bool useVForUUmlaut)
+    : m_from(from)
+    , m_to(to)
+    , m_includesTone(includesTone)
+    , m_useVForUUmlaut(useVForUUmlaut)
+    , m_table(BopomofoSyllableTable::SharedTable())
+{
+}
+
+static inline bool IsTokenSeparator(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+void BopomofoTransliterator::transliterate(const char* input, size_t length, string& output) const
+{
+    const char* end = input + length;
+    const char* p = input;
+    while (p != end) {
+        const char* start = p;
+        while (p != end && IsTokenSeparator(*p)) {
+            p++;
+        }
+        output.append(start, p - start);
+
+        start = p;
+        while (p != end && !IsTokenSeparator(*p)) {
+            p++;
+        }
+
+        BPMF syllable;
+        if (p != start && !(parse(start, p - start, syllable) && append(syllable, output))) {
+            output.append(start, p - start);
+        }
+    }
+}
+
+const string BopomofoTransliterator::transliterate(const string& input) const
+{
+    string output;
+    transliterate(input.data(), input.length(), output);
+    return output;
+}
+
+bool BopomofoTransliterator::parse(const char* token, size_t length, BPMF& syllable) const
+{
+    switch (m_from) {
+        case ComposedString:
+            {
+                // unlike FromComposedString, which skips what isn't Bopomofo,
+                // a token must be exactly what composedString() writes: each
+                // kind of component at most once, in the order of the masks
+                const unsigned char* p = (const unsigned char*)token;
+                const unsigned char* end = p + length;
+                BPMF::Component components = 0;
+                while (p != end) {
+                    BPMF::Component component = 0;
+                    if (*p == 0xe3 && end - p >= 3 && p[1] == 0x84 && (p[2] & 0xc0) == 0x80) {
+                        component = BopomofoCharacters.componentsByThirdByte[p[2] & 0x3f];
+                        p += 3;
+                    }
+                    else if (*p == 0xcb && end - p >= 2 && (p[1] & 0xc0) == 0x80) {
+                        component = BopomofoCharacters.tonesBySecondByte[p[1] & 0x3f];
+                        p += 2;
+                    }
+
+                    if (!component) {
+                        return false;
+                    }
+
+                    // the kinds that come before this one sit in lower bits
+                    BPMF::Component kind = (component & BPMF::ToneMarkerMask) ? BPMF::ToneMarkerMask : (component & BPMF::VowelMask) ? BPMF::VowelMask : (component & BPMF::MiddleVowelMask) ? BPMF::MiddleVowelMask : BPMF::ConsonantMask;
+                    if (components >= (kind & -kind)) {
+                        return false;
+                    }
+                    components |= component;
+                }
+                syllable = BPMF(components);
+                return !syllable.isEmpty();
+            }
+        case HanyuPinyin:
+            return m_table->findHanyuPinyin(token, length, syllable) && !syllable.isEmpty();
+        case PHT:
+            return m_table->findPHT(token, length, syllable) && !syllable.isEmpty();
+        case AbsoluteOrderString:
+            {
+                if (length != 2 || token[0] < 48 || token[0] >= 48 + 79 || token[1] < 48 || token[1] >= 48 + 79) {
+                    return false;
+                }
+                size_t order = (size_t)(token[1] - 48) * 79 + (size_t)(token[0] - 48);
+                if (order >= BopomofoSyllableTable::Size) {
+                    return false;
+                }
+                syllable = BPMF::FromAbsoluteOrder((short)order);
+                return !syllable.isEmpty();
+            }
+    }
+    return false;
+}
+
+bool BopomofoTransliterator::append(const BPMF& syllable, string& output) const
+{
+    BPMF written = m_includesTone ? syllable : BPMF(syllable.consonantComponent() | syllable.middleVowelComponent() | syllable.vowelComponent());
+    switch (m_to) {
+        case ComposedString:
+            output += written.composedString();
+            return true;
+        case HanyuPinyin:
+            {
+                const string& romanized = m_table->hanyuPinyinString(written, true, m_useVForUUmlaut);
+                output += romanized;
+                return !romanized.empty();
+            }
+        case PHT:
+            {
+                const string& romanized = m_table->PHTString(written, true);
+                output += romanized;
+                return !romanized.empty();
+            }
+        case AbsoluteOrderString:
+            {
+                short order = written.absoluteOrder();
+                if (order >= (short)BopomofoSyllableTable::Size || BPMF::FromAbsoluteOrder(order) != written) {
+                    return false;
+                }
+                output += (char)(48 + order % 79);
+                output += (char)(48 + order / 79);
+                return true;
+            }
+    }
+    return false;
+}
+
+// The heuristics of BopomofoKeyboardLayout::heuristicSyllableFromKeySequence()
+// for one key, given the mask type of the syllable so far and what the parser
+// looks up around the key. Returns which of the key's components is added to
+// the syllable, or -1 for none.
+static int ChooseKeyComponent(BPMF::Component maskType, const vector<BPMF::Component>& components, bool beforeSeqHasIorUE, bool aheadSeqHasIorUE, bool onlyKey, bool endAheadOrAheadHasToneMarkKey)
+{
+    if (!components.size())
+        return -1;
+
+    if (components.size() == 1)
+        return 0;
+
+    BPMF head = BPMF(components[0]);
+    BPMF follow = BPMF(components[1]);
+    int endingIndex = components.size() > 2 ? 2 : 1;
+    BPMF ending = BPMF(components[endingIndex]);
+
+    // the I/UE + E rule
+    if (head.vowelComponent() == BPMF::E && follow.vowelComponent() != BPMF::E)
+        return beforeSeqHasIorUE ? 0 : 1;
+
+    if (head.vowelComponent() != BPMF::E && follow.vowelComponent() == BPMF::E)
+        return beforeSeqHasIorUE ? 1 : 0;
+
+    // the J/Q/X + I/UE rule
+    if (head.belongsToJQXClass() != follow.belongsToJQXClass()) {
+        if (maskType)
+            return ending != follow ? endingIndex : -1;
+        return (aheadSeqHasIorUE == head.belongsToJQXClass()) ? 0 : 1;
+    }
+
+    // only one key in the sequence
+    if (onlyKey) {
+        if (head.hasVowel() || follow.hasToneMarker() || head.belongsToZCSRClass())
+            return 0;
+        if (follow.hasVowel() || ending.hasToneMarker())
+            return 1;
+        return endingIndex;
+    }
+
+    if (!(maskType & head.maskType()) && !endAheadOrAheadHasToneMarkKey)
+        return 0;
+    if (endAheadOrAheadHasToneMarkKey && head.belongsToZCSRClass() && !maskType)
+        return 0;
+    if (maskType < follow.maskType())
+        return 1;
+    return endingIndex;
+}
+
+// A reading of the keys so far under assumptions about the keys to come:
+// what the next key may be, and whether a later key is I or UE; the
+// heuristics look no further ahead than that. Only the mask type of the
+// reading's syllable steers the heuristics, so the syllable itself is kept
+// aside, in a slot that the automaton fills in as keys come.
+struct KeySequenceReading {
+    enum {
+        NextIsEnd = 1,
+        NextIsToneKey = 2,
+        NextIsOtherKey = 4,
+        NextIsAnything = 7
+    };
+
+    unsigned int slot;
+    BPMF::Component maskType;
+    unsigned int next;
+    int laterIorUE;     // 0 or 1, or -1 for either
+
+    bool operator<(const KeySequenceReading& another) const
+    {
+        if (slot != another.slot)
+            return slot < another.slot;
+        if (maskType != another.maskType)
+            return maskType < another.maskType;
+        if (next != another.next)
+            return next < another.next;
+        return laterIorUE < another.laterIorUE;
+    }
+
+    bool operator==(const KeySequenceReading& another) const
+    {
+        return slot == another.slot && maskType == another.maskType && next == another.next && laterIorUE == another.laterIorUE;
+    }
+
+    bool covers(const KeySequenceReading& another) const
+    {
+        return slot == another.slot && (next & another.next) == another.next && (laterIorUE == -1 || laterIorUE == another.laterIorUE);
+    }
+};
+
+struct KeySequenceState {
+    bool atBeginning;
+    bool hasIorUE;
+    vector<KeySequenceReading> readings;
+
+    bool operator<(const KeySequenceState& another) const
+    {
+        if (atBeginning != another.atBeginning)
+            return atBeginning < another.atBeginning;
+        if (hasIorUE != another.hasIorUE)
+            return hasIorUE < another.hasIorUE;
+        return lexicographical_compare(readings.begin(), readings.end(), another.readings.begin(), another.readings.end());
+    }
+
+    // merges readings of the same slot whose assumptions add up, and drops
+    // those that another reading covers
+    void normalize()
+    {
+        bool merged = true;
+        while (merged) {
+            merged = false;
+            sort(readings.begin(), readings.end());
+            readings.erase(unique(readings.begin(), readings.end()), readings.end());
+
+            for (size_t i = 0; i < readings.size() && !merged; i++) {
+                for (size_t j = 0; j < readings.size() && !merged; j++) {
+                    KeySequenceReading& a = readings[i];
+                    const KeySequenceReading& b = readings[j];
+                    if (i == j || a.slot != b.slot)
+                        continue;
+
+                    if (a.covers(b)) {
+                    }
+                    else if (a.laterIorUE == b.laterIorUE) {
+                        a.next |= b.next;
+                    }
+                    else if (a.next == b.next && a.laterIorUE != -1 && b.laterIorUE != -1) {
+                        a.laterIorUE = -1;
+                    }
+                    else {
+                        continue;
+                    }
+
+                    readings.erase(readings.begin() + j);
+                    merged = true;
+                }
+            }
+        }
+    }
+};
+
+void BopomofoKeyboardLayout::compileKeySequenceAutomaton()
+{
+    // the parser tells keys apart by their components, and compares them
+    // with the keys of I, UE and the tones, which are 0 for a layout that
+    // lacks one
+    char iChar = componentToKey(BPMF::I);
+    char ueChar = componentToKey(BPMF::UE);
+    char toneChars[5] = {componentToKey(BPMF::Tone1), componentToKey(BPMF::Tone2), componentToKey(BPMF::Tone3), componentToKey(BPMF::Tone4), componentToKey(BPMF::Tone5)};
+
+    vector<char> classKeys(1, 0);
+    memset(m_keyClasses, 0, sizeof(m_keyClasses));
+    for (int c = 0; c < 256; c++) {
+        char key = (char)c;
+        bool special = key == iChar || key == ueChar || (toneChars[0] && key == toneChars[0]);
+        for (size_t t = 1; t < 5; t++)
+            special = special || key == toneChars[t];
+
+        if (special || m_keyToComponent.find(key) != m_keyToComponent.end()) {
+            m_keyClasses[c] = (unsigned char)classKeys.size();
+            classKeys.push_back(key);
+        }
+        else if (!classKeys[0]) {
+            // any one of the other keys stands for them all
+            classKeys[0] = key;
+        }
+    }
+    m_keyClassCount = classKeys.size();
+
+    KeySequenceState initial;
+    initial.atBeginning = true;
+    initial.hasIorUE = false;
+    KeySequenceReading empty = {0, 0, KeySequenceReading::NextIsAnything, -1};
+    initial.readings.push_back(empty);
+
+    map<KeySequenceState, size_t> stateIDs;
+    vector<KeySequenceState> states;
+    stateIDs[initial] = 0;
+    states.push_back(initial);
+
+    m_keySequenceTransitions.clear();
+    m_keySequenceEndings.clear();
+
+    // states are numbered in the order they're reached
+    for (size_t id = 0; id < states.size(); id++) {
+        KeySequenceState state = states[id];
+
+        // the sequence ends here: the reading that expected the end and no
+        // later I or UE gives the syllable
+        unsigned char ending = 0;
+        for (vector<KeySequenceReading>::const_iterator r = state.readings.begin() ; r != state.readings.end() ; ++r) {
+            if ((r->next & KeySequenceReading::NextIsEnd) && r->laterIorUE != 1) {
+                ending = (unsigned char)r->slot;
+                break;
+            }
+        }
+        m_keySequenceEndings.push_back(ending);
+
+        for (size_t k = 0; k < m_keyClassCount; k++) {
+            char key = classKeys[k];
+            bool isIorUE = key == iChar || key == ueChar;
+            bool isTone = (toneChars[0] && key == toneChars[0]) || key == toneChars[1] || key == toneChars[2] || key == toneChars[3] || key == toneChars[4];
+            vector<BPMF::Component> components = keyToComponents(key);
+
+            KeySequenceState next;
+            next.atBeginning = false;
+            next.hasIorUE = state.hasIorUE || isIorUE;
+
+            // a new reading's slot is first numbered by where its syllable
+            // comes from: a current slot and the component added to it
+            for (vector<KeySequenceReading>::const_iterator r = state.readings.begin() ; r != state.readings.end() ; ++r) {
+                if (!(r->next & (isTone ? KeySequenceReading::NextIsToneKey : KeySequenceReading::NextIsOtherKey)))
+                    continue;
+
+                // an I or UE settles what was assumed about later keys
+                int laterIorUE = r->laterIorUE;
+                if (isIorUE) {
+                    if (!laterIorUE)
+                        continue;
+                    laterIorUE = -1;
+                }
+
+                for (int ahead = 0; ahead < 2; ahead++) {
+                    if (laterIorUE != -1 && laterIorUE != ahead)
+                        continue;
+
+                    const unsigned int nextKeys[3] = {KeySequenceReading::NextIsEnd, KeySequenceReading::NextIsToneKey, KeySequenceReading::NextIsOtherKey};
+                    for (size_t n = 0; n < 3; n++) {
+                        bool onlyKey = state.atBeginning && nextKeys[n] == KeySequenceReading::NextIsEnd;
+                        int chosen = ChooseKeyComponent(r->maskType, components, state.hasIorUE, !!ahead, onlyKey, nextKeys[n] != KeySequenceReading::NextIsOtherKey);
+
+                        KeySequenceReading reading = {r->slot * 4 + (unsigned int)(chosen + 1), r->maskType, nextKeys[n], ahead};
+                        if (chosen >= 0)
+                            reading.maskType |= BPMF(components[chosen]).maskType();
+                        next.readings.push_back(reading);
+                    }
+                }
+            }
+            next.normalize();
+
+            // renumber the slots from 0, keeping their order
+            KeySequenceTransition transition;
+            memset(&transition, 0, sizeof(transition));
+            memset(transition.components, -1, sizeof(transition.components));
+
+            unsigned int slotCount = 0;
+            unsigned int lastOrigin = 0;
+            for (size_t i = 0; i < next.readings.size(); i++) {
+                unsigned int origin = next.readings[i].slot;
+                if (!i || origin != lastOrigin) {
+                    if (slotCount == MaxKeySequenceReadings) {
+                        // a layout whose readings don't fit; the heuristics
+                        // still work, just without the automaton
+                        m_keySequenceTransitions.clear();
+                        m_keySequenceEndings.clear();
+                        return;
+                    }
+                    transition.sources[slotCount] = (unsigned char)(origin / 4);
+                    transition.components[slotCount] = (signed char)((int)(origin % 4) - 1);
+                    slotCount++;
+                    lastOrigin = origin;
+                }
+                next.readings[i].slot = slotCount - 1;
+            }
+
+            map<KeySequenceState, size_t>::const_iterator found = stateIDs.find(next);
+            if (found == stateIDs.end()) {
+                transition.state = (unsigned short)states.size();
+                stateIDs[next] = states.size();
+                states.push_back(next);
+            }
+            else {
+                transition.state = (unsigned short)found->second;
+            }
+            m_keySequenceTransitions.push_back(transition);
+        }
+    }
 }
 
-const BopomofoKeyboardLayout* BopomofoKeyboardLayout::c_StandardLayout = 0;
-const BopomofoKeyboardLayout* BopomofoKeyboardLayout::c_ETenLayout = 0;
-const BopomofoKeyboardLayout* BopomofoKeyboardLayout::c_HsuLayout = 0;
-const BopomofoKeyboardLayout* BopomofoKeyboardLayout::c_ETen26Layout = 0;                        
-const BopomofoKeyboardLayout* BopomofoKeyboardLayout::c_HanyuPinyinLayout = 0;
+const BPMF BopomofoKeyboardLayout::syllableFromKeySequence(const char* sequence, size_t length) const
+{
+    if (m_keySequenceTransitions.empty())
+        return heuristicSyllableFromKeySequence(string(sequence, length));
+
+    BPMF syllables[MaxKeySequenceReadings];
+    size_t state = 0;
+    for (size_t k = 0; k < length; k++) {
+        unsigned char key = (unsigned char)sequence[k];
+        const KeySequenceTransition& transition = m_keySequenceTransitions[state * m_keyClassCount + m_keyClasses[key]];
+        const BPMF::Component* components = m_keyComponents[key];
+
+        BPMF next[MaxKeySequenceReadings];
+        for (size_t i = 0; i < MaxKeySequenceReadings; i++) {
+            next[i] = syllables[transition.sources[i]];
+            if (transition.components[i] >= 0)
+                next[i] += BPMF(components[transition.components[i]]);
+        }
+        for (size_t i = 0; i < MaxKeySequenceReadings; i++)
+            syllables[i] = next[i];
+
+        state = transition.state;
+    }
+
+    BPMF syllable = syllables[m_keySequenceEndings[state]];
+
+    // the Hsu fixes, as in heuristicSyllableFromKeySequence()
+    if (this == HsuLayout()) {
+        if (syllable.vowelComponent() == BPMF::ENG && !syllable.hasConsonant() && !syllable.hasMiddleVowel()) {
+            syllable += BPMF(BPMF::ERR);
+        }
+        else if (syllable.consonantComponent() == BPMF::G && (syllable.middleVowelComponent() == BPMF::I || syllable.middleVowelComponent() == BPMF::UE)) {
+            syllable += BPMF(BPMF::J);
+        }
+    }
+
+    return syllable;
+}
 
 void BopomofoKeyboardLayout::FinalizeLayouts()
 {
-    #define FL(x) if (x) { delete x; } x = 0
-    FL(c_StandardLayout);
-    FL(c_ETen26Layout);
-    FL(c_HsuLayout);
-    FL(c_ETen26Layout);
-    FL(c_HanyuPinyinLayout);
-    #undef FL    
+    // the layouts are built once and live until the program exits, so that
+    // a layout pointer handed out to any thread stays valid
 }
 
 const BopomofoKeyboardLayout* BopomofoKeyboardLayout::LayoutForName(const string& name)
@@ -768,7 +1402,7 @@ const BopomofoKeyboardLayout* BopomofoKeyboardLayout::LayoutForName(const string
 
 const BopomofoKeyboardLayout* BopomofoKeyboardLayout::StandardLayout()
 {
-    if (!c_StandardLayout) {
+    static const BopomofoKeyboardLayout* layout = [] {
         vector<BPMF::Component> vec;
         BopomofoKeyToComponentMap ktcm;
         
@@ -814,15 +1448,15 @@ const BopomofoKeyboardLayout* BopomofoKeyboardLayout::StandardLayout()
         ASSIGNKEY1(ktcm, vec, '6', BPMF::Tone2);
         ASSIGNKEY1(ktcm, vec, '7', BPMF::Tone5);        
         
-        c_StandardLayout = new BopomofoKeyboardLayout(ktcm, "Standard");
-    }
-    
-    return c_StandardLayout;
+        return new BopomofoKeyboardLayout(ktcm, "Standard");
+    }();
+
+    return layout;
 }
 
 const BopomofoKeyboardLayout* BopomofoKeyboardLayout::ETenLayout()
 {
-    if (!c_ETenLayout) {
+    static const BopomofoKeyboardLayout* layout = [] {
         vector<BPMF::Component> vec;
         BopomofoKeyToComponentMap ktcm;
                 
@@ -868,15 +1502,15 @@ const BopomofoKeyboardLayout* BopomofoKeyboardLayout::ETenLayout()
         ASSIGNKEY1(ktcm, vec, '4', BPMF::Tone4);
         ASSIGNKEY1(ktcm, vec, '1', BPMF::Tone5);
         
-        c_ETenLayout = new BopomofoKeyboardLayout(ktcm, "ETen");
-    }
-    
-    return c_ETenLayout;    
+        return new BopomofoKeyboardLayout(ktcm, "ETen");
+    }();
+
+    return layout;
 }
 
 const BopomofoKeyboardLayout* BopomofoKeyboardLayout::HsuLayout()
 {
-    if (!c_HsuLayout) {
+    static const BopomofoKeyboardLayout* layout = [] {
         vector<BPMF::Component> vec;
         BopomofoKeyToComponentMap ktcm;
                 
@@ -906,14 +1540,14 @@ const BopomofoKeyboardLayout* BopomofoKeyboardLayout::HsuLayout()
         ASSIGNKEY1(ktcm, vec, 'w', BPMF::AO);
         ASSIGNKEY1(ktcm, vec, 'o', BPMF::OU);
         
-        c_HsuLayout = new BopomofoKeyboardLayout(ktcm, "Hsu");
-    }
-    
-    return c_HsuLayout;    
+        return new BopomofoKeyboardLayout(ktcm, "Hsu");
+    }();
+
+    return layout;
 }
 const BopomofoKeyboardLayout* BopomofoKeyboardLayout::ETen26Layout()
 {
-    if (!c_ETen26Layout) {
+    static const BopomofoKeyboardLayout* layout = [] {
         vector<BPMF::Component> vec;
         BopomofoKeyToComponentMap ktcm;
                 
@@ -944,19 +1578,16 @@ const BopomofoKeyboardLayout* BopomofoKeyboardLayout::ETen26Layout()
         ASSIGNKEY1(ktcm, vec, 'i', BPMF::AI);
         ASSIGNKEY1(ktcm, vec, 'z', BPMF::AO);
         
-        c_ETen26Layout = new BopomofoKeyboardLayout(ktcm, "ETen26");
-    }
-    
-    return c_ETen26Layout;       
+        return new BopomofoKeyboardLayout(ktcm, "ETen26");
+    }();
+
+    return layout;
 }
 
 const BopomofoKeyboardLayout* BopomofoKeyboardLayout::HanyuPinyinLayout()
 {
-    if (!c_HanyuPinyinLayout) {
-        BopomofoKeyToComponentMap ktcm;        
-        c_HanyuPinyinLayout = new BopomofoKeyboardLayout(ktcm, "HanyuPinyin");
-    }
-    return c_HanyuPinyinLayout;
+    static const BopomofoKeyboardLayout* layout = new BopomofoKeyboardLayout(BopomofoKeyToComponentMap(), "HanyuPinyin");
+    return layout;
 }
 
 
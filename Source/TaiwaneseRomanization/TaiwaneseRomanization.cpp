@@ -26,6 +26,7 @@
 //
 
 #include "TaiwaneseRomanization.h"
+#include <cstring>
 
 using namespace Formosa::TaiwaneseRomanization;
 
@@ -54,12 +55,12 @@ void ComposableStringBuffer::clear()
     strvec.clear();
 }
 
-bool ComposableStringBuffer::empty()
+bool ComposableStringBuffer::empty() const
 {
     return strvec.empty();
 }
 
-unsigned int ComposableStringBuffer::numberOfCodepoints()
+unsigned int ComposableStringBuffer::numberOfCodepoints() const
 {
     return (unsigned int)strvec.size();
 }
@@ -91,15 +92,24 @@ const string ComposableStringBuffer::internalForm()
     return newstr;
 }
 
-RomanizationSymbol::RomanizationSymbol() : _tone(0), _type(POJSyllable)
+// the letters of the two-letter symbols, from NNSymbol on
+static const char* const c_twoLetterSymbols[] = { "nn", "ou", "oo", "ii" };
+
+RomanizationSymbol::RomanizationSymbol() : _symbolID(NoSymbol), _upperCaseLetters(0), _vowelID(VowelHelper::NoVowel), _tone(0), _type(POJSyllable)
+{
+}
+
+RomanizationSymbol::RomanizationSymbol(const string &s, SyllableType t) : _symbolID(NoSymbol), _upperCaseLetters(0), _vowelID(VowelHelper::NoVowel), _tone(0), _type(t)
 {
+    setLetters(s.data(), (unsigned int)s.length());
 }
 
-RomanizationSymbol::RomanizationSymbol(const string &s, SyllableType t) : _tone(0), _type(t), _symbol(s)
+RomanizationSymbol::RomanizationSymbol(char c, SyllableType t) : _symbolID(NoSymbol), _upperCaseLetters(0), _vowelID(VowelHelper::NoVowel), _tone(0), _type(t)
 {
+    setLetters(&c, 1);
 }
 
-RomanizationSymbol::RomanizationSymbol(const RomanizationSymbol &s) : _tone(s._tone), _type(s._type), _symbol(s._symbol)
+RomanizationSymbol::RomanizationSymbol(const RomanizationSymbol &s) : _symbolID(s._symbolID), _upperCaseLetters(s._upperCaseLetters), _vowelID(s._vowelID), _tone(s._tone), _type(s._type)
 {
 }
 
@@ -110,7 +120,9 @@ void RomanizationSymbol::setType(SyllableType t)
 
 const RomanizationSymbol& RomanizationSymbol::operator=(const RomanizationSymbol &s)
 {
-    _symbol = s._symbol;
+    _symbolID = s._symbolID;
+    _upperCaseLetters = s._upperCaseLetters;
+    _vowelID = s._vowelID;
     _tone = s._tone;
     _type = s._type;
     return *this;
@@ -118,23 +130,99 @@ const RomanizationSymbol& RomanizationSymbol::operator=(const RomanizationSymbol
 
 const string RomanizationSymbol::symbol() const
 {
-    return string(_symbol);
+    char letters[2];
+    return string(letters, copyLetters(letters));
 }
 
 const string RomanizationSymbol::symbolInLowerCase() const
 {
-    string lower;
-    unsigned int s = (unsigned int)_symbol.length();
-    for (unsigned int i=0; i<s; i++) lower+=tolower(_symbol[i]);
-    return lower;
+    if (_symbolID == NoSymbol) return string();
+    if (_symbolID < NoSymbol) return string(1, (char)_symbolID);
+    return string(c_twoLetterSymbols[_symbolID - NNSymbol], 2);
 }
 
 const string RomanizationSymbol::setSymbol(const string& s)
 {
-    return (_symbol = s);
+    setLetters(s.data(), (unsigned int)s.length());
+    return symbol();
 }
 
-const string RomanizationSymbol::composedForm(bool forcePOJStyle, bool usePOJLegacyOU) const
+bool RomanizationSymbol::setLetters(const char* letters, unsigned int length)
+{
+    if (length > 2) return false;
+
+    char lower[2];
+    unsigned char upperCaseLetters = 0;
+    for (unsigned int i = 0 ; i < length ; i++) {
+        lower[i] = tolower((unsigned char)letters[i]);
+        if (lower[i] != letters[i]) upperCaseLetters |= 1 << i;
+    }
+
+    unsigned int symbolID = NoSymbol;
+    if (length == 1) {
+        symbolID = (unsigned char)lower[0];
+    }
+    else if (length == 2) {
+        for (symbolID = NNSymbol ; symbolID <= IISymbol ; symbolID++) {
+            const char* twoLetters = c_twoLetterSymbols[symbolID - NNSymbol];
+            if (twoLetters[0] == lower[0] && twoLetters[1] == lower[1]) break;
+        }
+        if (symbolID > IISymbol) return false;
+    }
+
+    _symbolID = symbolID;
+    _upperCaseLetters = upperCaseLetters;
+    _vowelID = VowelHelper::vowelIDForVowel(letters, length);
+    return true;
+}
+
+bool RomanizationSymbol::appendLetter(char c)
+{
+    char letters[3];
+    unsigned int length = copyLetters(letters);
+    letters[length] = c;
+    return setLetters(letters, length + 1);
+}
+
+void RomanizationSymbol::appendSymbol(string& output) const
+{
+    char letters[2];
+    output.append(letters, copyLetters(letters));
+}
+
+unsigned int RomanizationSymbol::symbolID() const
+{
+    return _symbolID;
+}
+
+unsigned int RomanizationSymbol::length() const
+{
+    if (_symbolID == NoSymbol) return 0;
+    return _symbolID < NoSymbol ? 1 : 2;
+}
+
+char RomanizationSymbol::letterAt(unsigned int i) const
+{
+    if (i >= length()) return 0;
+    char c = _symbolID < NoSymbol ? (char)_symbolID : c_twoLetterSymbols[_symbolID - NNSymbol][i];
+    return (_upperCaseLetters & (1 << i)) ? toupper((unsigned char)c) : c;
+}
+
+unsigned int RomanizationSymbol::copyLetters(char* letters) const
+{
+    if (_symbolID < NoSymbol) {
+        letters[0] = (_upperCaseLetters & 1) ? toupper(_symbolID) : (char)_symbolID;
+        return 1;
+    }
+    if (_symbolID == NoSymbol) return 0;
+
+    const char* lower = c_twoLetterSymbols[_symbolID - NNSymbol];
+    letters[0] = (_upperCaseLetters & 1) ? toupper(lower[0]) : lower[0];
+    letters[1] = (_upperCaseLetters & 2) ? toupper(lower[1]) : lower[1];
+    return 2;
+}
+
+const VowelHelper::ComposedVowel RomanizationSymbol::composedVowel(bool forcePOJStyle, bool usePOJLegacyOU) const
 {
     bool usePOJStyleOUAndNN = (_type == POJSyllable) || (_type == HakkaPFSSyllable) || forcePOJStyle;
     bool usePOJStyleNinthToneMark = (_type == POJSyllable);
@@ -153,38 +241,35 @@ const string RomanizationSymbol::composedForm(bool forcePOJStyle, bool usePOJLeg
         }
     }
     
-    string composed = VowelHelper::symbolForVowel(_symbol, nanTone, usePOJStyleOUAndNN, usePOJStyleNinthToneMark, composeII, usePOJLegacyOU);
-    if (!composed.length()) return _symbol;
-    return composed;
+    return VowelHelper::composedVowelFromID(_vowelID, nanTone, usePOJStyleOUAndNN, usePOJStyleNinthToneMark, composeII, usePOJLegacyOU);
+}
+
+const string RomanizationSymbol::composedForm(bool forcePOJStyle, bool usePOJLegacyOU) const
+{
+    VowelHelper::ComposedVowel composed = composedVowel(forcePOJStyle, usePOJLegacyOU);
+    if (!composed.length) return symbol();
+    return string(composed.data, composed.length);
+}
+
+void RomanizationSymbol::appendComposedForm(string& output, bool forcePOJStyle, bool usePOJLegacyOU) const
+{
+    VowelHelper::ComposedVowel composed = composedVowel(forcePOJStyle, usePOJLegacyOU);
+    if (!composed.length) {
+        appendSymbol(output);
+        return;
+    }
+    output.append(composed.data, composed.length);
 }
 
 unsigned int RomanizationSymbol::composedLength() const
 {
-    string composed = composedForm();
-    unsigned int len = 0, clen = (unsigned int)composed.length();
-    for (unsigned int i=0; i<clen; )
-    {
-        if (!(composed[i] & 0x80)) {
-            len++;
-            i++;
-        }
-        else if ((composed[i] & 0xe0) == 0xc0) {
-            len++;
-            i+=2;
-        }
-        else if ((composed[i] & 0xf0) == 0xe0) {
-            len++;
-            i+=3;
-        }
-        else {
-            len++;
-            i+=4;
-        }
+    VowelHelper::ComposedVowel composed = composedVowel(false, false);
+    if (composed.length) {
+        return composed.codepoints;
     }
-    
-    // fprintf (stderr, "composed=%s, strlen=%d, calculated len=%d\n", composed.c_str(), clen, len);
-    
-    return len;
+
+    // an uncomposed symbol is one codepoint per letter
+    return length();
 }
 
 unsigned int RomanizationSymbol::tone() const
@@ -200,8 +285,9 @@ unsigned int RomanizationSymbol::setTone(unsigned int t)
 
 bool RomanizationSymbol::isUpperCase() const
 {
-    if (!_symbol.length()) return false;
-    return toupper(_symbol[0]) == _symbol[0];
+    if (_symbolID == NoSymbol) return false;
+    unsigned char c = letterAt(0);
+    return toupper(c) == c;
 }
 
 
@@ -209,6 +295,7 @@ bool RomanizationSymbol::isUpperCase() const
 RomanizationSyllable::RomanizationSyllable() : _inputType(POJSyllable), _inputOption(DiacriticGivenBeforeVowel), 
 _forcePOJStyle(false),
 _usePOJLegacyOU(false),
+_symbolCount(0),
 _cursor(0), _preparedTone(0)
 {
 }
@@ -216,9 +303,11 @@ _cursor(0), _preparedTone(0)
 RomanizationSyllable::RomanizationSyllable(const RomanizationSyllable &s) : _inputType(s._inputType),
 _inputOption(s._inputOption),
 _forcePOJStyle(s._forcePOJStyle),
-_symvec(s._symvec),
+_usePOJLegacyOU(s._usePOJLegacyOU),
+_symbolCount(s._symbolCount),
 _cursor(s._cursor), _preparedTone(s._preparedTone)
 {
+    for (unsigned int i = 0 ; i < _symbolCount ; i++) _symbols[i] = s._symbols[i];
 }
 
 const RomanizationSyllable& RomanizationSyllable::operator=(const RomanizationSyllable &s)
@@ -226,7 +315,9 @@ const RomanizationSyllable& RomanizationSyllable::operator=(const RomanizationSy
     _inputType = s._inputType;
     _inputOption = s._inputOption;
     _forcePOJStyle = s._forcePOJStyle;
-    _symvec = s._symvec;
+    _usePOJLegacyOU = s._usePOJLegacyOU;
+    _symbolCount = s._symbolCount;
+    for (unsigned int i = 0 ; i < _symbolCount ; i++) _symbols[i] = s._symbols[i];
     _cursor = s._cursor;
     _preparedTone = s._preparedTone;
     return *this;
@@ -254,33 +345,39 @@ void RomanizationSyllable::setUsePOJLegacyOU(bool u) {
 
 void RomanizationSyllable::clear()
 {
-    _symvec.clear();
+    _symbolCount = 0;
     _cursor = 0;
     _preparedTone = 0;
 }
 
 bool RomanizationSyllable::empty() const
 {
-    return _symvec.empty();
+    return !_symbolCount;
 }
 
 unsigned int RomanizationSyllable::numberOfCodepoints() const
 {
-    return (unsigned int)_symvec.size();
+    return _symbolCount;
 }
 
 const string RomanizationSyllable::composedForm()
 {
-    unsigned int s = (unsigned int)_symvec.size();
     string composed;
+    appendComposedForm(composed);
+    return composed;
+}
+
+void RomanizationSyllable::appendComposedForm(string& composed)
+{
+    unsigned int s = _symbolCount;
     unsigned int i;
     
     if (_preparedTone) _cursor--;
     
     for (i=0; i<_cursor; i++) 
     {
-        composed += _symvec[i].composedForm(_forcePOJStyle, _usePOJLegacyOU);
-        // fprintf(stderr, "%d, symbol=%s, composed=%s, composd form=%s\n", i, _symvec[i].symbol().c_str(), _symvec[i].composedForm().c_str(), composed.c_str());
+        _symbols[i].appendComposedForm(composed, _forcePOJStyle, _usePOJLegacyOU);
+        // fprintf(stderr, "%d, symbol=%s, composed=%s, composd form=%s\n", i, _symbols[i].symbol().c_str(), _symbols[i].composedForm().c_str(), composed.c_str());
     }
     
     
@@ -294,13 +391,11 @@ const string RomanizationSyllable::composedForm()
     
     for (; i<s; i++)
     {
-        composed += _symvec[i].composedForm(_forcePOJStyle);
+        _symbols[i].appendComposedForm(composed, _forcePOJStyle);
         // fprintf(stderr, "composd form=%s\n", composed.c_str());
     }
     
     if (_preparedTone) _cursor++;
-    
-    return composed;
 }
 
 void RomanizationSyllable::setCursor(unsigned int c)
@@ -313,7 +408,7 @@ unsigned int RomanizationSyllable::cursor() const
 {
     unsigned int realcursor = _preparedTone ? _cursor-1 : _cursor;			
     unsigned codepointCursor=0;
-    for (unsigned int i=0; i<realcursor; i++) codepointCursor+=_symvec[i].composedLength();
+    for (unsigned int i=0; i<realcursor; i++) codepointCursor+=_symbols[i].composedLength();
     
     if (_preparedTone) codepointCursor++;
     
@@ -355,10 +450,11 @@ bool RomanizationSyllable::cursorRight()
 
 bool RomanizationSyllable::insertSymbolAtCursor(const RomanizationSymbol &s)
 {
+    if (_symbolCount == MaxSymbols) return false;
     clearPreparedTone();
     RomanizationSymbol newsym(s);
     newsym.setType(_inputType);
-    _symvec.insert(_symvec.begin() + _cursor, newsym);
+    insertSymbolAt(_cursor, newsym);
     _cursor++;			
     
     return true;			
@@ -396,45 +492,49 @@ bool RomanizationSyllable::insertCharacterAtCursor(char c, unsigned int tone)
     {
         if (hasPreviousSymbolAtCursor())
         {
-            string prev = previousSymbolAtCursor().symbolInLowerCase();
+            RomanizationSymbol& previous = previousSymbolAtCursor();
+            unsigned int prev = previous.symbolID();
             
             // N -> nn only works if the first character of the syllable is not an
             // all uppercase symbol
-            if (c=='N' && ((prev != "n") && (prev != "nn")) && _inputType == POJSyllable
-                && (_symvec.size() > 0 && !_symvec[0].isUpperCase()))
+            if (c=='N' && ((prev != 'n') && (prev != RomanizationSymbol::NNSymbol)) && _inputType == POJSyllable
+                && (_symbolCount > 0 && !_symbols[0].isUpperCase()))
             {
                 // insert two n's in a row
-                _symvec.insert(_symvec.begin() + _cursor, RomanizationSymbol(string("nn"), _inputType));
+                RomanizationSymbol nn('n', _inputType);
+                nn.appendLetter('n');
+                if (!insertSymbolAt(_cursor, nn)) return false;
                 _cursor++;
                 return true;
             }
-            else if (tolower(c)=='n' && prev=="n") {
-                previousSymbolAtCursor().setSymbol(previousSymbolAtCursor().symbol() + string(1, c));
+            else if (tolower(c)=='n' && prev=='n') {
+                previous.appendLetter(c);
                 return true;
             }
-            else if (_inputType == POJSyllable && tolower(c)=='u' && prev=="o") {
-                previousSymbolAtCursor().setSymbol(previousSymbolAtCursor().symbol() + string(1, c));
+            else if (_inputType == POJSyllable && tolower(c)=='u' && prev=='o') {
+                previous.appendLetter(c);
                 return true;
             }
-            else if (_inputType == TLSyllable && tolower(c)=='o' && prev=="o") {
-                previousSymbolAtCursor().setSymbol(previousSymbolAtCursor().symbol() + string(1, c));
+            else if (_inputType == TLSyllable && tolower(c)=='o' && prev=='o') {
+                previous.appendLetter(c);
                 return true;
             }
-            else if ((_inputType == HakkaPFSSyllable) && tolower(c)=='i' && prev=="i") {
-                previousSymbolAtCursor().setSymbol(previousSymbolAtCursor().symbol() + string(1, c));
+            else if ((_inputType == HakkaPFSSyllable) && tolower(c)=='i' && prev=='i') {
+                previous.appendLetter(c);
                 return true;
             }                    
-            else if (tolower(c)=='g' && prev=="nn") {
+            else if (tolower(c)=='g' && prev==RomanizationSymbol::NNSymbol) {
                 // we need to break them up!
-                string before = previousSymbolAtCursor().symbol();
+                if (_symbolCount + 2 > MaxSymbols) return false;
+                char first = previous.letterAt(0), second = previous.letterAt(1);
                 
                 // and the tone of the previous symbol (when it's combined into nn) will be retained
-                previousSymbolAtCursor().setSymbol(before.substr(0, 1));
+                previous.setLetters(&first, 1);
                 
                 // insert one n and one g
-                _symvec.insert(_symvec.begin() + _cursor, RomanizationSymbol(before.substr(1,1), _inputType));
+                insertSymbolAt(_cursor, RomanizationSymbol(second, _inputType));
                 _cursor++;
-                _symvec.insert(_symvec.begin() + _cursor, RomanizationSymbol(string(1, c), _inputType));
+                insertSymbolAt(_cursor, RomanizationSymbol(c, _inputType));
                 _cursor++;
                 return true;
             }
@@ -442,7 +542,8 @@ bool RomanizationSyllable::insertCharacterAtCursor(char c, unsigned int tone)
     }
     
     
-    RomanizationSymbol s(string(1, c), _inputType);
+    if (_symbolCount == MaxSymbols) return false;
+    RomanizationSymbol s(c, _inputType);
     if (_preparedTone)
     {
         _cursor--;
@@ -454,7 +555,7 @@ bool RomanizationSyllable::insertCharacterAtCursor(char c, unsigned int tone)
         s.setTone(tone);
     }
     
-    _symvec.insert(_symvec.begin() + _cursor, s);
+    insertSymbolAt(_cursor, s);
     _cursor++;			
     
     return true;
@@ -470,7 +571,7 @@ bool RomanizationSyllable::removeCharacterAtRightOfCursor()	// backspace
     
     if (atBeginning()) return false;
     _cursor--;
-    _symvec.erase(_symvec.begin() + _cursor);
+    removeSymbolAt(_cursor);
     return true;
 }
 
@@ -481,7 +582,7 @@ bool RomanizationSyllable::removeCharacterAtLeftOfCursor()	// delete
     // then push it back
     bool retval=true;
     if (_preparedTone) _cursor--;
-    if (atEnd()) retval=false; else _symvec.erase(_symvec.begin() + _cursor);
+    if (atEnd()) retval=false; else removeSymbolAt(_cursor);
     if (_preparedTone) _cursor++;
     return retval;
 }
@@ -489,33 +590,40 @@ bool RomanizationSyllable::removeCharacterAtLeftOfCursor()	// delete
 // returns a normalized string that represents the "internal form" for querying the database
 // implies normalization
 const string RomanizationSyllable::normalizedQueryData(unsigned int finalTone)
+{
+    char query[MaxQueryDataLength];
+    return string(query, writeNormalizedQueryData(query, finalTone));
+}
+
+size_t RomanizationSyllable::writeNormalizedQueryData(char* output, unsigned int finalTone) const
 {
     RomanizationSyllable s(*this);
     s.normalize(finalTone);
-    string query;
     
-    unsigned int size = (unsigned int)s._symvec.size();
+    unsigned int size = s._symbolCount;
     unsigned int loudest = 0;
+    size_t length = 0;
     
     for (unsigned int i=0; i<size; i++) {
-        query = query + s._symvec[i].symbol();
-        if (s._symvec[i].tone() > 1) loudest = s._symvec[i].tone();
-        // fprintf (stderr, "combining query data %s, tone %d\n", s._symvec[i].symbol().c_str(), s._symvec[i].tone());
+        length += s._symbols[i].copyLetters(output + length);
+        if (s._symbols[i].tone() > 1) loudest = s._symbols[i].tone();
     }
     
     // TODO: Accept 1 when Hakka
-    if (loudest > 1) query = query + string(1, loudest+'0');
-    return query;
+    if (loudest > 1) output[length++] = loudest + '0';
+    return length;
 }
 
-static unsigned int FindVowel(vector<RomanizationSymbol>& symvec, unsigned int start)
+static unsigned int FindVowel(const RomanizationSymbol* symbols, unsigned int size, unsigned int start)
 {
-    unsigned i = start >= (unsigned int)symvec.size() ? (unsigned int)symvec.size() : start;
-    while (i < symvec.size()) {
-        string s = symvec[i].symbolInLowerCase();
-        
-        if (s == "a" || s == "e" || s == "i" || s == "o" || s == "u" || s == "ou" || s == "oo" || s == "ii") {
-            return i;
+    unsigned i = start >= size ? size : start;
+    while (i < size) {
+        switch (symbols[i].symbolID()) {
+            case 'a': case 'e': case 'i': case 'o': case 'u':
+            case RomanizationSymbol::OUSymbol:
+            case RomanizationSymbol::OOSymbol:
+            case RomanizationSymbol::IISymbol:
+                return i;
         }
         
         i++;
@@ -532,7 +640,7 @@ void RomanizationSyllable::normalize(unsigned int finalTone)
     bool pureTL = (_inputType == TLSyllable && !_forcePOJStyle);
     
     // fprintf (stderr, "input finalTone=%d\n", finalTone);
-    unsigned int end = (unsigned int)_symvec.size();
+    unsigned int end = _symbolCount;
     
     // if it's empty, just return
     if (!end) return;
@@ -543,105 +651,105 @@ void RomanizationSyllable::normalize(unsigned int finalTone)
     
     // find the loudest vowel
 #define FLV(x) ((p=findSymbol(x)) != end)
-#define SETLOUDEST(v) do { loudestVowel = v; if (_symvec[loudestVowel].tone()>0) { loudestTone = _symvec[loudestVowel].tone(); } } while(0)
+#define SETLOUDEST(v) do { loudestVowel = v; if (_symbols[loudestVowel].tone()>0) { loudestTone = _symbols[loudestVowel].tone(); } } while(0)
     
     
     if (!pureTL) {
         // do ng first
         // see if it's ng
-        if ((p=findSymbolPair("n", "g")) != end) {
+        if ((p=findSymbolPair('n', 'g')) != end) {
             SETLOUDEST(p);
         }
         else {
             // do m and n
-            if (FLV("m")) SETLOUDEST(p);        
-            if (FLV("n")) SETLOUDEST(p);
+            if (FLV('m')) SETLOUDEST(p);        
+            if (FLV('n')) SETLOUDEST(p);
         }
         
-        unsigned first = FindVowel(_symvec, 0);
+        unsigned first = FindVowel(_symbols, end, 0);
         if (first != end) {
             SETLOUDEST(first);
             
-            unsigned second = FindVowel(_symvec, first + 1);
-            if (second != end && _symvec[first].symbolInLowerCase() != "a") {
-                if (!(_symvec[first].symbolInLowerCase() == "e" && _symvec[second].symbolInLowerCase() == "e") && _symvec[second].symbolInLowerCase() != "i") {
+            unsigned second = FindVowel(_symbols, end, first + 1);
+            if (second != end && _symbols[first].symbolID() != 'a') {
+                if (!(_symbols[first].symbolID() == 'e' && _symbols[second].symbolID() == 'e') && _symbols[second].symbolID() != 'i') {
                     SETLOUDEST(second);
                 }
             }
         }
         
         // exceptions: oa/oai, oe/oei
-        first = findSymbolPair("o", "e");
+        first = findSymbolPair('o', 'e');
         if (first != end) {
-            string symAfter;
+            unsigned int symAfter = RomanizationSymbol::NoSymbol;
             if (first + 2 != end) {
-                symAfter = _symvec[first + 2].symbolInLowerCase();
+                symAfter = _symbols[first + 2].symbolID();
             }
             
-            if (!symAfter.size() || symAfter == "nn") {
+            if (symAfter == RomanizationSymbol::NoSymbol || symAfter == RomanizationSymbol::NNSymbol) {
                 SETLOUDEST(first);                
             }
         }
 
-        first = findSymbolPair("o", "a");
+        first = findSymbolPair('o', 'a');
         if (first != end) {
-            if (findSymbolTriple("o", "a", "i") == end) {
-                string symAfter;
+            if (findSymbolTriple('o', 'a', 'i') == end) {
+                unsigned int symAfter = RomanizationSymbol::NoSymbol;
                 if (first + 2 != end) {
-                    symAfter = _symvec[first + 2].symbolInLowerCase();
+                    symAfter = _symbols[first + 2].symbolID();
                 }
 
-                if (!symAfter.size() || symAfter == "nn") {
+                if (symAfter == RomanizationSymbol::NoSymbol || symAfter == RomanizationSymbol::NNSymbol) {
                     SETLOUDEST(first);                
                 }
             }
         }
     }
     else {
-        if (end==1 && _symvec[0].symbolInLowerCase()=="m") SETLOUDEST(0);
-        if (FLV("n")) SETLOUDEST(p);
-        if (FLV("m")) SETLOUDEST(p);
+        if (end==1 && _symbols[0].symbolID() == 'm') SETLOUDEST(0);
+        if (FLV('n')) SETLOUDEST(p);
+        if (FLV('m')) SETLOUDEST(p);
         
         // see if it's ng
-        if ((p=findSymbolPair("n", "g")) != end)
+        if ((p=findSymbolPair('n', 'g')) != end)
             SETLOUDEST(p);
         
-        if (FLV("u")) SETLOUDEST(p);
-        if (FLV("ii")) SETLOUDEST(p); // TODO: Check the rule here
-        if (FLV("i")) SETLOUDEST(p);
-        if (FLV("o")) SETLOUDEST(p);
-        if (FLV("e")) SETLOUDEST(p);
-        if (FLV("ou")) SETLOUDEST(p);
-        if (FLV("oo")) SETLOUDEST(p);
-        if (FLV("a")) SETLOUDEST(p);
+        if (FLV('u')) SETLOUDEST(p);
+        if (FLV(RomanizationSymbol::IISymbol)) SETLOUDEST(p); // TODO: Check the rule here
+        if (FLV('i')) SETLOUDEST(p);
+        if (FLV('o')) SETLOUDEST(p);
+        if (FLV('e')) SETLOUDEST(p);
+        if (FLV(RomanizationSymbol::OUSymbol)) SETLOUDEST(p);
+        if (FLV(RomanizationSymbol::OOSymbol)) SETLOUDEST(p);
+        if (FLV('a')) SETLOUDEST(p);
     }
     
     // the last "ere" override
     if (end >= 3) {
-        if (_symvec[end-1].symbolInLowerCase() == "e" && _symvec[end-2].symbolInLowerCase() == "r" && _symvec[end-3].symbolInLowerCase() == "e")
+        if (_symbols[end-1].symbolID() == 'e' && _symbols[end-2].symbolID() == 'r' && _symbols[end-3].symbolID() == 'e')
         {
             SETLOUDEST(end-1);
         }
     }
     
     if (loudestVowel==end) return;
-    // fprintf(stderr, "found loudest vowel=%d (%s), loudest tone=%d\n", loudestVowel, _symvec[loudestVowel].symbol().c_str(), loudestTone);
+    // fprintf(stderr, "found loudest vowel=%d (%s), loudest tone=%d\n", loudestVowel, _symbols[loudestVowel].symbol().c_str(), loudestTone);
     
     // finalTone overrides
     if (finalTone > 0) loudestTone = finalTone;
     
-    for (unsigned int i=0; i<end; i++) _symvec[i].setTone(0);
+    for (unsigned int i=0; i<end; i++) _symbols[i].setTone(0);
     
-    string lastSymbolStr = _symvec[end-1].symbolInLowerCase();
+    unsigned int lastSymbol = _symbols[end-1].symbolID();
     
     // if the symbol is "i", and there's a next "u", we shift the vowel to "u" (TL only)    
-    if (_symvec[loudestVowel].symbolInLowerCase()=="i" && pureTL)
+    if (_symbols[loudestVowel].symbolID() == 'i' && pureTL)
     {
-        if ((loudestVowel+1 < end) && (_symvec[loudestVowel+1].symbolInLowerCase() == "u" || _symvec[loudestVowel+1].symbolInLowerCase() == "ii")) {
+        if ((loudestVowel+1 < end) && (_symbols[loudestVowel+1].symbolID() == 'u' || _symbols[loudestVowel+1].symbolID() == RomanizationSymbol::IISymbol)) {
             // if i follows a vowel, and the next vowel is u or ṳ, we put the accent on the succeeding vowel
             loudestVowel++;
         }
-        else if (_inputType == POJSyllable && loudestVowel && (_symvec[loudestVowel-1].symbolInLowerCase() == "u" || _symvec[loudestVowel-1].symbolInLowerCase() == "ii")) {
+        else if (_inputType == POJSyllable && loudestVowel && (_symbols[loudestVowel-1].symbolID() == 'u' || _symbols[loudestVowel-1].symbolID() == RomanizationSymbol::IISymbol)) {
             // if (and only if) in POJ mode/forced POJ style, and if i precedes a vowel, and the next voewl is u or ṳ, we put the accent on the preceeding vowel
             loudestVowel--;
         }
@@ -654,22 +762,22 @@ void RomanizationSyllable::normalize(unsigned int finalTone)
 
     unsigned int tpkhTone = (_inputType == HakkaPFSSyllable) ? 5 : 8;
 
-    if (lastSymbolStr=="t" || lastSymbolStr=="p" || lastSymbolStr=="k" || lastSymbolStr=="h") {
+    if (lastSymbol=='t' || lastSymbol=='p' || lastSymbol=='k' || lastSymbol=='h') {
         // only when the ending is t, p, k, h is the tone set -- and only when the tone is 8
         
         
-        if (loudestTone==tpkhTone) _symvec[loudestVowel].setTone(loudestTone);
+        if (loudestTone==tpkhTone) _symbols[loudestVowel].setTone(loudestTone);
         return;
     }
     else {
         // if not t,p,k,h, we need to override the loudest tone--back to tone 1 !
         if (loudestTone==tpkhTone) {
-            _symvec[loudestVowel].setTone(0);
+            _symbols[loudestVowel].setTone(0);
             return;
         }
     }
     
-    _symvec[loudestVowel].setTone(loudestTone);
+    _symbols[loudestVowel].setTone(loudestTone);
     
 #undef FLV
 #undef SETTONE
@@ -682,46 +790,51 @@ char RomanizationSyllable::charAccordingToCaseOf(char c, char ref)
 
 RomanizationSyllable RomanizationSyllable::convertToPOJSyllable()
 {
-    RomanizationSyllable syl = *this;
-    syl.clearPreparedTone();
-    syl.setCursor(0);
+    RomanizationSyllable syl;
+    convertToPOJSyllable(syl);
+    return syl;
+}
+
+void RomanizationSyllable::convertToPOJSyllable(RomanizationSyllable& syl)
+{
+    syl._inputOption = _inputOption;
+    syl._forcePOJStyle = _forcePOJStyle;
+    syl._usePOJLegacyOU = _usePOJLegacyOU;
     //			if (_inputType==POJSyllable) return syl;
     
     syl.setInputType(POJSyllable);
     syl.clear();
     
     // begin TL->POJ conversion
-    unsigned int size = (unsigned int)_symvec.size();
+    unsigned int size = _symbolCount;
     unsigned int i;
     
     for (i=0; i<size; i++)
     {
-        RomanizationSymbol sym1 = _symvec[i];
-        string str1 = sym1.symbol();
+        const RomanizationSymbol& sym1 = _symbols[i];
         
-        // fprintf (stderr, "converting to POJ: %s\n", str1.c_str());
+        // fprintf (stderr, "converting to POJ: %s\n", sym1.symbol().c_str());
         
-        string lowstr1 = sym1.symbolInLowerCase();
+        unsigned int id1 = sym1.symbolID();
         
         // oo -> ou
-        if (lowstr1=="oo")
+        if (id1==RomanizationSymbol::OOSymbol)
         {
-            syl.insertCharacterAtCursor(charAccordingToCaseOf('o', str1[0]), sym1.tone());
-            syl.insertCharacterAtCursor(charAccordingToCaseOf('u', str1[1]));
+            syl.insertCharacterAtCursor(charAccordingToCaseOf('o', sym1.letterAt(0)), sym1.tone());
+            syl.insertCharacterAtCursor(charAccordingToCaseOf('u', sym1.letterAt(1)));
             continue;
         }
         
         
         if (hasNextSymbol(i)) {
-            RomanizationSymbol sym2 = _symvec[i+1];
-            string str2 = sym2.symbol();
-            string lowstr2 = sym2.symbolInLowerCase();
+            const RomanizationSymbol& sym2 = _symbols[i+1];
+            unsigned int id2 = sym2.symbolID();
             
             // ou -> oo for POJ but not combined ou
-            if (lowstr1=="o" && lowstr2=="u") {
+            if (id1=='o' && id2=='u') {
                 // detect case
-                syl.insertCharacterAtCursor(charAccordingToCaseOf('o', str1[0]), sym1.tone());
-                syl.insertCharacterAtCursor(charAccordingToCaseOf('u', str2[0]));
+                syl.insertCharacterAtCursor(charAccordingToCaseOf('o', sym1.letterAt(0)), sym1.tone());
+                syl.insertCharacterAtCursor(charAccordingToCaseOf('u', sym2.letterAt(0)));
                 
                 i++;
                 continue;
@@ -729,66 +842,65 @@ RomanizationSyllable RomanizationSyllable::convertToPOJSyllable()
             
             
             // ts -> ch with case detection
-            if (lowstr1=="t" && lowstr2=="s") {
+            if (id1=='t' && id2=='s') {
                 // detect case
-                syl.insertCharacterAtCursor(charAccordingToCaseOf('c', str1[0]));
-                syl.insertCharacterAtCursor(charAccordingToCaseOf('h', str2[0]));
+                syl.insertCharacterAtCursor(charAccordingToCaseOf('c', sym1.letterAt(0)));
+                syl.insertCharacterAtCursor(charAccordingToCaseOf('h', sym2.letterAt(0)));
                 
                 i++;
                 continue;
             }
             
             // ue -> oe
-            if (lowstr1=="u" && lowstr2=="e") {
+            if (id1=='u' && id2=='e') {
                 // detect case
-                syl.insertCharacterAtCursor(charAccordingToCaseOf('o', str1[0]), sym1.tone());
-                syl.insertCharacterAtCursor(charAccordingToCaseOf('e', str2[0]), sym2.tone());
+                syl.insertCharacterAtCursor(charAccordingToCaseOf('o', sym1.letterAt(0)), sym1.tone());
+                syl.insertCharacterAtCursor(charAccordingToCaseOf('e', sym2.letterAt(0)), sym2.tone());
                 
                 i++;
                 continue;
             }
             
             // ua -> oa
-            if (lowstr1=="u" && lowstr2=="a") {
+            if (id1=='u' && id2=='a') {
                 // detect case
-                syl.insertCharacterAtCursor(charAccordingToCaseOf('o', str1[0]), sym1.tone());
-                syl.insertCharacterAtCursor(charAccordingToCaseOf('a', str2[0]), sym2.tone());
+                syl.insertCharacterAtCursor(charAccordingToCaseOf('o', sym1.letterAt(0)), sym1.tone());
+                syl.insertCharacterAtCursor(charAccordingToCaseOf('a', sym2.letterAt(0)), sym2.tone());
                 
                 i++;
                 continue;
             }
             
             // ik -> ek (at ending)
-            if (lowstr1=="i" && lowstr2=="k" && (i+2)==size) {
+            if (id1=='i' && id2=='k' && (i+2)==size) {
                 // detect case
-                syl.insertCharacterAtCursor(charAccordingToCaseOf('e', str1[0]), sym1.tone());
-                syl.insertCharacterAtCursor(charAccordingToCaseOf('k', str2[0]), sym2.tone());
+                syl.insertCharacterAtCursor(charAccordingToCaseOf('e', sym1.letterAt(0)), sym1.tone());
+                syl.insertCharacterAtCursor(charAccordingToCaseOf('k', sym2.letterAt(0)), sym2.tone());
                 
                 i++;
                 continue;
             }
             
             if (hasNextNextSymbol(i) && (i+3)==size) {
-                RomanizationSymbol sym3 = _symvec[i+2];
-                string str3 = sym3.symbol();
-                string lowstr3 = sym3.symbolInLowerCase();
+                const RomanizationSymbol& sym3 = _symbols[i+2];
+                unsigned int id3 = sym3.symbolID();
                 
                 // ing -> eng (must be ending)					
-                if (lowstr1=="i" && lowstr2=="n" && lowstr3=="g") {
+                if (id1=='i' && id2=='n' && id3=='g') {
                     // detect case
-                    syl.insertCharacterAtCursor(charAccordingToCaseOf('e', str1[0]), sym1.tone());
-                    syl.insertCharacterAtCursor(charAccordingToCaseOf('n', str2[0]), sym2.tone());
-                    syl.insertCharacterAtCursor(charAccordingToCaseOf('g', str3[0]), sym3.tone());
+                    syl.insertCharacterAtCursor(charAccordingToCaseOf('e', sym1.letterAt(0)), sym1.tone());
+                    syl.insertCharacterAtCursor(charAccordingToCaseOf('n', sym2.letterAt(0)), sym2.tone());
+                    syl.insertCharacterAtCursor(charAccordingToCaseOf('g', sym3.letterAt(0)), sym3.tone());
                     
                     i+=2;
                     continue;
                 }
                 
                 // ouh -> oh (ending)
-                if (lowstr1=="o" && lowstr2=="u" && lowstr3=="h") {
+                if (id1=='o' && id2=='u' && id3=='h') {
                     // detect case
-                    syl.insertCharacterAtCursor(charAccordingToCaseOf('o', str1[0]), sym1.tone());
-                    syl.insertCharacterAtCursor(charAccordingToCaseOf('h', str2[0]), sym2.tone());
+                    syl.insertCharacterAtCursor(charAccordingToCaseOf('o', sym1.letterAt(0)), sym1.tone());
+                    syl.insertCharacterAtCursor(charAccordingToCaseOf('h', sym2.letterAt(0)), sym2.tone());
                     
                     i+=2;
                     continue;
@@ -798,96 +910,98 @@ RomanizationSyllable RomanizationSyllable::convertToPOJSyllable()
         
         syl.insertSymbolAtCursor(sym1);
     }			
-    
-    return syl;
 }
 
 RomanizationSyllable RomanizationSyllable::convertToTLSyllable()
 {
-    RomanizationSyllable syl = *this;
-    syl.clearPreparedTone();
-    syl.setCursor(0);
+    RomanizationSyllable syl;
+    convertToTLSyllable(syl);
+    return syl;
+}
+
+void RomanizationSyllable::convertToTLSyllable(RomanizationSyllable& syl)
+{
+    syl._inputOption = _inputOption;
+    syl._forcePOJStyle = _forcePOJStyle;
+    syl._usePOJLegacyOU = _usePOJLegacyOU;
     //			if (_inputType==TLSyllable) return syl;
     
     syl.setInputType(TLSyllable);			
     syl.clear();
     
     // begin POJ->TL conversion
-    unsigned int size = (unsigned int)_symvec.size();
+    unsigned int size = _symbolCount;
     unsigned int i;
     
     for (i=0; i<size; i++)
     {
-        RomanizationSymbol sym1 = _symvec[i];
-        string str1 = sym1.symbol();
-        string lowstr1 = sym1.symbolInLowerCase();
+        const RomanizationSymbol& sym1 = _symbols[i];
+        unsigned int id1 = sym1.symbolID();
         
         // ou -> oo
-        if (lowstr1=="ou")
+        if (id1==RomanizationSymbol::OUSymbol)
         {
             // detect case
-            syl.insertCharacterAtCursor(charAccordingToCaseOf('o', str1[0]), sym1.tone());
-            syl.insertCharacterAtCursor(charAccordingToCaseOf('o', str1[1]));
+            syl.insertCharacterAtCursor(charAccordingToCaseOf('o', sym1.letterAt(0)), sym1.tone());
+            syl.insertCharacterAtCursor(charAccordingToCaseOf('o', sym1.letterAt(1)));
             continue;
         }
         
         
         if (hasNextSymbol(i)) {
-            RomanizationSymbol sym2 = _symvec[i+1];
-            string str2 = sym2.symbol();
-            string lowstr2 = sym2.symbolInLowerCase();
+            const RomanizationSymbol& sym2 = _symbols[i+1];
+            unsigned int id2 = sym2.symbolID();
             
             // ch -> ts with case detection
-            if (lowstr1=="c" && lowstr2=="h") {
+            if (id1=='c' && id2=='h') {
                 // detect case
-                syl.insertCharacterAtCursor(charAccordingToCaseOf('t', str1[0]));
-                syl.insertCharacterAtCursor(charAccordingToCaseOf('s', str2[0]));
+                syl.insertCharacterAtCursor(charAccordingToCaseOf('t', sym1.letterAt(0)));
+                syl.insertCharacterAtCursor(charAccordingToCaseOf('s', sym2.letterAt(0)));
                 
                 i++;
                 continue;
             }
             
             // oe -> ue
-            if (lowstr1=="o" && lowstr2=="e") {
+            if (id1=='o' && id2=='e') {
                 // detect case
-                syl.insertCharacterAtCursor(charAccordingToCaseOf('u', str1[0]), sym1.tone());
-                syl.insertCharacterAtCursor(charAccordingToCaseOf('e', str2[0]), sym2.tone());
+                syl.insertCharacterAtCursor(charAccordingToCaseOf('u', sym1.letterAt(0)), sym1.tone());
+                syl.insertCharacterAtCursor(charAccordingToCaseOf('e', sym2.letterAt(0)), sym2.tone());
                 
                 i++;
                 continue;
             }
             
             // oa -> ua
-            if (lowstr1=="o" && lowstr2=="a") {
+            if (id1=='o' && id2=='a') {
                 // detect case
-                syl.insertCharacterAtCursor(charAccordingToCaseOf('u', str1[0]), sym1.tone());
-                syl.insertCharacterAtCursor(charAccordingToCaseOf('a', str2[0]), sym2.tone());
+                syl.insertCharacterAtCursor(charAccordingToCaseOf('u', sym1.letterAt(0)), sym1.tone());
+                syl.insertCharacterAtCursor(charAccordingToCaseOf('a', sym2.letterAt(0)), sym2.tone());
                 
                 i++;
                 continue;
             }
             
             // ek -> ik (at ending)
-            if (lowstr1=="e" && lowstr2=="k" && (i+2)==size) {
+            if (id1=='e' && id2=='k' && (i+2)==size) {
                 // detect case
-                syl.insertCharacterAtCursor(charAccordingToCaseOf('i', str1[0]), sym1.tone());
-                syl.insertCharacterAtCursor(charAccordingToCaseOf('k', str2[0]), sym2.tone());
+                syl.insertCharacterAtCursor(charAccordingToCaseOf('i', sym1.letterAt(0)), sym1.tone());
+                syl.insertCharacterAtCursor(charAccordingToCaseOf('k', sym2.letterAt(0)), sym2.tone());
                 
                 i++;
                 continue;
             }
             
             if (hasNextNextSymbol(i) && (i+3)==size) {
-                RomanizationSymbol sym3 = _symvec[i+2];
-                string str3 = sym3.symbol();
-                string lowstr3 = sym3.symbolInLowerCase();
+                const RomanizationSymbol& sym3 = _symbols[i+2];
+                unsigned int id3 = sym3.symbolID();
                 
                 // ing -> eng (must be ending)					
-                if (lowstr1=="e" && lowstr2=="n" && lowstr3=="g") {
+                if (id1=='e' && id2=='n' && id3=='g') {
                     // detect case
-                    syl.insertCharacterAtCursor(charAccordingToCaseOf('i', str1[0]), sym1.tone());
-                    syl.insertCharacterAtCursor(charAccordingToCaseOf('n', str2[0]), sym2.tone());
-                    syl.insertCharacterAtCursor(charAccordingToCaseOf('g', str3[0]), sym3.tone());
+                    syl.insertCharacterAtCursor(charAccordingToCaseOf('i', sym1.letterAt(0)), sym1.tone());
+                    syl.insertCharacterAtCursor(charAccordingToCaseOf('n', sym2.letterAt(0)), sym2.tone());
+                    syl.insertCharacterAtCursor(charAccordingToCaseOf('g', sym3.letterAt(0)), sym3.tone());
                     
                     i+=2;
                     continue;
@@ -897,8 +1011,6 @@ RomanizationSyllable RomanizationSyllable::convertToTLSyllable()
         
         syl.insertSymbolAtCursor(sym1);
     }
-    
-    return syl;
 }
 
 bool RomanizationSyllable::atBeginning() const
@@ -926,13 +1038,13 @@ bool RomanizationSyllable::hasPreviousSymbolAtCursor() const
 
 bool RomanizationSyllable::hasNextSymbol(unsigned int pos) const
 {
-    if (pos+1 >= _symvec.size()) return false;
+    if (pos+1 >= _symbolCount) return false;
     return true;
 }
 
 bool RomanizationSyllable::hasNextNextSymbol(unsigned int pos) const
 {
-    if (pos+2 >= _symvec.size()) return false;
+    if (pos+2 >= _symbolCount) return false;
     return true;
 }
 
@@ -942,46 +1054,56 @@ bool RomanizationSyllable::hasNextNextSymbol(unsigned int pos) const
 RomanizationSymbol& RomanizationSyllable::previousSymbolAtCursor()
 {
     unsigned int realcursor = _preparedTone ? _cursor-1 : _cursor;
-    return _symvec[realcursor-1];
+    return _symbols[realcursor-1];
 }
 
-// always assumes that the given input is in all lower case
-unsigned int RomanizationSyllable::findSymbol(const char *s) const
+bool RomanizationSyllable::insertSymbolAt(unsigned int i, const RomanizationSymbol &s)
 {
-    string cpps(s);
-    unsigned int size = (unsigned int)_symvec.size();
+    if (_symbolCount == MaxSymbols || i > _symbolCount) return false;
+    for (unsigned int j = _symbolCount ; j > i ; j--) _symbols[j] = _symbols[j-1];
+    _symbols[i] = s;
+    _symbolCount++;
+    return true;
+}
+
+void RomanizationSyllable::removeSymbolAt(unsigned int i)
+{
+    if (i >= _symbolCount) return;
+    _symbolCount--;
+    for (unsigned int j = i ; j < _symbolCount ; j++) _symbols[j] = _symbols[j+1];
+}
+
+unsigned int RomanizationSyllable::findSymbol(unsigned int s) const
+{
+    unsigned int size = _symbolCount;
     unsigned int i;
     for (i = 0; i < size; i++) {
-        if (_symvec[i].symbolInLowerCase() == cpps) break;
+        if (_symbols[i].symbolID() == s) break;
     }
     return i;
 }
 
-unsigned int RomanizationSyllable::findSymbolPair(const char *s1, const char *s2) const
+unsigned int RomanizationSyllable::findSymbolPair(unsigned int s1, unsigned int s2) const
 {
-    string cpps1(s1), cpps2(s2);
-    
-    unsigned int size = (unsigned int)_symvec.size();
+    unsigned int size = _symbolCount;
     if (size < 2) return size;
     
     unsigned int i;			
     for (i = 0; i < size-1; i++) {
-        if (_symvec[i].symbolInLowerCase()==cpps1 && _symvec[i+1].symbolInLowerCase()==cpps2) return i;
+        if (_symbols[i].symbolID()==s1 && _symbols[i+1].symbolID()==s2) return i;
     }
     
     return size;
 }
 
-unsigned int RomanizationSyllable::findSymbolTriple(const char *s1, const char *s2, const char *s3) const
+unsigned int RomanizationSyllable::findSymbolTriple(unsigned int s1, unsigned int s2, unsigned int s3) const
 {
-    string cpps1(s1), cpps2(s2), cpps3(s3);
-    
-    unsigned int size = (unsigned int)_symvec.size();
+    unsigned int size = _symbolCount;
     if (size < 3) return size;
     
     unsigned int i;			
     for (i = 0; i < size-2; i++) {
-        if (_symvec[i].symbolInLowerCase()==cpps1 && _symvec[i+1].symbolInLowerCase()==cpps2 && _symvec[i+2].symbolInLowerCase()==cpps3) return i;
+        if (_symbols[i].symbolID()==s1 && _symbols[i+1].symbolID()==s2 && _symbols[i+2].symbolID()==s3) return i;
     }
     
     return size;
@@ -989,8 +1111,15 @@ unsigned int RomanizationSyllable::findSymbolTriple(const char *s1, const char *
 
 const RomanizationSyllable FreeFormSyllable::convertToTLFromTLPA(unsigned int finalTone)
 {
-    string rep=internalForm();
     RomanizationSyllable syl;
+    convertToTLFromTLPA(syl, finalTone);
+    return syl;
+}
+
+void FreeFormSyllable::convertToTLFromTLPA(RomanizationSyllable& syl, unsigned int finalTone)
+{
+    string rep=internalForm();
+    syl.clear();
     syl.setInputType(TLSyllable);
     
     unsigned int size = (unsigned int)rep.length();
@@ -1009,14 +1138,20 @@ const RomanizationSyllable FreeFormSyllable::convertToTLFromTLPA(unsigned int fi
     }
     
     syl.normalize(finalTone);
-    return syl;
 }
 
 
 const RomanizationSyllable FreeFormSyllable::convertToTLFromDT(unsigned int finalTone)
 {
-    string rep=internalForm();
     RomanizationSyllable syl;
+    convertToTLFromDT(syl, finalTone);
+    return syl;
+}
+
+void FreeFormSyllable::convertToTLFromDT(RomanizationSyllable& syl, unsigned int finalTone)
+{
+    string rep=internalForm();
+    syl.clear();
     syl.setInputType(TLSyllable);
     
     unsigned int size = (unsigned int)rep.length();
@@ -1185,8 +1320,6 @@ const RomanizationSyllable FreeFormSyllable::convertToTLFromDT(unsigned int fina
     unsigned int tltone=finalTone;
     
     syl.normalize(tltone);
-    return syl;
-    
 }
 
 char FreeFormSyllable::charWithCaseAccordingTo(char c, char ref) const
@@ -1210,3 +1343,279 @@ const string FreeFormSyllable::toLowerString(const string &s) const
     return lower;
 }
 
+
+// Returns the length of the codepoint at s if it can be part of a word: a
+// Latin letter, digit, combining diacritic, or ⁿ, and the middle dot of the
+// old POJ o· inside a word. Returns 0 for anything else.
+static size_t WordCodepointLength(const char* s, size_t length, bool inWord)
+{
+    unsigned char c = (unsigned char)*s;
+    if (c < 0x80) {
+        return isalnum(c) ? 1 : 0;
+    }
+
+    if ((c & 0xe0) == 0xc0 && length >= 2 && ((unsigned char)s[1] & 0xc0) == 0x80) {
+        unsigned int codepoint = ((c & 0x1f) << 6) | ((unsigned char)s[1] & 0x3f);
+        if ((codepoint >= 0xc0 && codepoint <= 0x24f && codepoint != 0xd7 && codepoint != 0xf7) ||
+            (codepoint >= 0x300 && codepoint <= 0x36f) || (codepoint == 0xb7 && inWord)) {
+            return 2;
+        }
+        return 0;
+    }
+
+    if ((c & 0xf0) == 0xe0 && length >= 3 && ((unsigned char)s[1] & 0xc0) == 0x80 && ((unsigned char)s[2] & 0xc0) == 0x80) {
+        unsigned int codepoint = ((c & 0x0f) << 12) | (((unsigned char)s[1] & 0x3f) << 6) | ((unsigned char)s[2] & 0x3f);
+        if ((codepoint >= 0x1e00 && codepoint <= 0x1eff) || codepoint == 0x207f) {
+            return 3;
+        }
+    }
+
+    return 0;
+}
+
+// Returns true if the letters make a rhyme: vowels, where r may follow
+// e, i and o, then an optional nasal nn and a final, or a syllabic m or
+// ng. The nasal can only be followed by h.
+static bool IsRhyme(const char* letters, size_t length)
+{
+    if ((length == 1 && letters[0] == 'm') || (length == 2 && !memcmp(letters, "ng", 2))) {
+        return true;
+    }
+    if ((length == 2 && !memcmp(letters, "mh", 2)) || (length == 3 && !memcmp(letters, "ngh", 3))) {
+        return true;
+    }
+
+    size_t vowels = 0;
+    while (vowels < length && (strchr("aeiou", letters[vowels]) || (letters[vowels] == 'r' && vowels && strchr("eio", letters[vowels - 1])))) {
+        vowels++;
+    }
+
+    if (!vowels || vowels > 3) {
+        return false;
+    }
+
+    const char* final = letters + vowels;
+    size_t finalLength = length - vowels;
+    if (finalLength >= 2 && !memcmp(final, "nn", 2)) {
+        return finalLength == 2 || (finalLength == 3 && final[2] == 'h');
+    }
+
+    static const char* const finals[] = {"", "m", "n", "ng", "p", "t", "k", "h"};
+    for (size_t i = 0 ; i < sizeof(finals) / sizeof(finals[0]) ; i++) {
+        if (finalLength == strlen(finals[i]) && !memcmp(final, finals[i], finalLength)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns true if the letters, in lower case and without a tone, make a
+// syllable of the type: one of its initials, or none, and a rhyme. This
+// only checks the shape, so that words of other languages are left alone;
+// TLPA and DT are checked once converted to TL.
+static bool IsSyllable(const char* letters, size_t length, SyllableType type)
+{
+    static const char* const pojInitials[] = {"", "p", "ph", "b", "m", "t", "th", "n", "l", "k", "kh", "g", "ng", "h", "ch", "chh", "ts", "tsh", "j", "s", 0};
+    static const char* const tlInitials[] = {"", "p", "ph", "b", "m", "t", "th", "n", "l", "k", "kh", "g", "ng", "h", "ts", "tsh", "j", "s", 0};
+    static const char* const hakkaInitials[] = {"", "p", "ph", "m", "f", "v", "t", "th", "n", "l", "k", "kh", "ng", "h", "ts", "tsh", "s", "ch", "chh", "sh", "j", 0};
+
+    const char* const* initials = (type == POJSyllable) ? pojInitials : (type == HakkaPFSSyllable ? hakkaInitials : tlInitials);
+    for ( ; *initials ; initials++) {
+        size_t initialLength = strlen(*initials);
+        if (initialLength <= length && !memcmp(letters, *initials, initialLength) && IsRhyme(letters + initialLength, length - initialLength)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+RomanizationTransliterator::RomanizationTransliterator(SyllableType from, SyllableType to, bool forcePOJStyle, bool usePOJLegacyOU)
+    : _from(from)
+    , _to(to)
+    , _forcePOJStyle(forcePOJStyle)
+    , _usePOJLegacyOU(usePOJLegacyOU)
+    , _canTransliterate(canTransliterate(from, to))
+{
+}
+
+bool RomanizationTransliterator::canTransliterate(SyllableType from, SyllableType to)
+{
+    if (to == POJSyllable || to == TLSyllable) {
+        return from != HakkaPFSSyllable;
+    }
+
+    return to == from && to == HakkaPFSSyllable;
+}
+
+void RomanizationTransliterator::transliterate(const char* text, size_t length, string& output)
+{
+    if (!_canTransliterate) {
+        output.append(text, length);
+        return;
+    }
+
+    size_t i = 0;
+    while (i < length) {
+        size_t end = i;
+        size_t codepoint;
+        while (end < length && (codepoint = WordCodepointLength(text + end, length - end, end > i))) {
+            end += codepoint;
+        }
+
+        if (end == i) {
+            output += text[i++];
+            continue;
+        }
+
+        // a tone number ends a syllable; numbers are copied
+        while (i < end) {
+            size_t letters = i;
+            while (letters < end && !isdigit((unsigned char)text[letters])) {
+                letters++;
+            }
+
+            if (letters == i) {
+                while (i < end && isdigit((unsigned char)text[i])) {
+                    output += text[i++];
+                }
+                continue;
+            }
+
+            size_t syllableEnd = letters < end ? letters + 1 : letters;
+            unsigned int tone = letters < end ? text[letters] - '0' : 0;
+            if (!transliterateSyllable(text + i, letters - i, tone, output)) {
+                output.append(text + i, syllableEnd - i);
+            }
+            i = syllableEnd;
+        }
+    }
+}
+
+const string RomanizationTransliterator::transliterate(const string& text)
+{
+    string output;
+    transliterate(text.data(), text.length(), output);
+    return output;
+}
+
+// Types the syllable into the scratch source syllable the way an input
+// method would, then converts and composes it; returns false, having
+// written nothing, if the syllable is more than letters and tone marks or
+// its letters make no syllable.
+bool RomanizationTransliterator::transliterateSyllable(const char* syllable, size_t length, unsigned int tone, string& output)
+{
+    _decomposed.resize(length + 1);
+    size_t decomposedLength = VowelHelper::queryFormFromComposedForm(syllable, length, &_decomposed[0]);
+    if (decomposedLength && isdigit((unsigned char)_decomposed[decomposedLength - 1])) {
+        decomposedLength--;
+        if (!tone) {
+            tone = _decomposed[decomposedLength] - '0';
+        }
+    }
+
+    static const char nasal[] = "\xe2\x81\xbf"; // ⁿ
+    for (size_t i = 0 ; i < decomposedLength ; i++) {
+        if (isalpha((unsigned char)_decomposed[i])) {
+            continue;
+        }
+        if (i + 3 <= decomposedLength && !_decomposed.compare(i, 3, nasal)) {
+            i += 2;
+            continue;
+        }
+        return false;
+    }
+
+    // a word this long is no syllable; the limit leaves room for the
+    // conversions, which can add letters
+    if (decomposedLength > RomanizationSyllable::MaxSymbols / 2) {
+        return false;
+    }
+
+    _source.setForcePOJStyle(false);
+    _source.setUsePOJLegacyOU(false);
+
+    bool fromFreeForm = (_from == TLPASyllable || _from == DTSyllable);
+    if (fromFreeForm) {
+        _freeForm.clear();
+    }
+    else {
+        _source.clear();
+        _source.setInputType(_from);
+    }
+
+    // ⁿ is typed as nn, and POJ's o͘, which decomposes to oo, as ou; o͘ is
+    // told from a plain oo by its dot, U+0358 or the old middle dot, so
+    // that oo is typed the same with a tone mark or a tone number
+    bool spellsOU = false;
+    if (_from == POJSyllable) {
+        for (size_t i = 0 ; i + 1 < length && !spellsOU ; i++) {
+            spellsOU = (syllable[i] == '\xcd' && syllable[i + 1] == '\x98') || (syllable[i] == '\xc2' && syllable[i + 1] == '\xb7');
+        }
+    }
+
+    char last = 0;
+    for (size_t i = 0 ; i < decomposedLength ; i++) {
+        char c = _decomposed[i];
+        unsigned int count = 1;
+        if (c & 0x80) {
+            c = 'n';
+            count = 2;
+            i += 2;
+        }
+        else if (spellsOU && tolower(c) == 'o' && tolower(last) == 'o') {
+            c = isupper(c) ? 'U' : 'u';
+        }
+
+        for ( ; count ; count--) {
+            if (fromFreeForm) {
+                _freeForm.insertCharacterAt(_freeForm.numberOfCodepoints(), c);
+            }
+            else {
+                _source.insertCharacterAtCursor(c);
+            }
+        }
+        last = c;
+    }
+
+    if (_from == TLPASyllable) {
+        _freeForm.convertToTLFromTLPA(_source, tone);
+    }
+    else if (_from == DTSyllable) {
+        _freeForm.convertToTLFromDT(_source, tone);
+    }
+    else {
+        _source.normalize(tone);
+    }
+
+    SyllableType sourceType = fromFreeForm ? TLSyllable : _from;
+
+    // English words and the like are copied rather than made into syllables
+    char letters[RomanizationSyllable::MaxQueryDataLength];
+    size_t letterCount = _source.writeNormalizedQueryData(letters);
+    while (letterCount && isdigit((unsigned char)letters[letterCount - 1])) {
+        letterCount--;
+    }
+    for (size_t i = 0 ; i < letterCount ; i++) {
+        letters[i] = tolower((unsigned char)letters[i]);
+    }
+    if (!IsSyllable(letters, letterCount, sourceType)) {
+        return false;
+    }
+
+    RomanizationSyllable* converted = &_source;
+    if (_to != sourceType) {
+        converted = &_converted;
+        if (_to == POJSyllable) {
+            _source.convertToPOJSyllable(_converted);
+        }
+        else {
+            _source.convertToTLSyllable(_converted);
+        }
+    }
+
+    converted->setForcePOJStyle(_forcePOJStyle);
+    converted->setUsePOJLegacyOU(_usePOJLegacyOU);
+    converted->normalize(tone);
+    converted->appendComposedForm(output);
+    return true;
+}
@@ -27,20 +27,80 @@
 
 #include "VowelHelper.h"
 #include <algorithm>
+#include <cctype>
+#include <cstring>
 
 using namespace Formosa::TaiwaneseRomanization;
 
 static const unsigned int kPOJ9thTone = 10;
+
+// The composed vowel table has a row for every spelling the lookup accepts:
+// the single letters, then each pair below in its four casings.
+static const char kSingleVowels[] = "aeimnouzAEIMNOUZ";
+static const size_t kSingleVowelCount = sizeof(kSingleVowels) - 1;
+static const char* const kVowelPairs[] = { "nn", "ou", "oo", "ii" };
+static const size_t kVowelPairCount = sizeof(kVowelPairs) / sizeof(kVowelPairs[0]);
+static const size_t kVowelIDCount = kSingleVowelCount + kVowelPairCount * 4;
+
+// Each row has a column for tones 1 to 9 and the POJ ninth tone, each
+// split by the POJ style ou/nn, ii and legacy ou flags.
+static const size_t kComposedVowelStyleCount = 8;
+
 map<string, map<unsigned int, string> >* VowelHelper::c_vowelTable = 0;
+string* VowelHelper::c_composedVowelPool = 0;
+VowelHelper::ComposedVowelSlice* VowelHelper::c_composedVowels = 0;
 map<string, string>* VowelHelper::c_toUppercasedVowelTable = 0;
 VowelDecompositionState *VowelHelper::c_groundState = 0;
+unsigned char VowelHelper::c_decompositionByteClasses[256];
+size_t VowelHelper::c_decompositionClassCount = 0;
+unsigned short* VowelHelper::c_decompositionTransitions = 0;
+VowelHelper::CompiledDecompositionState* VowelHelper::c_decompositionStates = 0;
 
-const string VowelHelper::symbolForVowel(const string& vowel, unsigned int tone, bool usePOJStyleOUAndNN, bool usePOJStyleNinthToneMark, bool composeII, bool usePOJLegacyOU)
+const VowelHelper::ComposedVowel VowelHelper::composedVowel(const char* vowel, size_t length, unsigned int tone, bool usePOJStyleOUAndNN, bool usePOJStyleNinthToneMark, bool composeII, bool usePOJLegacyOU)
 {
-    // This singleton instantiation is not thread safe, you've been warned
-    if (!c_vowelTable) {
-        populateVowelTables();
+    return composedVowelFromID(vowelIDForVowel(vowel, length), tone, usePOJStyleOUAndNN, usePOJStyleNinthToneMark, composeII, usePOJLegacyOU);
+}
+
+unsigned char VowelHelper::vowelIDForVowel(const char* vowel, size_t length)
+{
+    size_t id = vowelID(vowel, length);
+    return id == kVowelIDCount ? (unsigned char)NoVowel : (unsigned char)id;
+}
+
+const VowelHelper::ComposedVowel VowelHelper::composedVowelFromID(unsigned char id, unsigned int tone, bool usePOJStyleOUAndNN, bool usePOJStyleNinthToneMark, bool composeII, bool usePOJLegacyOU)
+{
+    populateComposedVowelTable();
+
+    ComposedVowel composed = { "", 0, 0 };
+    if (tone > 9 || id >= kVowelIDCount) {
+        return composed;
     }
+
+    unsigned int realtone = tone;
+    if (!realtone) {
+        realtone = 1;
+    }
+    else if (realtone == 9 && usePOJStyleNinthToneMark) {
+        realtone = kPOJ9thTone;
+    }
+
+    size_t style = (usePOJStyleOUAndNN ? 1 : 0) | (composeII ? 2 : 0) | (usePOJLegacyOU ? 4 : 0);
+    const ComposedVowelSlice& slice = c_composedVowels[(id * kPOJ9thTone + realtone - 1) * kComposedVowelStyleCount + style];
+    composed.data = c_composedVowelPool->data() + slice.offset;
+    composed.length = slice.length;
+    composed.codepoints = slice.codepoints;
+    return composed;
+}
+
+const string VowelHelper::symbolForVowel(const string& vowel, unsigned int tone, bool usePOJStyleOUAndNN, bool usePOJStyleNinthToneMark, bool composeII, bool usePOJLegacyOU)
+{
+    ComposedVowel composed = composedVowel(vowel.data(), vowel.length(), tone, usePOJStyleOUAndNN, usePOJStyleNinthToneMark, composeII, usePOJLegacyOU);
+    return string(composed.data, composed.length);
+}
+
+const string VowelHelper::referenceSymbolForVowel(const string& vowel, unsigned int tone, bool usePOJStyleOUAndNN, bool usePOJStyleNinthToneMark, bool composeII, bool usePOJLegacyOU)
+{
+    populateVowelTables();
     
     // if tone is out of range, return
     if (tone > 9 || !vowel.length()) {
@@ -142,9 +202,7 @@ bool VowelHelper::isDiacriticShorthand(char shorthand)
 
 const string VowelHelper::uppercasedVowelFromVowel(const string& vowel)
 {
-    if (!c_toUppercasedVowelTable) {
-        populateVowelTables();        
-    }
+    populateVowelTables();
     
     map<string, string>::const_iterator i = c_toUppercasedVowelTable->find(vowel);
     if (i == c_toUppercasedVowelTable->end()) {
@@ -157,7 +215,73 @@ const string VowelHelper::uppercasedVowelFromVowel(const string& vowel)
     return (*i).second;
 }
 
+// Walks the compiled table the way the reference walks the states: when a
+// vowel can't go on, what it has read so far is emitted and the byte that
+// stopped it is read again from the ground state. What a vowel has read is
+// always a run of the input, so nothing needs to be accumulated.
+size_t VowelHelper::queryFormFromComposedForm(const char* composed, size_t length, char* output)
+{
+    populateDecompositionTable();
+
+    const unsigned char* input = (const unsigned char*)composed;
+    const unsigned char* classes = c_decompositionByteClasses;
+    const unsigned short* transitions = c_decompositionTransitions;
+    size_t classCount = c_decompositionClassCount;
+
+    char* out = output;
+    unsigned int finalTone = 0;
+    size_t i = 0;
+
+    while (i < length) {
+        // most bytes start no vowel and are copied as they are
+        size_t state = transitions[classes[input[i]]];
+        if (!state) {
+            *out++ = composed[i++];
+            continue;
+        }
+
+        size_t start = i++;
+        while (i < length) {
+            size_t next = transitions[state * classCount + classes[input[i]]];
+            if (!next) {
+                break;
+            }
+            state = next;
+            i++;
+        }
+
+        // a vowel is read from more bytes than its symbol has, so both
+        // bytes of the symbol can be stored; where the bytes read so far
+        // make no vowel, they are copied, and most often that's one letter
+        const CompiledDecompositionState& s = c_decompositionStates[state];
+        if (s.symbolLength) {
+            out[0] = s.symbol[0];
+            out[1] = s.symbol[1];
+            out += s.symbolLength;
+            finalTone = s.tone;
+        }
+        else {
+            while (start < i) {
+                *out++ = composed[start++];
+            }
+        }
+    }
+
+    if (finalTone > 1) {
+        *out++ = '0' + finalTone;
+    }
+
+    return out - output;
+}
+
 const string VowelHelper::queryFormFromComposedForm(const string& composed)
+{
+    string result(composed.length() + 1, 0);
+    result.resize(queryFormFromComposedForm(composed.data(), composed.length(), &result[0]));
+    return result;
+}
+
+const string VowelHelper::referenceQueryFormFromComposedForm(const string& composed)
 {
     unsigned int finalTone = 0;
     const VowelDecompositionState* groundState = &vowelDecompositionGroundState();
@@ -211,16 +335,119 @@ const string VowelHelper::queryFormFromComposedForm(const string& composed)
 }
 
 
-VowelDecompositionState& VowelHelper::vowelDecompositionGroundState()
+size_t VowelHelper::vowelID(const char* vowel, size_t length)
 {
-    if (!c_groundState) {
-        populateDecompositionStateMachine();
+    if (length == 1) {
+        const char* found = (const char*)memchr(kSingleVowels, vowel[0], kSingleVowelCount);
+        return found ? (size_t)(found - kSingleVowels) : kVowelIDCount;
     }
+
+    if (length == 2) {
+        char first = tolower((unsigned char)vowel[0]);
+        char second = tolower((unsigned char)vowel[1]);
+        for (size_t i = 0 ; i < kVowelPairCount ; i++) {
+            if (first == kVowelPairs[i][0] && second == kVowelPairs[i][1]) {
+                return kSingleVowelCount + i * 4 + (first != vowel[0] ? 2 : 0) + (second != vowel[1] ? 1 : 0);
+            }
+        }
+    }
+
+    return kVowelIDCount;
+}
+
+const string VowelHelper::vowelFromID(size_t id)
+{
+    if (id < kSingleVowelCount) {
+        return string(1, kSingleVowels[id]);
+    }
+
+    size_t pair = (id - kSingleVowelCount) / 4;
+    size_t casing = (id - kSingleVowelCount) % 4;
+    string vowel = kVowelPairs[pair];
+    if (casing & 2) {
+        vowel[0] = toupper(vowel[0]);
+    }
+    if (casing & 1) {
+        vowel[1] = toupper(vowel[1]);
+    }
+    return vowel;
+}
+
+VowelDecompositionState& VowelHelper::vowelDecompositionGroundState()
+{
+    populateDecompositionStateMachine();
     
     return *c_groundState;
 }
 
+// The tables are built by the first call to the populate functions. A local
+// static is initialized exactly once, and threads that get there meanwhile
+// wait for it, so the tables are complete before any thread reads them.
 void VowelHelper::populateVowelTables()
+{
+    static const bool built = (buildVowelTables(), true);
+    (void)built;
+}
+
+void VowelHelper::populateDecompositionStateMachine()
+{
+    static const bool built = (buildDecompositionStateMachine(), true);
+    (void)built;
+}
+
+void VowelHelper::populateDecompositionTable()
+{
+    static const bool built = (compileDecompositionTable(), true);
+    (void)built;
+}
+
+void VowelHelper::populateComposedVowelTable()
+{
+    static const bool built = (buildComposedVowelTable(), true);
+    (void)built;
+}
+
+// Every slice is composed once by the map lookup; equal slices share their
+// bytes in the pool, which keeps the whole table to a few kilobytes.
+void VowelHelper::buildComposedVowelTable()
+{
+    if (c_composedVowels) {
+        return;
+    }
+
+    c_composedVowelPool = new string;
+    c_composedVowels = new ComposedVowelSlice[kVowelIDCount * kPOJ9thTone * kComposedVowelStyleCount];
+
+    map<string, unsigned short> offsets;
+    ComposedVowelSlice* slice = c_composedVowels;
+    for (size_t id = 0 ; id < kVowelIDCount ; id++) {
+        string vowel = vowelFromID(id);
+        for (unsigned int realtone = 1 ; realtone <= kPOJ9thTone ; realtone++) {
+            for (size_t style = 0 ; style < kComposedVowelStyleCount ; style++, slice++) {
+                bool usePOJStyleNinthToneMark = (realtone == kPOJ9thTone);
+                unsigned int tone = usePOJStyleNinthToneMark ? 9 : realtone;
+                string composed = referenceSymbolForVowel(vowel, tone, style & 1, usePOJStyleNinthToneMark, style & 2, style & 4);
+
+                map<string, unsigned short>::const_iterator i = offsets.find(composed);
+                if (i == offsets.end()) {
+                    i = offsets.insert(make_pair(composed, (unsigned short)c_composedVowelPool->length())).first;
+                    *c_composedVowelPool += composed;
+                }
+
+                slice->offset = (*i).second;
+                slice->length = (unsigned char)composed.length();
+                slice->codepoints = 0;
+                for (string::const_iterator c = composed.begin() ; c != composed.end() ; ++c) {
+                    if ((*c & 0xc0) != 0x80) {
+                        slice->codepoints++;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void VowelHelper::buildVowelTables()
 {
     if (!c_vowelTable) {
         c_vowelTable = new map<string, map<unsigned int, string> >;
@@ -466,7 +693,7 @@ void VowelHelper::addStringToState(const string& s, const string &repSymbol, uns
     st->representedTone = repTone;
 }
 
-void VowelHelper::populateDecompositionStateMachine()
+void VowelHelper::buildDecompositionStateMachine()
 {
     if (c_groundState) {
         return;
@@ -531,6 +758,14 @@ void VowelHelper::populateDecompositionStateMachine()
     addStringToState("o\xcc\x8d\xcd\x98", "oo", 8, *c_groundState); // o̍͘
     addStringToState("o\xcc\x8b\xcd\x98", "oo", 9, *c_groundState); // ő͘
     addStringToState("\xc5\x8f\xcd\x98", "oo", 9, *c_groundState); // ŏ͘
+    addStringToState("o\xcd\x98\xcc\x81", "oo", 2, *c_groundState); // ó͘
+    addStringToState("o\xcd\x98\xcc\x80", "oo", 3, *c_groundState); // ò͘
+    addStringToState("o\xcd\x98\xcc\x82", "oo", 5, *c_groundState); // ô͘
+    addStringToState("o\xcd\x98\xcc\x8c", "oo", 6, *c_groundState); // ǒ͘
+    addStringToState("o\xcd\x98\xcc\x84", "oo", 7, *c_groundState); // ō͘
+    addStringToState("o\xcd\x98\xcc\x8d", "oo", 8, *c_groundState); // o̍͘
+    addStringToState("o\xcd\x98\xcc\x8b", "oo", 9, *c_groundState); // ő͘
+    addStringToState("o\xcd\x98\xcc\x86", "oo", 9, *c_groundState); // ŏ͘
     addStringToState("\xc3\xba", "u", 2, *c_groundState); // ú
     addStringToState("\xc3\xb9", "u", 3, *c_groundState); // ù
     addStringToState("\xc3\xbb", "u", 5, *c_groundState); // û
@@ -596,6 +831,14 @@ void VowelHelper::populateDecompositionStateMachine()
     addStringToState("O\xcc\x8d\xcd\x98", "Oo", 8, *c_groundState); // O̍͘
     addStringToState("O\xcc\x8b\xcd\x98", "Oo", 9, *c_groundState); // Ő͘
     addStringToState("\xc5\x8e\xcd\x98", "Oo", 9, *c_groundState); // Ŏ͘
+    addStringToState("O\xcd\x98\xcc\x81", "Oo", 2, *c_groundState); // Ó͘
+    addStringToState("O\xcd\x98\xcc\x80", "Oo", 3, *c_groundState); // Ò͘
+    addStringToState("O\xcd\x98\xcc\x82", "Oo", 5, *c_groundState); // Ô͘
+    addStringToState("O\xcd\x98\xcc\x8c", "Oo", 6, *c_groundState); // Ǒ͘
+    addStringToState("O\xcd\x98\xcc\x84", "Oo", 7, *c_groundState); // Ō͘
+    addStringToState("O\xcd\x98\xcc\x8d", "Oo", 8, *c_groundState); // O̍͘
+    addStringToState("O\xcd\x98\xcc\x8b", "Oo", 9, *c_groundState); // Ő͘
+    addStringToState("O\xcd\x98\xcc\x86", "Oo", 9, *c_groundState); // Ŏ͘
     addStringToState("\xc3\x9a", "U", 2, *c_groundState); // Ú
     addStringToState("\xc3\x99", "U", 3, *c_groundState); // Ù
     addStringToState("\xc3\x9b", "U", 5, *c_groundState); // Û
@@ -646,6 +889,62 @@ void VowelHelper::populateDecompositionStateMachine()
     addStringToState("\xe1\xb9\xb2\xcc\x86", "Ii", 9, *c_groundState); // Ṳ̆
 }
 
+// Numbers the decomposition states breadth first, then merges the bytes
+// that every state treats alike into classes, so that a row of the table
+// is only as wide as the number of classes. Every vowel's symbol is
+// shorter than the bytes it is read from, so the query form is never
+// longer than the composed form plus the tone.
+void VowelHelper::compileDecompositionTable()
+{
+    if (c_decompositionStates) {
+        return;
+    }
+
+    vector<const VowelDecompositionState*> states(1, &vowelDecompositionGroundState());
+    vector<unsigned short> byteTransitions;
+    for (size_t i = 0 ; i < states.size() ; i++) {
+        byteTransitions.resize(byteTransitions.size() + 256, 0);
+        unsigned short* row = &byteTransitions[i * 256];
+        for (map<char, VowelDecompositionState>::const_iterator t = states[i]->transitions.begin() ; t != states[i]->transitions.end() ; ++t) {
+            row[(unsigned char)(*t).first] = (unsigned short)states.size();
+            states.push_back(&((*t).second));
+        }
+    }
+
+    map<vector<unsigned short>, unsigned char> columns;
+    vector<unsigned char> classForColumn;
+    for (size_t b = 0 ; b < 256 ; b++) {
+        vector<unsigned short> column(states.size());
+        for (size_t i = 0 ; i < states.size() ; i++) {
+            column[i] = byteTransitions[i * 256 + b];
+        }
+
+        map<vector<unsigned short>, unsigned char>::const_iterator c = columns.find(column);
+        if (c == columns.end()) {
+            c = columns.insert(make_pair(column, (unsigned char)columns.size())).first;
+        }
+        c_decompositionByteClasses[b] = (*c).second;
+    }
+
+    c_decompositionClassCount = columns.size();
+    c_decompositionTransitions = new unsigned short[states.size() * c_decompositionClassCount];
+    for (size_t b = 0 ; b < 256 ; b++) {
+        for (size_t i = 0 ; i < states.size() ; i++) {
+            c_decompositionTransitions[i * c_decompositionClassCount + c_decompositionByteClasses[b]] = byteTransitions[i * 256 + b];
+        }
+    }
+
+    c_decompositionStates = new CompiledDecompositionState[states.size()];
+    for (size_t i = 0 ; i < states.size() ; i++) {
+        CompiledDecompositionState& s = c_decompositionStates[i];
+        const string& symbol = states[i]->representedSymbol;
+        s.symbolLength = (unsigned char)min(symbol.length(), sizeof(s.symbol));
+        memset(s.symbol, 0, sizeof(s.symbol));
+        memcpy(s.symbol, symbol.data(), s.symbolLength);
+        s.tone = (unsigned char)states[i]->representedTone;
+    }
+}
+
 VowelDecompositionState::VowelDecompositionState()
                         : representedTone(0)
 {
@@ -0,0 +1,49 @@
+#include "AllocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+std::atomic<size_t> g_allocationCount(0);
+
+namespace {
+
+void* Allocate(std::size_t size) noexcept {
+  g_allocationCount++;
+  return std::malloc(size ? size : 1);
+}
+
+void* AllocateOrThrow(std::size_t size) {
+  void* p = Allocate(size);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+}  // namespace
+
+void* operator new(std::size_t size) { return AllocateOrThrow(size); }
+
+void* operator new[](std::size_t size) { return AllocateOrThrow(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  return Allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return Allocate(size);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete[](void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  std::free(p);
+}
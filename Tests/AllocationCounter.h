@@ -0,0 +1,13 @@
+// Counts heap allocations, so that tests can check a code path makes none.
+// Linking AllocationCounter.cpp into a test binary replaces every form of
+// the global operator new and operator delete with a counting one.
+
+#ifndef AllocationCounter_h
+#define AllocationCounter_h
+
+#include <atomic>
+#include <cstddef>
+
+extern std::atomic<size_t> g_allocationCount;
+
+#endif
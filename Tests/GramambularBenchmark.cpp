@@ -0,0 +1,521 @@
+// Times the Gramambular walkers on synthetic grids. Not part of the test
+// suite; build the GramambularBenchmark target and run it directly.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#include "Gramambular.h"
+
+namespace {
+
+using namespace Formosa::Gramambular;
+
+// A grid as dense as BlockReadingBuilder makes it: a node for every span of
+// up to four readings, each with a few candidates.
+void FillGrid(Grid& grid, size_t width) {
+  for (size_t p = 0; p < width; p++) {
+    for (size_t q = 1; q <= 4 && p + q <= width; q++) {
+      std::stringstream key;
+      key << p << "-" << q;
+
+      std::vector<Unigram> unigrams;
+      for (int i = 0; i < 3; i++) {
+        Unigram u;
+        u.keyValue.key = key.str();
+        u.keyValue.value = key.str();
+        u.score = -(double)(rand() % 1000) / 100.0;
+        unigrams.push_back(u);
+      }
+
+      grid.insertNode(Node(key.str(), unigrams, std::vector<Bigram>()), p, q);
+    }
+  }
+}
+
+// Returns the time of one call in microseconds, averaged over a batch of
+// calls; the fastest of several batches is taken to keep out noise.
+template <typename F>
+double Time(F f) {
+  double best = 0.0;
+  for (int batch = 0; batch < 7; batch++) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    size_t iterations = 0;
+    double elapsed = 0.0;
+    do {
+      f();
+      iterations++;
+      elapsed = std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    } while (elapsed < 30000.0);
+
+    if (!batch || elapsed / iterations < best) {
+      best = elapsed / iterations;
+    }
+  }
+  return best;
+}
+
+void BenchmarkNBestWalk() {
+  printf("%-8s %12s %12s %12s %12s\n", "width", "viterbi us", "K=1 us",
+         "K=5 us", "K=20 us");
+
+  for (size_t width = 10; width <= 60; width += 10) {
+    Grid grid;
+    FillGrid(grid, width);
+    Walker walker(&grid);
+
+    double viterbi = Time([&] { walker.reverseViterbiWalk(width); });
+    double k1 = Time([&] { walker.reverseNBestWalk(width, 1); });
+    double k5 = Time([&] { walker.reverseNBestWalk(width, 5); });
+    double k20 = Time([&] { walker.reverseNBestWalk(width, 20); });
+    printf("%-8zu %12.2f %12.2f %12.2f %12.2f\n", width, viterbi, k1, k5,
+           k20);
+  }
+}
+
+// Times the grid operations BlockReadingBuilder and the walkers use: filling
+// a grid, querying every location, and editing in the middle of it.
+void BenchmarkGrid() {
+  printf("%-8s %12s %12s %12s %12s\n", "width", "fill us", "ending us",
+         "crossing us", "edit us");
+
+  for (size_t width = 10; width <= 60; width += 10) {
+    Grid grid;
+    FillGrid(grid, width);
+    Node node = *grid.nodeAtLocationSpanningLength(0, 1);
+
+    double fill = Time([&] {
+      Grid g;
+      for (size_t p = 0; p < width; p++) {
+        for (size_t q = 1; q <= 4 && p + q <= width; q++) {
+          g.insertNode(node, p, q);
+        }
+      }
+    });
+
+    size_t found = 0;
+    std::vector<NodeAnchor> anchors;
+    double ending = Time([&] {
+      for (size_t l = 1; l <= width; l++) {
+        grid.nodesEndingAt(l, anchors);
+        found += anchors.size();
+      }
+    });
+    double crossing = Time([&] {
+      for (size_t l = 1; l <= width; l++) {
+        grid.nodesCrossingOrEndingAt(l, anchors);
+        found += anchors.size();
+      }
+    });
+
+    // inserts a reading in the middle and takes it out again
+    double edit = Time([&] {
+      size_t location = width / 2;
+      grid.expandGridByOneAtLocation(location);
+      for (size_t p = location - 3; p <= location; p++) {
+        for (size_t q = location + 1 - p; q <= 4; q++) {
+          grid.insertNode(node, p, q);
+        }
+      }
+      grid.shrinkGridByOneAtLocation(location);
+    });
+
+    printf("%-8zu %12.2f %12.2f %12.2f %12.2f\n", width, fill, ending,
+           crossing, edit);
+  }
+}
+
+// Random readings made of Bopomofo symbols, as UTF-8.
+std::vector<std::string> RandomReadings(size_t count) {
+  std::vector<std::string> readings;
+  for (size_t i = 0; i < count; i++) {
+    std::string reading;
+    size_t length = 1 + rand() % 3;
+    for (size_t j = 0; j < length; j++) {
+      // U+3105 to U+3129
+      unsigned int c = 0x3105 + rand() % 0x25;
+      reading += (char)(0xe0 | (c >> 12));
+      reading += (char)(0x80 | ((c >> 6) & 0x3f));
+      reading += (char)(0x80 | (c & 0x3f));
+    }
+    readings.push_back(reading);
+  }
+  return readings;
+}
+
+// A lexicon of keys made of 1 to maxLength readings joined with "-".
+struct Lexicon {
+  std::vector<std::vector<std::string> > keyReadings;
+  std::map<std::string, uint32_t> keys;
+};
+
+Lexicon MakeLexicon(size_t keyCount, size_t maxLength) {
+  std::vector<std::string> syllables = RandomReadings(400);
+  Lexicon lexicon;
+
+  while (lexicon.keys.size() < keyCount) {
+    std::vector<std::string> readings;
+    std::string key;
+    size_t length = 1 + rand() % maxLength;
+    for (size_t i = 0; i < length; i++) {
+      readings.push_back(syllables[rand() % syllables.size()]);
+      key += (i ? "-" : "") + readings.back();
+    }
+    if (lexicon.keys.insert(std::make_pair(key, 0)).second) {
+      lexicon.keyReadings.push_back(readings);
+    }
+  }
+  return lexicon;
+}
+
+// Readings of randomly picked keys, one after another, so that spans of the
+// text often match keys.
+std::vector<std::string> MakeText(const Lexicon& lexicon, size_t keyCount) {
+  std::vector<std::string> text;
+  for (size_t i = 0; i < keyCount; i++) {
+    const std::vector<std::string>& readings =
+        lexicon.keyReadings[rand() % lexicon.keyReadings.size()];
+    text.insert(text.end(), readings.begin(), readings.end());
+  }
+  return text;
+}
+
+// Compares key lookups in a lexicon of joined readings: exact lookups of
+// known keys, and finding which of the spans of 1 to 4 readings starting
+// at a position are keys, the question BlockReadingBuilder asks.
+void BenchmarkKeyIndex() {
+  Lexicon lexicon = MakeLexicon(100000, 4);
+  std::map<std::string, uint32_t>& ordered = lexicon.keys;
+
+  std::vector<std::string> sortedKeys;
+  for (std::map<std::string, uint32_t>::iterator i = ordered.begin();
+       i != ordered.end(); ++i) {
+    (*i).second = (uint32_t)sortedKeys.size();
+    sortedKeys.push_back((*i).first);
+  }
+  std::unordered_map<std::string, uint32_t> unordered(ordered.begin(),
+                                                      ordered.end());
+  DoubleArrayTrie trie;
+  trie.build(sortedKeys);
+
+  std::vector<std::string> probes;
+  for (size_t i = 0; i < 100000; i++) {
+    probes.push_back(sortedKeys[rand() % sortedKeys.size()]);
+  }
+
+  std::vector<std::string> text = MakeText(lexicon, 10000);
+
+  uint64_t sum = 0;
+  double mapExact = Time([&] {
+    for (size_t i = 0; i < probes.size(); i++) {
+      sum += ordered.find(probes[i])->second;
+    }
+  });
+  double unorderedExact = Time([&] {
+    for (size_t i = 0; i < probes.size(); i++) {
+      sum += unordered.find(probes[i])->second;
+    }
+  });
+  double trieExact = Time([&] {
+    uint32_t value = 0;
+    for (size_t i = 0; i < probes.size(); i++) {
+      trie.find(probes[i], value);
+      sum += value;
+    }
+  });
+
+  std::string key;
+  double mapSpans = Time([&] {
+    for (size_t p = 0; p + 4 <= text.size(); p++) {
+      key.clear();
+      for (size_t q = 1; q <= 4; q++) {
+        key += (q > 1 ? "-" : "") + text[p + q - 1];
+        sum += ordered.count(key);
+      }
+    }
+  });
+  double unorderedSpans = Time([&] {
+    for (size_t p = 0; p + 4 <= text.size(); p++) {
+      key.clear();
+      for (size_t q = 1; q <= 4; q++) {
+        key += (q > 1 ? "-" : "") + text[p + q - 1];
+        sum += unordered.count(key);
+      }
+    }
+  });
+  double trieSpans = Time([&] {
+    uint32_t value = 0;
+    for (size_t p = 0; p + 4 <= text.size(); p++) {
+      size_t node = DoubleArrayTrie::RootNode();
+      for (size_t q = 1; q <= 4; q++) {
+        if ((q > 1 && !trie.advance(node, "-", 1)) ||
+            !trie.advance(node, text[p + q - 1].data(),
+                          text[p + q - 1].size())) {
+          break;
+        }
+        sum += trie.valueAtNode(node, value);
+      }
+    }
+  });
+
+  double spanStarts = text.size() - 3;
+  printf("%-16s %16s %20s\n", "100k keys", "exact Mlookups/s",
+         "span starts M/s");
+  printf("%-16s %16.2f %20.2f\n", "std::map", probes.size() / mapExact,
+         spanStarts / mapSpans);
+  printf("%-16s %16.2f %20.2f\n", "unordered_map",
+         probes.size() / unorderedExact, spanStarts / unorderedSpans);
+  printf("%-16s %16.2f %20.2f\n", "DoubleArrayTrie",
+         probes.size() / trieExact, spanStarts / trieSpans);
+  if (!sum) {
+    printf("\n");
+  }
+}
+
+// Counts the unigram lookups a builder makes, and can hide the model's key
+// traversal so that the builder looks up every span instead.
+class CountingMappedLM : public MappedLanguageModel {
+ public:
+  CountingMappedLM(bool walksKeys) : walksKeys(walksKeys), lookups(0) {}
+
+  virtual const UnigramView unigramViewForKey(
+      const std::string& key, std::vector<Unigram>& ioBuffer) {
+    lookups++;
+    return MappedLanguageModel::unigramViewForKey(key, ioBuffer);
+  }
+
+  virtual bool keyPrefixRoot(size_t& outState) const {
+    return walksKeys && MappedLanguageModel::keyPrefixRoot(outState);
+  }
+
+  bool walksKeys;
+  size_t lookups;
+};
+
+// Types a text one reading at a time, with and without walking the model's
+// keys, and reports unigram lookups and time per keystroke.
+void BenchmarkBuild() {
+  Lexicon lexicon = MakeLexicon(100000, 4);
+  std::stringstream source;
+  for (std::map<std::string, uint32_t>::const_iterator i =
+           lexicon.keys.begin();
+       i != lexicon.keys.end(); ++i) {
+    source << (*i).first << " " << (*i).first << " -1.0\n";
+  }
+
+  const char* path = "GramambularBenchmark.lm";
+  std::ofstream binary(path, std::ios::binary);
+  std::string error;
+  MappedLanguageModel::Compile(source, binary, error);
+  binary.close();
+
+  std::vector<std::string> text = MakeText(lexicon, 500);
+
+  printf("%-16s %18s %14s\n", "typing", "lookups/keystroke", "us/keystroke");
+  for (int walksKeys = 0; walksKeys < 2; walksKeys++) {
+    CountingMappedLM lm(walksKeys != 0);
+    lm.open(path);
+
+    size_t lookups = 0;
+    double time = Time([&] {
+      BlockReadingBuilder builder(&lm);
+      builder.setJoinSeparator("-");
+      lm.lookups = 0;
+      for (size_t i = 0; i < text.size(); i++) {
+        builder.insertReadingAtCursor(text[i]);
+      }
+      lookups = lm.lookups;
+    });
+
+    printf("%-16s %18.2f %14.2f\n", walksKeys ? "walking keys" : "joining spans",
+           (double)lookups / text.size(), time / text.size());
+  }
+
+  std::remove(path);
+}
+
+// Types text from a lexicon with keys of up to eight readings, with the
+// builder's span capped at 4, 6 and 8, then walks the resulting grid.
+void BenchmarkSpanLength() {
+  Lexicon lexicon = MakeLexicon(100000, 8);
+  std::stringstream source;
+  for (std::map<std::string, uint32_t>::const_iterator i =
+           lexicon.keys.begin();
+       i != lexicon.keys.end(); ++i) {
+    source << (*i).first << " " << (*i).first << " -1.0\n";
+  }
+
+  const char* path = "GramambularBenchmark.lm";
+  std::ofstream binary(path, std::ios::binary);
+  std::string error;
+  MappedLanguageModel::Compile(source, binary, error);
+  binary.close();
+
+  std::vector<std::string> text = MakeText(lexicon, 200);
+
+  printf("%-6s %22s %22s %10s\n", "span", "joining us/keystroke",
+         "walking us/keystroke", "walk us");
+  size_t spans[] = {4, 6, 8};
+  for (size_t s = 0; s < sizeof(spans) / sizeof(spans[0]); s++) {
+    double typing[2];
+    double walk = 0.0;
+    for (int walksKeys = 0; walksKeys < 2; walksKeys++) {
+      CountingMappedLM lm(walksKeys != 0);
+      lm.open(path);
+
+      typing[walksKeys] = Time([&] {
+        BlockReadingBuilder builder(&lm);
+        builder.setMaximumBuildSpanLength(spans[s]);
+        builder.setJoinSeparator("-");
+        for (size_t i = 0; i < text.size(); i++) {
+          builder.insertReadingAtCursor(text[i]);
+        }
+      }) / text.size();
+
+      if (walksKeys) {
+        BlockReadingBuilder builder(&lm);
+        builder.setMaximumBuildSpanLength(spans[s]);
+        builder.setJoinSeparator("-");
+        for (size_t i = 0; i < text.size(); i++) {
+          builder.insertReadingAtCursor(text[i]);
+        }
+        Walker walker(&builder.grid());
+        walk = Time([&] { walker.reverseViterbiWalk(builder.grid().width()); });
+      }
+    }
+
+    printf("%-6zu %22.2f %22.2f %10.1f\n", spans[s], typing[0], typing[1],
+           walk);
+  }
+
+  std::remove(path);
+}
+
+// Converts sentences by typing them reading by reading and walking at the
+// end, and with a BatchConverter that builds each grid in one pass.
+void BenchmarkBatch() {
+  Lexicon lexicon = MakeLexicon(100000, 4);
+  std::stringstream source;
+  for (std::map<std::string, uint32_t>::const_iterator i =
+           lexicon.keys.begin();
+       i != lexicon.keys.end(); ++i) {
+    source << (*i).first << " " << (*i).first << " -1.0\n";
+  }
+
+  const char* path = "GramambularBenchmark.lm";
+  std::ofstream binary(path, std::ios::binary);
+  std::string error;
+  MappedLanguageModel::Compile(source, binary, error);
+  binary.close();
+
+  MappedLanguageModel lm;
+  lm.open(path);
+
+  std::vector<std::vector<std::string> > sentences;
+  size_t readingCount = 0;
+  for (int i = 0; i < 100; i++) {
+    sentences.push_back(MakeText(lexicon, 8));
+    readingCount += sentences.back().size();
+  }
+
+  size_t length = 0;
+  double typing = Time([&] {
+    for (size_t i = 0; i < sentences.size(); i++) {
+      BlockReadingBuilder builder(&lm);
+      builder.setJoinSeparator("-");
+      for (size_t j = 0; j < sentences[i].size(); j++) {
+        builder.insertReadingAtCursor(sentences[i][j]);
+      }
+      Walker walker(&builder.grid());
+      length += walker.reverseViterbiWalk(builder.grid().width()).size();
+    }
+  });
+
+  BatchConverter converter(&lm, "-");
+  double batch = Time([&] {
+    for (size_t i = 0; i < sentences.size(); i++) {
+      length += converter.convert(sentences[i]).size();
+    }
+  });
+
+  printf("%-16s %14s\n", "converting", "us/reading");
+  printf("%-16s %14.2f\n", "typing", typing / readingCount);
+  printf("%-16s %14.2f\n", "batch", batch / readingCount);
+
+  std::remove(path);
+}
+
+// Converts the same sentences with a ParallelConverter on 1 to N threads,
+// N being at least the number of cores, all sharing one model.
+void BenchmarkParallel() {
+  Lexicon lexicon = MakeLexicon(100000, 4);
+  std::stringstream source;
+  for (std::map<std::string, uint32_t>::const_iterator i =
+           lexicon.keys.begin();
+       i != lexicon.keys.end(); ++i) {
+    source << (*i).first << " " << (*i).first << " -1.0\n";
+  }
+
+  const char* path = "GramambularBenchmark.lm";
+  std::ofstream binary(path, std::ios::binary);
+  std::string error;
+  MappedLanguageModel::Compile(source, binary, error);
+  binary.close();
+
+  MappedLanguageModel lm;
+  lm.open(path);
+
+  std::vector<std::vector<std::string> > sentences;
+  size_t readingCount = 0;
+  for (int i = 0; i < 1000; i++) {
+    sentences.push_back(MakeText(lexicon, 1 + rand() % 12));
+    readingCount += sentences.back().size();
+  }
+
+  size_t cores = std::thread::hardware_concurrency();
+  size_t maxThreads = cores > 4 ? cores : 4;
+
+  printf("%-8s %14s %10s   (%zu cores)\n", "threads", "us/reading", "speedup",
+         cores);
+  double single = 0.0;
+  for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+    ParallelConverter converter(&lm, "-", threads);
+    std::vector<std::string> results;
+    double time = Time([&] { converter.convert(sentences, results); });
+    if (threads == 1) {
+      single = time;
+    }
+    printf("%-8zu %14.3f %10.2f\n", threads, time / readingCount,
+           single / time);
+  }
+
+  std::remove(path);
+}
+
+}  // namespace
+
+int main() {
+  srand(20100302);
+  BenchmarkNBestWalk();
+  printf("\n");
+  BenchmarkGrid();
+  printf("\n");
+  BenchmarkKeyIndex();
+  printf("\n");
+  BenchmarkBuild();
+  printf("\n");
+  BenchmarkSpanLength();
+  printf("\n");
+  BenchmarkBatch();
+  printf("\n");
+  BenchmarkParallel();
+  return 0;
+}
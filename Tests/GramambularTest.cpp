@@ -0,0 +1,1475 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <set>
+#include <sstream>
+
+#include "AllocationCounter.h"
+#include "Gramambular.h"
+
+namespace {
+
+using namespace Formosa::Gramambular;
+
+class TestLM : public LanguageModel {
+ public:
+  TestLM() : unigramLookups(0), bigramLookups(0) {}
+
+  void add(const std::string& key, const std::string& value, double score) {
+    Unigram u;
+    u.keyValue.key = key;
+    u.keyValue.value = value;
+    u.score = score;
+    m_db[key].push_back(u);
+  }
+
+  void addBigram(const std::string& preceedingKey,
+                 const std::string& preceedingValue, const std::string& key,
+                 const std::string& value, double score) {
+    Bigram b;
+    b.preceedingKeyValue.key = preceedingKey;
+    b.preceedingKeyValue.value = preceedingValue;
+    b.keyValue.key = key;
+    b.keyValue.value = value;
+    b.score = score;
+    m_bigrams[std::make_pair(preceedingKey, key)].push_back(b);
+  }
+
+  virtual const std::vector<Bigram> bigramsForKeys(
+      const std::string& preceedingKey, const std::string& key) {
+    bigramLookups++;
+    std::map<std::pair<std::string, std::string>,
+             std::vector<Bigram> >::const_iterator f =
+        m_bigrams.find(std::make_pair(preceedingKey, key));
+    return f == m_bigrams.end() ? std::vector<Bigram>() : (*f).second;
+  }
+
+  virtual const std::vector<Unigram> unigramsForKeys(const std::string& key) {
+    unigramLookups++;
+    std::map<std::string, std::vector<Unigram> >::const_iterator f =
+        m_db.find(key);
+    return f == m_db.end() ? std::vector<Unigram>() : (*f).second;
+  }
+
+  virtual bool hasUnigramsForKey(const std::string& key) {
+    unigramLookups++;
+    return m_db.find(key) != m_db.end();
+  }
+
+  size_t unigramLookups;
+  size_t bigramLookups;
+
+ protected:
+  std::map<std::string, std::vector<Unigram> > m_db;
+  std::map<std::pair<std::string, std::string>, std::vector<Bigram> >
+      m_bigrams;
+};
+
+// A model that hands out views straight into its own storage.
+class ViewLM : public TestLM {
+ public:
+  virtual const UnigramView unigramViewForKey(const std::string& key,
+                                              std::vector<Unigram>&) {
+    std::map<std::string, std::vector<Unigram> >::const_iterator f =
+        m_db.find(key);
+    return f == m_db.end() ? UnigramView() : UnigramView((*f).second);
+  }
+};
+
+struct SampleUnigram {
+  const char* key;
+  const char* value;
+  double score;
+};
+
+// A small lexicon after the TestBed sample: single characters as readings,
+// with joined keys for the words.
+const SampleUnigram kSampleUnigrams[] = {
+    {"高", "高", -7.17},
+    {"科", "科", -7.08},
+    {"技", "技", -8.45},
+    {"公", "公", -8.02},
+    {"司", "司", -99.0},
+    {"的", "的", -3.51},
+    {"年", "年", -6.09},
+    {"終", "終", -9.09},
+    {"獎", "獎", -8.85},
+    {"金", "金", -7.65},
+    {"科技", "科技", -6.74},
+    {"高科技", "高科技", -9.84},
+    {"公司", "公司", -6.30},
+    {"年終", "年終", -11.37},
+    {"年終獎金", "年終獎金", -11.43},
+    {"獎金", "獎金", -10.34},
+};
+
+void FillSampleLM(TestLM& lm) {
+  for (size_t i = 0; i < sizeof(kSampleUnigrams) / sizeof(kSampleUnigrams[0]);
+       i++) {
+    lm.add(kSampleUnigrams[i].key, kSampleUnigrams[i].value,
+           kSampleUnigrams[i].score);
+  }
+}
+
+// Scores are multiples of 1/8 so that sums are exact and walkers that add
+// scores in a different order still agree on ties.
+Node RandomNode(size_t location, size_t length) {
+  std::stringstream key;
+  key << location << "-" << length;
+
+  std::vector<Unigram> unigrams;
+  size_t count = 1 + rand() % 3;
+  for (size_t i = 0; i < count; i++) {
+    Unigram u;
+    u.keyValue.key = key.str();
+    std::stringstream value;
+    value << key.str() << "/" << i;
+    u.keyValue.value = value.str();
+    u.score = -(double)(rand() % 64) / 8.0;
+    unigrams.push_back(u);
+  }
+
+  return Node(key.str(), unigrams, std::vector<Bigram>());
+}
+
+// Fills a grid of the given width with random nodes spanning up to four
+// locations. With a fill rate below 100, some locations end up with nothing
+// ending there, which exercises the walkers' dead-end handling.
+void FillRandomGrid(Grid& grid, size_t width, int fillRate) {
+  for (size_t p = 0; p < width; p++) {
+    for (size_t q = 1; q <= 4 && p + q <= width; q++) {
+      if (rand() % 100 < fillRate) {
+        grid.insertNode(RandomNode(p, q), p, q);
+      }
+    }
+  }
+}
+
+void ExpectSamePath(const std::vector<NodeAnchor>& a,
+                    const std::vector<NodeAnchor>& b) {
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t i = 0; i < a.size(); i++) {
+    EXPECT_EQ(a[i].node, b[i].node);
+    EXPECT_EQ(a[i].location, b[i].location);
+    EXPECT_EQ(a[i].spanningLength, b[i].spanningLength);
+    EXPECT_EQ(a[i].accumulatedScore, b[i].accumulatedScore);
+  }
+}
+
+TEST(GramambularTest, ViterbiWalkMatchesReverseWalkOnRandomGrids) {
+  srand(20100302);
+  for (int round = 0; round < 200; round++) {
+    Grid grid;
+    size_t width = 1 + rand() % 12;
+    FillRandomGrid(grid, width, round % 2 ? 100 : 40);
+
+    Walker walker(&grid);
+    for (size_t location = 0; location <= width + 1; location++) {
+      ExpectSamePath(walker.reverseWalk(location, 1.5),
+                     walker.reverseViterbiWalk(location, 1.5));
+    }
+  }
+}
+
+TEST(GramambularTest, IncrementalWalkMatchesViterbiWalkAfterEdits) {
+  srand(20100303);
+  for (int round = 0; round < 50; round++) {
+    Grid grid;
+    FillRandomGrid(grid, 1 + rand() % 8, 80);
+
+    IncrementalWalker incrementalWalker(&grid);
+    Walker walker(&grid);
+
+    for (int edit = 0; edit < 40; edit++) {
+      size_t location = rand() % (grid.width() + 1);
+      if (rand() % 3 || !grid.width()) {
+        grid.expandGridByOneAtLocation(location);
+        for (size_t p = location > 3 ? location - 3 : 0; p <= location; p++) {
+          for (size_t q = 1; q <= 4 && p + q <= grid.width(); q++) {
+            if (p + q > location && rand() % 100 < 80) {
+              grid.insertNode(RandomNode(p, q), p, q);
+            }
+          }
+        }
+      } else {
+        grid.shrinkGridByOneAtLocation(location % grid.width());
+      }
+
+      ExpectSamePath(walker.reverseViterbiWalk(grid.width(), 0.5),
+                     incrementalWalker.reverseWalk(0.5));
+    }
+  }
+}
+
+TEST(GramambularTest, IncrementalWalkRecomputesOnlyTheTailWhenAppending) {
+  TestLM lm;
+  FillSampleLM(lm);
+  BlockReadingBuilder builder(&lm);
+  IncrementalWalker incrementalWalker(&builder.grid());
+  Walker walker(&builder.grid());
+  EXPECT_TRUE(incrementalWalker.reverseWalk().empty());
+
+  const char* readings[] = {"高", "科", "技", "公", "司",
+                            "的", "年", "終", "獎", "金"};
+  for (size_t i = 0; i < sizeof(readings) / sizeof(readings[0]); i++) {
+    builder.insertReadingAtCursor(readings[i]);
+
+    // appending only adds nodes ending at the new end of the grid
+    EXPECT_EQ(builder.grid().width(),
+              builder.grid().earliestChangedLocation());
+    ExpectSamePath(walker.reverseViterbiWalk(builder.grid().width()),
+                   incrementalWalker.reverseWalk());
+  }
+
+  std::vector<NodeAnchor> walked = incrementalWalker.reverseWalk();
+  std::string composed;
+  for (std::vector<NodeAnchor>::reverse_iterator i = walked.rbegin();
+       i != walked.rend(); ++i) {
+    composed += (*i).node->currentKeyValue().value + " ";
+  }
+  EXPECT_EQ("高科技 公司 的 年終獎金 ", composed);
+
+  // a fixed candidate changes a node's score behind the grid's back
+  Node* node = builder.grid().nodeAtLocationSpanningLength(4, 1);
+  ASSERT_TRUE(node != 0);
+  node->selectCandidateAtIndex(0);
+  incrementalWalker.invalidateFromLocation(4);
+  ExpectSamePath(walker.reverseViterbiWalk(builder.grid().width()),
+                 incrementalWalker.reverseWalk());
+}
+
+// Collects the scores of every path reverseWalk() could have walked, that is,
+// every path that goes back from the location until it reaches either the
+// start of the grid or a location with nothing ending there.
+void CollectPathScores(Grid& grid, size_t location, double score,
+                       std::vector<double>& scores) {
+  std::vector<NodeAnchor> nodes = grid.nodesEndingAt(location);
+  for (size_t i = 0; i < nodes.size(); i++) {
+    double total = score + nodes[i].node->score();
+    size_t start = nodes[i].location;
+    if (!start || grid.nodesEndingAt(start).empty()) {
+      scores.push_back(total);
+    } else {
+      CollectPathScores(grid, start, total, scores);
+    }
+  }
+}
+
+TEST(GramambularTest, NBestWalkMatchesExhaustiveSearch) {
+  srand(20100304);
+  for (int round = 0; round < 200; round++) {
+    Grid grid;
+    size_t width = 1 + rand() % 8;
+    FillRandomGrid(grid, width, round % 2 ? 100 : 50);
+
+    Walker walker(&grid);
+    for (size_t location = 1; location <= width; location++) {
+      std::vector<double> scores;
+      CollectPathScores(grid, location, 0.25, scores);
+      std::sort(scores.begin(), scores.end(), std::greater<double>());
+
+      size_t count = 1 + rand() % 30;
+      std::vector<std::vector<NodeAnchor> > paths =
+          walker.reverseNBestWalk(location, count, 0.25);
+      ASSERT_EQ(std::min(count, scores.size()), paths.size());
+
+      for (size_t i = 0; i < paths.size(); i++) {
+        const std::vector<NodeAnchor>& path = paths[i];
+        ASSERT_FALSE(path.empty());
+        EXPECT_EQ(scores[i], path.back().accumulatedScore);
+
+        // each path is contiguous and accumulates like reverseWalk()
+        size_t end = location;
+        double accumulated = 0.25;
+        for (size_t j = 0; j < path.size(); j++) {
+          EXPECT_EQ(end, path[j].location + path[j].spanningLength);
+          accumulated += path[j].node->score();
+          EXPECT_EQ(accumulated, path[j].accumulatedScore);
+          end = path[j].location;
+        }
+      }
+
+      // the best path is the one the plain walk finds
+      if (!paths.empty()) {
+        EXPECT_EQ(walker.reverseViterbiWalk(location, 0.25).back()
+                      .accumulatedScore,
+                  paths[0].back().accumulatedScore);
+      }
+    }
+  }
+}
+
+TEST(GramambularTest, NBestWalkOnSample) {
+  TestLM lm;
+  FillSampleLM(lm);
+  BlockReadingBuilder builder(&lm);
+  const char* readings[] = {"高", "科", "技", "公", "司",
+                            "的", "年", "終", "獎", "金"};
+  for (size_t i = 0; i < sizeof(readings) / sizeof(readings[0]); i++) {
+    builder.insertReadingAtCursor(readings[i]);
+  }
+
+  Walker walker(&builder.grid());
+  std::vector<std::vector<NodeAnchor> > paths =
+      walker.reverseNBestWalk(builder.grid().width(), 3);
+  ASSERT_EQ(3U, paths.size());
+  ExpectSamePath(walker.reverseViterbiWalk(builder.grid().width()), paths[0]);
+  EXPECT_GE(paths[0].back().accumulatedScore, paths[1].back().accumulatedScore);
+  EXPECT_GE(paths[1].back().accumulatedScore, paths[2].back().accumulatedScore);
+
+  EXPECT_TRUE(walker.reverseNBestWalk(builder.grid().width(), 0).empty());
+  EXPECT_TRUE(walker.reverseNBestWalk(0, 5).empty());
+}
+
+// Adds a bigram with a random score for about a third of the candidate
+// pairs of adjacent nodes.
+void FillRandomBigrams(Grid& grid, TestLM& lm) {
+  for (size_t l = 1; l < grid.width(); l++) {
+    std::vector<NodeAnchor> before = grid.nodesEndingAt(l);
+    std::vector<NodeAnchor> after;
+    for (size_t q = 1; l + q <= grid.width(); q++) {
+      Node* node = grid.nodeAtLocationSpanningLength(l, q);
+      if (node) {
+        NodeAnchor anchor;
+        anchor.node = node;
+        after.push_back(anchor);
+      }
+    }
+
+    for (size_t i = 0; i < before.size(); i++) {
+      for (size_t j = 0; j < after.size(); j++) {
+        const Node* a = before[i].node;
+        const Node* b = after[j].node;
+        for (size_t x = 0; x < a->candidates().size(); x++) {
+          for (size_t y = 0; y < b->candidates().size(); y++) {
+            if (rand() % 3 == 0) {
+              lm.addBigram(a->key(), a->candidates()[x].value, b->key(),
+                           b->candidates()[y].value,
+                           -(double)(rand() % 64) / 8.0);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Finds the best score over every path reverseWalk() could have walked and
+// every choice of candidates along it. The path is built from its end, so
+// each node is scored once the candidate before it is known.
+double BestBigramScore(Grid& grid, TestLM& lm, size_t location,
+                       const Node* following, const std::string& value,
+                       double score) {
+  std::vector<NodeAnchor> nodes = grid.nodesEndingAt(location);
+  double best = 0.0;
+  bool found = false;
+
+  for (size_t i = 0; i < nodes.size(); i++) {
+    const Node* node = nodes[i].node;
+    for (size_t c = 0; c < node->unigrams().size(); c++) {
+      const KeyValuePair& keyValue = node->unigrams()[c].keyValue;
+      double total = score;
+
+      if (following) {
+        double transition = following->unigrams()[0].score;
+        for (size_t u = 0; u < following->unigrams().size(); u++) {
+          if (following->unigrams()[u].keyValue.value == value) {
+            transition = following->unigrams()[u].score;
+          }
+        }
+
+        std::vector<Bigram> bigrams =
+            lm.bigramsForKeys(node->key(), following->key());
+        for (size_t b = 0; b < bigrams.size(); b++) {
+          if (bigrams[b].preceedingKeyValue.value == keyValue.value &&
+              bigrams[b].keyValue.value == value) {
+            transition = bigrams[b].score;
+          }
+        }
+        total += transition;
+      }
+
+      size_t start = nodes[i].location;
+      if (!start || grid.nodesEndingAt(start).empty()) {
+        total += node->unigrams()[c].score;
+      } else {
+        total = BestBigramScore(grid, lm, start, node, keyValue.value, total);
+      }
+
+      if (!found || total > best) {
+        best = total;
+        found = true;
+      }
+    }
+  }
+
+  return best;
+}
+
+TEST(GramambularTest, BigramWalkWithoutBigramsMatchesViterbiWalk) {
+  srand(20100305);
+  TestLM lm;
+  for (int round = 0; round < 200; round++) {
+    Grid grid;
+    size_t width = 1 + rand() % 12;
+    FillRandomGrid(grid, width, round % 2 ? 100 : 40);
+
+    Walker walker(&grid);
+    BigramWalker bigramWalker(&grid, &lm);
+    for (size_t location = 0; location <= width + 1; location++) {
+      std::vector<KeyValuePair> keyValues;
+      std::vector<NodeAnchor> path =
+          bigramWalker.reverseWalk(location, keyValues, 1.5);
+      ExpectSamePath(walker.reverseViterbiWalk(location, 1.5), path);
+
+      ASSERT_EQ(path.size(), keyValues.size());
+      for (size_t i = 0; i < path.size(); i++) {
+        EXPECT_EQ(path[i].node->currentKeyValue(), keyValues[i]);
+      }
+    }
+  }
+}
+
+TEST(GramambularTest, BigramWalkMatchesExhaustiveSearch) {
+  srand(20100306);
+  for (int round = 0; round < 200; round++) {
+    Grid grid;
+    size_t width = 1 + rand() % 6;
+    FillRandomGrid(grid, width, round % 2 ? 100 : 50);
+    TestLM lm;
+    FillRandomBigrams(grid, lm);
+
+    BigramWalker bigramWalker(&grid, &lm);
+    for (size_t location = 1; location <= width; location++) {
+      std::vector<KeyValuePair> keyValues;
+      std::vector<NodeAnchor> path =
+          bigramWalker.reverseWalk(location, keyValues);
+      if (grid.nodesEndingAt(location).empty()) {
+        EXPECT_TRUE(path.empty());
+        continue;
+      }
+
+      ASSERT_FALSE(path.empty());
+      EXPECT_EQ(BestBigramScore(grid, lm, location, 0, "", 0.0),
+                path.back().accumulatedScore);
+
+      // the picked candidates belong to their nodes
+      ASSERT_EQ(path.size(), keyValues.size());
+      for (size_t i = 0; i < path.size(); i++) {
+        EXPECT_EQ(path[i].node->key(), keyValues[i].key);
+      }
+    }
+  }
+}
+
+TEST(GramambularTest, BigramWalkPicksCandidatesByContext) {
+  TestLM lm;
+  FillSampleLM(lm);
+  lm.add("的", "得", -3.0);
+  BlockReadingBuilder builder(&lm);
+  const char* readings[] = {"高", "科", "技", "公", "司",
+                            "的", "年", "終", "獎", "金"};
+  for (size_t i = 0; i < sizeof(readings) / sizeof(readings[0]); i++) {
+    builder.insertReadingAtCursor(readings[i]);
+  }
+
+  BigramWalker bigramWalker(&builder.grid(), &lm);
+  std::vector<KeyValuePair> keyValues;
+  bigramWalker.reverseWalk(builder.grid().width(), keyValues);
+  ASSERT_EQ(4U, keyValues.size());
+  EXPECT_EQ("得", keyValues[1].value);
+
+  lm.addBigram("公司", "公司", "的", "的", -1.0);
+  bigramWalker.clearBigramCache();
+  std::vector<NodeAnchor> path =
+      bigramWalker.reverseWalk(builder.grid().width(), keyValues);
+  ASSERT_EQ(4U, keyValues.size());
+  EXPECT_EQ("的", keyValues[1].value);
+  EXPECT_EQ(-11.43 + -1.0 + -6.30 + -9.84, path.back().accumulatedScore);
+
+  // bigrams were looked up once per pair of adjacent keys
+  lm.bigramLookups = 0;
+  bigramWalker.reverseWalk(builder.grid().width(), keyValues);
+  EXPECT_EQ(0U, lm.bigramLookups);
+
+  // and walking the same grid again reuses the walker's buffers, so that
+  // only the path it returns is allocated
+  size_t allocationCount = g_allocationCount;
+  path = bigramWalker.reverseWalk(builder.grid().width(), keyValues);
+  EXPECT_GE(allocationCount + path.size(), g_allocationCount);
+
+  builder.insertReadingAtCursor("的");
+  bigramWalker.reverseWalk(builder.grid().width(), keyValues);
+  EXPECT_EQ(builder.grid().nodesEndingAt(builder.grid().width() - 1).size(),
+            lm.bigramLookups);
+}
+
+TEST(GramambularTest, BigramWalkFollowsGridEdits) {
+  srand(20100312);
+  for (int round = 0; round < 50; round++) {
+    // bigrams between the keys RandomNode() gives adjacent nodes
+    TestLM lm;
+    for (size_t p = 0; p < 16; p++) {
+      for (size_t q = 1; q <= 4; q++) {
+        for (size_t r = 1; r <= 4; r++) {
+          std::stringstream key;
+          std::stringstream nextKey;
+          key << p << "-" << q;
+          nextKey << p + q << "-" << r;
+          for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+              if (rand() % 3 == 0) {
+                std::stringstream value;
+                std::stringstream nextValue;
+                value << key.str() << "/" << i;
+                nextValue << nextKey.str() << "/" << j;
+                lm.addBigram(key.str(), value.str(), nextKey.str(),
+                             nextValue.str(), -(double)(rand() % 64) / 8.0);
+              }
+            }
+          }
+        }
+      }
+    }
+
+    Grid grid;
+    FillRandomGrid(grid, 1 + rand() % 8, 80);
+    BigramWalker bigramWalker(&grid, &lm);
+
+    for (int edit = 0; edit < 40; edit++) {
+      size_t location = rand() % (grid.width() + 1);
+      int op = rand() % 4;
+      if (op < 2 || !grid.width()) {
+        grid.expandGridByOneAtLocation(location);
+        for (size_t p = location > 3 ? location - 3 : 0; p <= location; p++) {
+          for (size_t q = 1; q <= 4 && p + q <= grid.width(); q++) {
+            if (p + q > location && rand() % 100 < 80) {
+              grid.insertNode(RandomNode(p, q), p, q);
+            }
+          }
+        }
+      } else if (op == 2) {
+        grid.shrinkGridByOneAtLocation(location % grid.width());
+      } else {
+        // fixing a candidate doesn't change the grid
+        std::vector<NodeAnchor> nodes = grid.nodesEndingAt(location);
+        if (!nodes.empty()) {
+          const NodeAnchor& anchor = nodes[rand() % nodes.size()];
+          Node* node = grid.nodeAtLocationSpanningLength(anchor.location,
+                                                         anchor.spanningLength);
+          node->selectCandidateAtIndex(rand() % node->unigrams().size());
+        }
+      }
+
+      // a walker that has followed every edit agrees with a new one; the
+      // new one walks second, as walking resets the grid's change marker
+      for (size_t l = grid.width(); l + 2 > grid.width() && l; l--) {
+        std::vector<KeyValuePair> keyValues;
+        std::vector<NodeAnchor> path =
+            bigramWalker.reverseWalk(l, keyValues, 0.5);
+        BigramWalker freshWalker(&grid, &lm);
+        std::vector<KeyValuePair> freshKeyValues;
+        ExpectSamePath(freshWalker.reverseWalk(l, freshKeyValues, 0.5), path);
+        EXPECT_EQ(freshKeyValues, keyValues);
+      }
+    }
+  }
+}
+
+// Applies random edits to a grid and to a plain map of (location, length)
+// to node keys, and checks that the grid agrees with the map after each.
+TEST(GramambularTest, GridEditsMatchReferenceModel) {
+  srand(20100307);
+  for (int round = 0; round < 50; round++) {
+    Grid grid;
+    size_t width = 0;
+    std::map<std::pair<size_t, size_t>, std::string> reference;
+    std::map<std::pair<size_t, size_t>, Node*> pointers;
+
+    for (int edit = 0; edit < 60; edit++) {
+      int op = rand() % 4;
+      size_t location = rand() % (width + 1);
+      std::map<std::pair<size_t, size_t>, std::string> next;
+      std::map<std::pair<size_t, size_t>, std::string>::iterator i;
+
+      if (op == 0 || !width) {
+        // nodes may span up to 6 here, so that the grid has to widen
+        size_t length = 1 + rand() % 6;
+        Node node = RandomNode(location, length);
+        grid.insertNode(node, location, length);
+        reference[std::make_pair(location, length)] = node.key();
+        if (location + 1 > width) {
+          width = location + 1;
+        }
+      } else if (op == 1) {
+        grid.expandGridByOneAtLocation(location);
+        for (i = reference.begin(); i != reference.end(); ++i) {
+          size_t p = (*i).first.first, q = (*i).first.second;
+          if (p >= location) {
+            next[std::make_pair(p + 1, q)] = (*i).second;
+          } else if (location == width || p + q <= location) {
+            next[(*i).first] = (*i).second;
+          }
+        }
+        reference.swap(next);
+        width++;
+      } else if (op == 2 && location < width) {
+        grid.shrinkGridByOneAtLocation(location);
+        for (i = reference.begin(); i != reference.end(); ++i) {
+          size_t p = (*i).first.first, q = (*i).first.second;
+          if (p > location) {
+            next[std::make_pair(p - 1, q)] = (*i).second;
+          } else if (p < location && p + q <= location) {
+            next[(*i).first] = (*i).second;
+          }
+        }
+        reference.swap(next);
+        width--;
+      } else {
+        grid.clear();
+        reference.clear();
+        pointers.clear();
+        width = 0;
+      }
+
+      ASSERT_EQ(width, grid.width());
+      for (size_t p = 0; p <= width; p++) {
+        for (size_t q = 0; q <= 7; q++) {
+          i = reference.find(std::make_pair(p, q));
+          Node* node = grid.nodeAtLocationSpanningLength(p, q);
+          if (i == reference.end()) {
+            EXPECT_TRUE(node == 0);
+          } else {
+            ASSERT_TRUE(node != 0);
+            EXPECT_EQ((*i).second, node->key());
+            EXPECT_TRUE(grid.hasNodeAtLocationSpanningLengthMatchingKey(
+                p, q, (*i).second));
+          }
+        }
+      }
+
+      for (size_t l = 0; l <= width; l++) {
+        std::vector<NodeAnchor> ending = grid.nodesEndingAt(l);
+        size_t count = 0;
+        for (i = reference.begin(); i != reference.end(); ++i) {
+          if ((*i).first.first + (*i).first.second == l) {
+            ASSERT_LT(count, ending.size());
+            EXPECT_EQ((*i).first.first, ending[count].location);
+            EXPECT_EQ((*i).first.second, ending[count].spanningLength);
+            EXPECT_EQ((*i).second, ending[count].node->key());
+            count++;
+          }
+        }
+        EXPECT_EQ(count, ending.size());
+      }
+    }
+  }
+}
+
+TEST(GramambularTest, GridNodesKeepTheirAddresses) {
+  Grid grid;
+  grid.insertNode(RandomNode(0, 1), 0, 1);
+  Node* node = grid.nodeAtLocationSpanningLength(0, 1);
+
+  // growing and widening the grid moves slots, not nodes
+  for (size_t p = 1; p < 100; p++) {
+    grid.insertNode(RandomNode(p, 1), p, 1);
+  }
+  grid.insertNode(RandomNode(3, 8), 3, 8);
+  grid.expandGridByOneAtLocation(0);
+  EXPECT_EQ(node, grid.nodeAtLocationSpanningLength(1, 1));
+  EXPECT_EQ("0-1", node->key());
+
+  // replacing a node reuses its place
+  grid.insertNode(RandomNode(7, 1), 1, 1);
+  EXPECT_EQ(node, grid.nodeAtLocationSpanningLength(1, 1));
+  EXPECT_EQ("7-1", node->key());
+}
+
+TEST(GramambularTest, GridQueriesIntoBuffersDoNotAllocate) {
+  srand(20100308);
+  Grid grid;
+  FillRandomGrid(grid, 40, 80);
+
+  std::vector<NodeAnchor> ending;
+  std::vector<NodeAnchor> crossing;
+  for (size_t l = 0; l <= grid.width() + 1; l++) {
+    grid.nodesEndingAt(l, ending);
+    grid.nodesCrossingOrEndingAt(l, crossing);
+  }
+
+  size_t allocationCount = g_allocationCount;
+  size_t found = 0;
+  for (size_t l = 0; l <= grid.width() + 1; l++) {
+    grid.nodesEndingAt(l, ending);
+    found += ending.size();
+    grid.nodesCrossingOrEndingAt(l, crossing);
+    found += crossing.size();
+  }
+  EXPECT_EQ(allocationCount, g_allocationCount);
+  EXPECT_LT(0U, found);
+
+  // the buffers get the same anchors as the vectors returned by value
+  for (size_t l = 0; l <= grid.width() + 1; l++) {
+    grid.nodesEndingAt(l, ending);
+    ExpectSamePath(grid.nodesEndingAt(l), ending);
+    grid.nodesCrossingOrEndingAt(l, crossing);
+    ExpectSamePath(grid.nodesCrossingOrEndingAt(l), crossing);
+  }
+}
+
+TEST(GramambularTest, PrimingPicksCandidateByBigram) {
+  std::vector<Unigram> unigrams(3);
+  const char* values[] = {"a", "b", "c"};
+  for (size_t i = 0; i < unigrams.size(); i++) {
+    unigrams[i].keyValue.key = "k";
+    unigrams[i].keyValue.value = values[i];
+    unigrams[i].score = -1.0 - i;
+  }
+
+  std::vector<Bigram> bigrams(2);
+  bigrams[0].preceedingKeyValue.key = "p";
+  bigrams[0].preceedingKeyValue.value = "x";
+  bigrams[0].keyValue = unigrams[2].keyValue;
+  bigrams[0].score = -0.5;
+  bigrams[1].preceedingKeyValue = bigrams[0].preceedingKeyValue;
+  bigrams[1].keyValue.key = "k";
+  bigrams[1].keyValue.value = "not a candidate";
+  bigrams[1].score = 0.0;
+
+  Node node("k", unigrams, bigrams);
+  EXPECT_EQ("a", node.currentKeyValue().value);
+  EXPECT_EQ(-1.0, node.score());
+
+  std::vector<KeyValuePair> preceeding(1, bigrams[0].preceedingKeyValue);
+  node.primeNodeWithPreceedingKeyValues(preceeding);
+  EXPECT_EQ("c", node.currentKeyValue().value);
+  EXPECT_EQ(-0.5, node.score());
+
+  // moved into the grid, the node keeps its pick
+  Grid grid;
+  grid.insertNode(std::move(node), 0, 1);
+  EXPECT_EQ("c",
+            grid.nodeAtLocationSpanningLength(0, 1)->currentKeyValue().value);
+}
+
+// Writes the sample lexicon in the text format, with a few extra
+// candidates and bigrams, compiles it and opens the result.
+void OpenSampleMappedLM(MappedLanguageModel& lm, TestLM& reference) {
+  std::stringstream source;
+  source << "# comments and blank lines are skipped\n\n";
+  for (size_t i = 0; i < sizeof(kSampleUnigrams) / sizeof(kSampleUnigrams[0]);
+       i++) {
+    source << kSampleUnigrams[i].key << " " << kSampleUnigrams[i].value << " "
+           << kSampleUnigrams[i].score << "\n";
+    reference.add(kSampleUnigrams[i].key, kSampleUnigrams[i].value,
+                  kSampleUnigrams[i].score);
+  }
+  source << "的 得 -3.75\n";
+  reference.add("的", "得", -3.75);
+  source << "公司 公司 的 得 -1.5\n";
+  reference.addBigram("公司", "公司", "的", "得", -1.5);
+  source << "公司 公司 的 的 -2.5\n";
+  reference.addBigram("公司", "公司", "的", "的", -2.5);
+  source << "我們 我們 的 的 -0.5\n";
+  reference.addBigram("我們", "我們", "的", "的", -0.5);
+
+  std::string path = testing::TempDir() + "GramambularTest.lm";
+  std::ofstream binary(path.c_str(), std::ios::binary);
+  std::string error;
+  ASSERT_TRUE(MappedLanguageModel::Compile(source, binary, error)) << error;
+  binary.close();
+  ASSERT_TRUE(lm.open(path));
+}
+
+void ExpectSameUnigrams(const std::vector<Unigram>& a,
+                        const std::vector<Unigram>& b) {
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t i = 0; i < a.size(); i++) {
+    EXPECT_EQ(a[i].keyValue, b[i].keyValue);
+    EXPECT_EQ(a[i].score, b[i].score);
+  }
+}
+
+TEST(GramambularTest, MappedLMMatchesTextLM) {
+  MappedLanguageModel lm;
+  TestLM reference;
+  OpenSampleMappedLM(lm, reference);
+  ASSERT_TRUE(lm.isOpen());
+
+  for (size_t i = 0; i < sizeof(kSampleUnigrams) / sizeof(kSampleUnigrams[0]);
+       i++) {
+    std::string key = kSampleUnigrams[i].key;
+    EXPECT_TRUE(lm.hasUnigramsForKey(key));
+    ExpectSameUnigrams(reference.unigramsForKeys(key),
+                       lm.unigramsForKeys(key));
+  }
+
+  // keys that are only in bigrams, or nowhere, have no unigrams
+  EXPECT_FALSE(lm.hasUnigramsForKey("我們"));
+  EXPECT_TRUE(lm.unigramsForKeys("我們").empty());
+  EXPECT_FALSE(lm.hasUnigramsForKey("沒有"));
+  EXPECT_FALSE(lm.hasUnigramsForKey(""));
+  EXPECT_TRUE(lm.unigramsForKeys("沒有").empty());
+
+  std::vector<Bigram> bigrams = lm.bigramsForKeys("公司", "的");
+  std::vector<Bigram> expected = reference.bigramsForKeys("公司", "的");
+  ASSERT_EQ(expected.size(), bigrams.size());
+  for (size_t i = 0; i < bigrams.size(); i++) {
+    EXPECT_EQ(expected[i].preceedingKeyValue, bigrams[i].preceedingKeyValue);
+    EXPECT_EQ(expected[i].keyValue, bigrams[i].keyValue);
+    EXPECT_EQ(expected[i].score, bigrams[i].score);
+  }
+  EXPECT_EQ(1U, lm.bigramsForKeys("我們", "的").size());
+  EXPECT_TRUE(lm.bigramsForKeys("的", "公司").empty());
+  EXPECT_TRUE(lm.bigramsForKeys("沒有", "的").empty());
+
+  // the same sentence comes out of both models
+  BlockReadingBuilder builder(&lm);
+  BlockReadingBuilder referenceBuilder(&reference);
+  const char* readings[] = {"高", "科", "技", "公", "司",
+                            "的", "年", "終", "獎", "金"};
+  for (size_t i = 0; i < sizeof(readings) / sizeof(readings[0]); i++) {
+    builder.insertReadingAtCursor(readings[i]);
+    referenceBuilder.insertReadingAtCursor(readings[i]);
+  }
+
+  std::vector<KeyValuePair> keyValues;
+  std::vector<KeyValuePair> referenceKeyValues;
+  BigramWalker walker(&builder.grid(), &lm);
+  BigramWalker referenceWalker(&referenceBuilder.grid(), &reference);
+  walker.reverseWalk(builder.grid().width(), keyValues);
+  referenceWalker.reverseWalk(referenceBuilder.grid().width(),
+                              referenceKeyValues);
+  EXPECT_EQ(referenceKeyValues, keyValues);
+  ASSERT_EQ(4U, keyValues.size());
+  EXPECT_EQ("得", keyValues[1].value);
+
+  lm.close();
+  EXPECT_FALSE(lm.isOpen());
+  EXPECT_FALSE(lm.hasUnigramsForKey("高"));
+}
+
+TEST(GramambularTest, MappedLMRejectsBadInput) {
+  std::string error;
+  std::stringstream badSource("高 高 -1.0\n高 高\n");
+  std::stringstream binary;
+  EXPECT_FALSE(MappedLanguageModel::Compile(badSource, binary, error));
+  EXPECT_EQ(0U, error.find("line 2:"));
+
+  std::stringstream badScore("高 高 high\n");
+  EXPECT_FALSE(MappedLanguageModel::Compile(badScore, binary, error));
+
+  MappedLanguageModel lm;
+  EXPECT_FALSE(lm.open(testing::TempDir() + "does-not-exist.lm"));
+
+  // a text file is not a compiled model, and neither is a truncated one
+  std::string path = testing::TempDir() + "GramambularTest-bad.lm";
+  std::ofstream text(path.c_str(), std::ios::binary);
+  text << "高 高 -1.0\n";
+  text.close();
+  EXPECT_FALSE(lm.open(path));
+  EXPECT_FALSE(lm.isOpen());
+
+  std::stringstream source("高 高 -1.0\n科 科 -2.0\n");
+  std::stringstream compiled;
+  ASSERT_TRUE(MappedLanguageModel::Compile(source, compiled, error));
+  std::string data = compiled.str();
+  std::ofstream truncated(path.c_str(), std::ios::binary);
+  truncated.write(data.data(), data.size() - 8);
+  truncated.close();
+  EXPECT_FALSE(lm.open(path));
+
+  std::ofstream whole(path.c_str(), std::ios::binary);
+  whole.write(data.data(), data.size());
+  whole.close();
+  EXPECT_TRUE(lm.open(path));
+  EXPECT_TRUE(lm.hasUnigramsForKey("科"));
+}
+
+TEST(GramambularTest, DefaultViewsReadIntoTheCallersBuffer) {
+  TestLM lm;
+  FillSampleLM(lm);
+  lm.addBigram("公司", "公司", "的", "的", -1.0);
+
+  std::vector<Unigram> unigrams;
+  UnigramView view = lm.unigramViewForKey("科技", unigrams);
+  ASSERT_EQ(1U, view.size());
+  EXPECT_EQ(&unigrams[0], view.begin());
+  EXPECT_EQ("科技", view[0].keyValue.value);
+  EXPECT_EQ(-6.74, view[0].score);
+  EXPECT_EQ(1U, lm.unigramLookups);
+
+  // nothing is kept, so every request asks the model
+  lm.unigramViewForKey("科技", unigrams);
+  EXPECT_EQ(2U, lm.unigramLookups);
+
+  EXPECT_TRUE(lm.unigramViewForKey("沒有", unigrams).empty());
+  EXPECT_TRUE(unigrams.empty());
+
+  std::vector<Bigram> bigrams;
+  BigramView bigramView = lm.bigramViewForKeys("公司", "的", bigrams);
+  ASSERT_EQ(1U, bigramView.size());
+  EXPECT_EQ(&bigrams[0], bigramView.begin());
+  EXPECT_EQ(-1.0, bigramView[0].score);
+  EXPECT_TRUE(lm.bigramViewForKeys("的", "公司", bigrams).empty());
+  EXPECT_EQ(2U, lm.bigramLookups);
+}
+
+TEST(GramambularTest, BuilderQueriesUnigramsThroughViews) {
+  TestLM lm;
+  ViewLM viewLM;
+  FillSampleLM(lm);
+  FillSampleLM(viewLM);
+
+  BlockReadingBuilder builder(&lm);
+  BlockReadingBuilder viewBuilder(&viewLM);
+  const char* readings[] = {"高", "科", "技", "公", "司",
+                            "的", "年", "終", "獎", "金"};
+  for (size_t i = 0; i < sizeof(readings) / sizeof(readings[0]); i++) {
+    builder.insertReadingAtCursor(readings[i]);
+    viewBuilder.insertReadingAtCursor(readings[i]);
+  }
+
+  // the default views ask the model, a model with its own views is not
+  EXPECT_LT(0U, lm.unigramLookups);
+  EXPECT_EQ(0U, viewLM.unigramLookups);
+
+  Walker walker(&builder.grid());
+  Walker viewWalker(&viewBuilder.grid());
+  std::vector<NodeAnchor> path =
+      walker.reverseViterbiWalk(builder.grid().width());
+  std::vector<NodeAnchor> viewPath =
+      viewWalker.reverseViterbiWalk(viewBuilder.grid().width());
+  ASSERT_EQ(path.size(), viewPath.size());
+  for (size_t i = 0; i < path.size(); i++) {
+    EXPECT_EQ(path[i].node->currentKeyValue(),
+              viewPath[i].node->currentKeyValue());
+    EXPECT_EQ(path[i].accumulatedScore, viewPath[i].accumulatedScore);
+  }
+
+  // nothing is cached in the model, so retyping asks it again, but only
+  // for the spans the grid lost
+  size_t unigramLookups = lm.unigramLookups;
+  builder.deleteReadingBeforeCursor();
+  builder.insertReadingAtCursor("金");
+  EXPECT_LT(unigramLookups, lm.unigramLookups);
+  EXPECT_GT(unigramLookups, lm.unigramLookups - unigramLookups);
+}
+
+// Random keys over a small alphabet, so that they share many prefixes;
+// includes the empty key and bytes at both ends of the range.
+std::vector<std::string> RandomSortedKeys(size_t count) {
+  const char alphabet[] = {'a', 'b', 'c', '\0', '\x7f', '\x80', '\xff'};
+  std::set<std::string> keys;
+  keys.insert("");
+  while (keys.size() < count) {
+    std::string key;
+    size_t length = 1 + rand() % 6;
+    for (size_t i = 0; i < length; i++) {
+      key += alphabet[rand() % sizeof(alphabet)];
+    }
+    keys.insert(key);
+  }
+  return std::vector<std::string>(keys.begin(), keys.end());
+}
+
+TEST(GramambularTest, DoubleArrayTrieFindsExactlyItsKeys) {
+  srand(20100309);
+  std::vector<std::string> keys = RandomSortedKeys(2000);
+  std::set<std::string> keySet(keys.begin(), keys.end());
+
+  DoubleArrayTrie trie;
+  ASSERT_TRUE(trie.build(keys));
+  for (size_t i = 0; i < keys.size(); i++) {
+    uint32_t value = 0;
+    ASSERT_TRUE(trie.find(keys[i], value)) << i;
+    EXPECT_EQ(i, value);
+  }
+
+  for (int i = 0; i < 5000; i++) {
+    std::string probe = RandomSortedKeys(2).back() + "c";
+    uint32_t value = 0;
+    EXPECT_EQ(keySet.count(probe) != 0, trie.find(probe, value));
+  }
+
+  // a trie attached to the same units answers the same
+  DoubleArrayTrie attached;
+  attached.attach(trie.units(), trie.unitCount());
+  for (size_t i = 0; i < keys.size(); i++) {
+    uint32_t value = 0;
+    ASSERT_TRUE(attached.find(keys[i], value));
+    EXPECT_EQ(i, value);
+  }
+
+  // unsorted or duplicate keys are refused
+  std::vector<std::string> unsorted;
+  unsorted.push_back("b");
+  unsorted.push_back("a");
+  EXPECT_FALSE(trie.build(unsorted));
+  unsorted[1] = "b";
+  EXPECT_FALSE(trie.build(unsorted));
+
+  DoubleArrayTrie empty;
+  ASSERT_TRUE(empty.build(std::vector<std::string>()));
+  uint32_t value = 0;
+  EXPECT_FALSE(empty.find("", value));
+  EXPECT_FALSE(empty.find("a", value));
+}
+
+TEST(GramambularTest, DoubleArrayTriePrefixSearchMatchesScan) {
+  srand(20100310);
+  std::vector<std::string> keys = RandomSortedKeys(500);
+  DoubleArrayTrie trie;
+  ASSERT_TRUE(trie.build(keys));
+
+  for (int i = 0; i < 2000; i++) {
+    std::string text = RandomSortedKeys(2).back() + RandomSortedKeys(2).back();
+
+    std::vector<std::pair<size_t, uint32_t> > expected;
+    for (size_t k = 0; k < keys.size(); k++) {
+      if (text.compare(0, keys[k].size(), keys[k]) == 0) {
+        expected.push_back(std::make_pair(keys[k].size(), (uint32_t)k));
+      }
+    }
+    std::sort(expected.begin(), expected.end());
+
+    std::vector<std::pair<size_t, uint32_t> > matches;
+    EXPECT_EQ(expected.size(),
+              trie.commonPrefixSearch(text.data(), text.size(), matches));
+    EXPECT_EQ(expected, matches);
+
+    // advancing piece by piece ends at the same nodes
+    size_t node = DoubleArrayTrie::RootNode();
+    size_t consumed = 0;
+    for (size_t m = 0; m < matches.size(); m++) {
+      ASSERT_TRUE(trie.advance(node, text.data() + consumed,
+                               matches[m].first - consumed));
+      consumed = matches[m].first;
+      uint32_t value = 0;
+      ASSERT_TRUE(trie.valueAtNode(node, value));
+      EXPECT_EQ(matches[m].second, value);
+    }
+  }
+}
+
+// Counts the unigram lookups a builder makes, and can hide the model's key
+// traversal so that the builder falls back to looking up every span.
+class CountingMappedLM : public MappedLanguageModel {
+ public:
+  CountingMappedLM(bool walksKeys)
+      : walksKeys(walksKeys), lookups(0), misses(0) {}
+
+  virtual const UnigramView unigramViewForKey(
+      const std::string& key, std::vector<Unigram>& ioBuffer) {
+    UnigramView view = MappedLanguageModel::unigramViewForKey(key, ioBuffer);
+    lookups++;
+    misses += view.empty();
+    return view;
+  }
+
+  virtual bool keyPrefixRoot(size_t& outState) const {
+    return walksKeys && MappedLanguageModel::keyPrefixRoot(outState);
+  }
+
+  bool walksKeys;
+  size_t lookups;
+  size_t misses;
+};
+
+std::string GridKeys(Grid& grid) {
+  std::string keys;
+  for (size_t l = 0; l <= grid.width(); l++) {
+    std::vector<NodeAnchor> nodes = grid.nodesEndingAt(l);
+    for (size_t i = 0; i < nodes.size(); i++) {
+      std::stringstream key;
+      key << nodes[i].location << "+" << nodes[i].spanningLength << ":"
+          << nodes[i].node->key() << " ";
+      keys += key.str();
+    }
+  }
+  return keys;
+}
+
+TEST(GramambularTest, BuilderWalksKeysOnlyWhereTheyExist) {
+  srand(20100311);
+  const char* syllables[] = {"ba", "pa", "ma", "fa", "da", "ta"};
+  const size_t syllableCount = sizeof(syllables) / sizeof(syllables[0]);
+
+  for (int round = 0; round < 20; round++) {
+    // keys of 1 to 5 readings, so that the build span adapts past its default
+    std::stringstream source;
+    for (int i = 0; i < 60; i++) {
+      std::string key;
+      size_t length = 1 + rand() % 5;
+      for (size_t j = 0; j < length; j++) {
+        key += (j ? "-" : "") + std::string(syllables[rand() % syllableCount]);
+      }
+      source << key << " " << key << " " << -(rand() % 64) / 8.0 << "\n";
+    }
+    // a key that only precedes a bigram is not a key to build nodes for
+    source << "ta-ta-ta x fa x -1.0\n";
+
+    std::string path = testing::TempDir() + "GramambularTest-walk.lm";
+    std::ofstream binary(path.c_str(), std::ios::binary);
+    std::string error;
+    ASSERT_TRUE(MappedLanguageModel::Compile(source, binary, error)) << error;
+    binary.close();
+
+    CountingMappedLM walkingLM(true);
+    CountingMappedLM probingLM(false);
+    ASSERT_TRUE(walkingLM.open(path));
+    ASSERT_TRUE(probingLM.open(path));
+
+    BlockReadingBuilder walking(&walkingLM);
+    BlockReadingBuilder probing(&probingLM);
+    walking.setJoinSeparator("-");
+    probing.setJoinSeparator("-");
+
+    for (int edit = 0; edit < 40; edit++) {
+      size_t cursor = rand() % (walking.length() + 1);
+      walking.setCursorIndex(cursor);
+      probing.setCursorIndex(cursor);
+
+      if (rand() % 4 || !walking.length()) {
+        const char* reading = syllables[rand() % syllableCount];
+        walking.insertReadingAtCursor(reading);
+        probing.insertReadingAtCursor(reading);
+      } else {
+        walking.deleteReadingBeforeCursor();
+        probing.deleteReadingBeforeCursor();
+      }
+
+      ASSERT_EQ(GridKeys(probing.grid()), GridKeys(walking.grid()));
+    }
+
+    // walking the keys looks up real keys only
+    EXPECT_EQ(0U, walkingLM.misses);
+    EXPECT_LT(0U, probingLM.misses);
+    EXPECT_EQ(probingLM.lookups - probingLM.misses, walkingLM.lookups);
+  }
+}
+
+TEST(GramambularTest, BuildSpanLengthFollowsLongestKey) {
+  std::stringstream source;
+  source << "a a -1.0\nb b -1.0\nc c -1.0\n";
+  source << "a-b a -2.0\n";
+  source << "a-b-c-a-b-c a -3.0\n";
+  // bigram-only keys don't count, and "abcabcabc" has no "-" in it
+  source << "a-b-c-a-b-c-a x b x -1.0\n";
+  source << "abcabcabc x -1.0\n";
+
+  std::string path = testing::TempDir() + "GramambularTest-span.lm";
+  std::ofstream binary(path.c_str(), std::ios::binary);
+  std::string error;
+  ASSERT_TRUE(MappedLanguageModel::Compile(source, binary, error)) << error;
+  binary.close();
+
+  MappedLanguageModel lm;
+  ASSERT_TRUE(lm.open(path));
+  EXPECT_EQ(6U, lm.maximumKeySpanLength("-"));
+  EXPECT_EQ(4U, lm.maximumKeySpanLength("b"));
+  EXPECT_EQ(1U, lm.maximumKeySpanLength("+"));
+  EXPECT_EQ(0U, lm.maximumKeySpanLength(""));
+
+  // the default for a model that can't tell
+  TestLM testLM;
+  EXPECT_EQ(4U, BlockReadingBuilder(&testLM).maximumBuildSpanLength());
+
+  BlockReadingBuilder builder(&lm);
+  EXPECT_EQ(4U, builder.maximumBuildSpanLength());
+  builder.setJoinSeparator("-");
+  EXPECT_EQ(6U, builder.maximumBuildSpanLength());
+
+  const char* readings[] = {"a", "b", "c", "a", "b", "c"};
+  for (size_t i = 0; i < 6; i++) {
+    builder.insertReadingAtCursor(readings[i]);
+  }
+  ASSERT_TRUE(builder.grid().nodeAtLocationSpanningLength(0, 6) != 0);
+
+  Walker walker(&builder.grid());
+  std::vector<NodeAnchor> path6 = walker.reverseViterbiWalk(6);
+  ASSERT_EQ(1U, path6.size());
+  EXPECT_EQ(6U, path6[0].spanningLength);
+
+  // an explicit length caps the spans the builder looks up
+  BlockReadingBuilder capped(&lm);
+  capped.setMaximumBuildSpanLength(2);
+  capped.setJoinSeparator("-");
+  EXPECT_EQ(2U, capped.maximumBuildSpanLength());
+  for (size_t i = 0; i < 6; i++) {
+    capped.insertReadingAtCursor(readings[i]);
+  }
+  EXPECT_TRUE(capped.grid().nodeAtLocationSpanningLength(0, 6) == 0);
+  EXPECT_TRUE(capped.grid().nodeAtLocationSpanningLength(3, 2) != 0);
+
+  capped.setMaximumBuildSpanLength(0);
+  EXPECT_EQ(6U, capped.maximumBuildSpanLength());
+}
+
+TEST(GramambularTest, SetReadingsBuildsTheSameGridAsTyping) {
+  srand(20100315);
+  const char* syllables[] = {"ba", "pa", "ma", "fa", "da", "ta"};
+  const size_t syllableCount = sizeof(syllables) / sizeof(syllables[0]);
+
+  std::stringstream source;
+  for (int i = 0; i < 80; i++) {
+    std::string key;
+    size_t length = 1 + rand() % 6;
+    for (size_t j = 0; j < length; j++) {
+      key += (j ? "-" : "") + std::string(syllables[rand() % syllableCount]);
+    }
+    source << key << " " << key << " " << -(rand() % 64) / 8.0 << "\n";
+  }
+
+  std::string path = testing::TempDir() + "GramambularTest-batch.lm";
+  std::ofstream binary(path.c_str(), std::ios::binary);
+  std::string error;
+  ASSERT_TRUE(MappedLanguageModel::Compile(source, binary, error)) << error;
+  binary.close();
+
+  MappedLanguageModel lm;
+  ASSERT_TRUE(lm.open(path));
+
+  BlockReadingBuilder batch(&lm);
+  batch.setJoinSeparator("-");
+
+  for (int round = 0; round < 20; round++) {
+    std::vector<std::string> readings;
+    size_t count = rand() % 30;
+    for (size_t i = 0; i < count; i++) {
+      readings.push_back(syllables[rand() % syllableCount]);
+    }
+
+    BlockReadingBuilder typing(&lm);
+    typing.setJoinSeparator("-");
+    for (size_t i = 0; i < readings.size(); i++) {
+      typing.insertReadingAtCursor(readings[i]);
+    }
+
+    // the batch builder is reused, so leftovers of the last round would show
+    batch.setReadings(readings);
+    EXPECT_EQ(readings.size(), batch.length());
+    EXPECT_EQ(readings.size(), batch.cursorIndex());
+    ASSERT_EQ(GridKeys(typing.grid()), GridKeys(batch.grid()));
+  }
+}
+
+TEST(GramambularTest, BatchConverterConvertsWholeSentences) {
+  TestLM lm;
+  FillSampleLM(lm);
+
+  const char* sentence[] = {"高", "科", "技", "公", "司",
+                            "的", "年", "終", "獎", "金"};
+  std::vector<std::string> readings(sentence, sentence + 10);
+
+  BlockReadingBuilder typing(&lm);
+  for (size_t i = 0; i < readings.size(); i++) {
+    typing.insertReadingAtCursor(readings[i]);
+  }
+  Walker walker(&typing.grid());
+  std::vector<NodeAnchor> path = walker.reverseViterbiWalk(readings.size());
+  std::string typed;
+  for (size_t i = path.size(); i > 0; i--) {
+    typed += path[i - 1].node->currentKeyValue().value;
+  }
+
+  BatchConverter converter(&lm, "");
+  EXPECT_EQ(typed, converter.convert(readings));
+  EXPECT_EQ("高科技公司的年終獎金", typed);
+
+  std::vector<std::string> keys;
+  converter.convert(readings, [&keys](const KeyValuePair& keyValue) {
+    keys.push_back(keyValue.key);
+  });
+  ASSERT_EQ(path.size(), keys.size());
+  EXPECT_EQ("高科技", keys.front());
+  EXPECT_EQ("年終獎金", keys.back());
+
+  // readings the model doesn't know are passed through, and don't cut the
+  // path short
+  const char* unknown[] = {"公", "司", "?", "年", "終", "!"};
+  EXPECT_EQ("公司?年終!",
+            converter.convert(std::vector<std::string>(unknown, unknown + 6)));
+
+  EXPECT_EQ("", converter.convert(std::vector<std::string>()));
+}
+
+TEST(GramambularTest, ParallelConverterMatchesBatchConverter) {
+  srand(20100318);
+  const char* syllables[] = {"ba", "pa", "ma", "fa", "da", "ta", "na"};
+  const size_t syllableCount = sizeof(syllables) / sizeof(syllables[0]);
+
+  std::stringstream source;
+  for (int i = 0; i < 200; i++) {
+    std::string key;
+    size_t length = 1 + rand() % 4;
+    for (size_t j = 0; j < length; j++) {
+      key += (j ? "-" : "") + std::string(syllables[rand() % syllableCount]);
+    }
+    std::string value = key;
+    value.erase(std::remove(value.begin(), value.end(), '-'), value.end());
+    source << key << " " << value << " " << -(rand() % 64) / 8.0 << "\n";
+  }
+
+  std::string path = testing::TempDir() + "GramambularTest-parallel.lm";
+  std::ofstream binary(path.c_str(), std::ios::binary);
+  std::string error;
+  ASSERT_TRUE(MappedLanguageModel::Compile(source, binary, error)) << error;
+  binary.close();
+
+  MappedLanguageModel lm;
+  ASSERT_TRUE(lm.open(path));
+  ASSERT_TRUE(lm.hasConstQueries());
+
+  // sentences of very different lengths, so that threads run out unevenly
+  std::vector<std::vector<std::string> > sentences(500);
+  for (size_t i = 0; i < sentences.size(); i++) {
+    size_t length = (i % 50 == 0) ? 200 : rand() % 20;
+    for (size_t j = 0; j < length; j++) {
+      sentences[i].push_back(syllables[rand() % syllableCount]);
+    }
+  }
+
+  BatchConverter serial(&lm, "-");
+  std::vector<std::string> expected;
+  for (size_t i = 0; i < sentences.size(); i++) {
+    expected.push_back(serial.convert(sentences[i]));
+  }
+
+  size_t threadCounts[] = {1, 2, 4, 7};
+  for (size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); t++) {
+    ParallelConverter parallel(&lm, "-", threadCounts[t]);
+    EXPECT_EQ(threadCounts[t], parallel.threadCount());
+
+    std::vector<std::string> results;
+    parallel.convert(sentences, results);
+    EXPECT_EQ(expected, results) << threadCounts[t] << " threads";
+
+    // again, with the converters' buffers left from the last run
+    std::vector<std::vector<std::string> > few(sentences.begin(),
+                                               sentences.begin() + 3);
+    parallel.convert(few, results);
+    EXPECT_EQ(std::vector<std::string>(expected.begin(), expected.begin() + 3),
+              results);
+
+    // and with a count, leaving the rest of the sentences alone
+    parallel.convert(sentences, 3, results);
+    EXPECT_EQ(std::vector<std::string>(expected.begin(), expected.begin() + 3),
+              results);
+  }
+
+  // a reader gives the same grams as the model itself
+  LanguageModelReader reader(&lm);
+  std::vector<Unigram> unigrams;
+  for (size_t i = 0; i < syllableCount; i++) {
+    EXPECT_EQ(lm.unigramsForKeys(syllables[i]),
+              reader.unigramsForKeys(syllables[i]));
+    lm.readUnigramsForKey(syllables[i], unigrams);
+    EXPECT_EQ(lm.unigramsForKeys(syllables[i]), unigrams);
+
+    // and reads views into the caller's buffer
+    UnigramView view = reader.unigramViewForKey(syllables[i], unigrams);
+    EXPECT_EQ(lm.unigramsForKeys(syllables[i]),
+              std::vector<Unigram>(view.begin(), view.end()));
+    EXPECT_TRUE(view.empty() || view.begin() == &unigrams[0]);
+  }
+  EXPECT_EQ(lm.maximumKeySpanLength("-"), reader.maximumKeySpanLength("-"));
+}
+
+TEST(GramambularTest, SynchronizedModelSharesAModelWithoutConstQueries) {
+  TestLM lm;
+  FillSampleLM(lm);
+  EXPECT_FALSE(lm.hasConstQueries());
+
+  SynchronizedLanguageModel shared(&lm);
+  EXPECT_TRUE(shared.hasConstQueries());
+
+  const char* sentence[] = {"高", "科", "技", "公", "司",
+                            "的", "年", "終", "獎", "金"};
+  std::vector<std::vector<std::string> > sentences;
+  for (size_t i = 0; i < 100; i++) {
+    sentences.push_back(
+        std::vector<std::string>(sentence + i % 10, sentence + 10));
+  }
+
+  ParallelConverter parallel(&shared, "", 4);
+  std::vector<std::string> results;
+  parallel.convert(sentences, results);
+
+  ASSERT_EQ(sentences.size(), results.size());
+  EXPECT_EQ("高科技公司的年終獎金", results[0]);
+  EXPECT_EQ("年終獎金", results[6]);
+  EXPECT_EQ("高科技公司的年終獎金", results[90]);
+}
+
+// Exposes which unigram priming selected, which candidates with the same
+// value can't tell apart.
+class SelectionNode : public Node {
+ public:
+  SelectionNode(const std::string& key, const std::vector<Unigram>& unigrams,
+                const std::vector<Bigram>& bigrams)
+      : Node(key, unigrams, bigrams) {}
+
+  size_t selectedUnigramIndex() const { return m_selectedUnigramIndex; }
+};
+
+TEST(GramambularTest, PrimingPicksTheLastOfDuplicateValues) {
+  std::vector<Unigram> unigrams(3);
+  const char* values[] = {"a", "b", "a"};
+  for (size_t i = 0; i < unigrams.size(); i++) {
+    unigrams[i].keyValue.key = "k";
+    unigrams[i].keyValue.value = values[i];
+    unigrams[i].score = -1.0 - i;
+  }
+
+  std::vector<Bigram> bigrams(1);
+  bigrams[0].preceedingKeyValue.key = "p";
+  bigrams[0].preceedingKeyValue.value = "x";
+  bigrams[0].keyValue = unigrams[0].keyValue;
+  bigrams[0].score = -0.5;
+
+  SelectionNode node("k", unigrams, bigrams);
+  std::vector<KeyValuePair> preceeding(1, bigrams[0].preceedingKeyValue);
+  node.primeNodeWithPreceedingKeyValues(preceeding);
+  EXPECT_EQ(2, node.selectedUnigramIndex());
+  EXPECT_EQ("a", node.currentKeyValue().value);
+  EXPECT_EQ(-0.5, node.score());
+}
+
+TEST(GramambularTest, BuildingAndMovingANodeCopiesNothing) {
+  std::vector<Unigram> unigrams(3);
+  const char* values[] = {"a", "b", "c"};
+  for (size_t i = 0; i < unigrams.size(); i++) {
+    unigrams[i].keyValue.key = "k";
+    unigrams[i].keyValue.value = values[i];
+    unigrams[i].score = -1.0 - i;
+  }
+  std::vector<Bigram> bigrams;
+
+  Grid grid;
+  grid.insertNode(Node(), 0, 1);
+
+  // The unigrams are moved in, and there is no value-to-index map, so the
+  // candidate list is the only allocation; moving the node into a slot
+  // makes none.
+  size_t allocationCount = g_allocationCount;
+  Node node("k", std::move(unigrams), bigrams);
+  EXPECT_EQ(allocationCount + 1, g_allocationCount);
+  grid.insertNode(std::move(node), 0, 1);
+  EXPECT_EQ(allocationCount + 1, g_allocationCount);
+  EXPECT_EQ("a",
+            grid.nodeAtLocationSpanningLength(0, 1)->currentKeyValue().value);
+}
+
+TEST(GramambularTest, ViterbiWalkOnEmptyGrid) {
+  Grid grid;
+  Walker walker(&grid);
+  EXPECT_TRUE(walker.reverseViterbiWalk(0).empty());
+  EXPECT_TRUE(walker.reverseViterbiWalk(1).empty());
+}
+
+}
@@ -0,0 +1,284 @@
+// Times composing and parsing Bopomofo syllables, romanizing them with and
+// without the syllable table, transliterating text, and parsing and typing
+// key sequences. Not part of the test suite; build the MandarinBenchmark target and run it directly.
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Mandarin.h"
+
+namespace {
+
+using namespace Formosa::Mandarin;
+
+// Returns the time of one call in microseconds, averaged over a batch of
+// calls; the fastest of several batches is taken to keep out noise.
+template <typename F>
+double Time(F f) {
+  double best = 0.0;
+  for (int batch = 0; batch < 7; batch++) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    size_t iterations = 0;
+    double elapsed = 0.0;
+    do {
+      f();
+      iterations++;
+      elapsed = std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    } while (elapsed < 30000.0);
+
+    if (!batch || elapsed / iterations < best) {
+      best = elapsed / iterations;
+    }
+  }
+  return best;
+}
+
+// The syllables that survive a round trip through Hanyu Pinyin, in all five
+// tones; there's no syllable list in the tree, and this keeps out component
+// combinations that Mandarin doesn't have.
+std::vector<BPMF> ValidSyllables() {
+  std::vector<BPMF> syllables;
+  for (BPMF::Component c = 0; c < 22; c++) {
+    for (BPMF::Component m = 0; m < 4; m++) {
+      for (BPMF::Component v = 0; v < 14; v++) {
+        BPMF syllable(c | (m << 5) | (v << 7));
+        if (syllable.isEmpty() ||
+            BPMF::FromHanyuPinyin(syllable.HanyuPinyinString(false, false)) !=
+                syllable) {
+          continue;
+        }
+
+        for (BPMF::Component t = 0; t < 5; t++) {
+          syllables.push_back(BPMF(syllable + BPMF(t << 11)));
+        }
+      }
+    }
+  }
+  return syllables;
+}
+
+void BenchmarkComposedStrings() {
+  std::vector<BPMF> syllables = ValidSyllables();
+  std::vector<std::string> composed;
+  for (size_t i = 0; i < syllables.size(); i++) {
+    composed.push_back(syllables[i].composedString());
+  }
+
+  size_t length = 0;
+  double compose = Time([&] {
+    for (size_t i = 0; i < syllables.size(); i++) {
+      length += syllables[i].composedString().size();
+    }
+  });
+
+  BPMF::Component sum = 0;
+  double parse = Time([&] {
+    for (size_t i = 0; i < composed.size(); i++) {
+      sum += BPMF::FromComposedString(composed[i]).absoluteOrder();
+    }
+  });
+
+  printf("%zu syllables\n", syllables.size());
+  printf("%-24s %10s\n", "", "ns/syllable");
+  printf("%-24s %10.1f\n", "composedString()", compose * 1000.0 / syllables.size());
+  printf("%-24s %10.1f\n", "FromComposedString()", parse * 1000.0 / syllables.size());
+  if (!length || !sum) {
+    printf("(nothing composed)\n");
+  }
+}
+
+void BenchmarkRomanization() {
+  std::vector<BPMF> syllables = ValidSyllables();
+  const BopomofoSyllableTable* table = BopomofoSyllableTable::SharedTable();
+  std::vector<std::string> pinyin, pht;
+  for (size_t i = 0; i < syllables.size(); i++) {
+    pinyin.push_back(syllables[i].HanyuPinyinString(true, false));
+    pht.push_back(syllables[i].PHTString(true));
+  }
+
+  size_t length = 0;
+  BPMF::Component sum = 0;
+  double pinyinFunction = Time([&] {
+    for (size_t i = 0; i < syllables.size(); i++) {
+      length += syllables[i].HanyuPinyinString(true, false).size();
+    }
+  });
+  double pinyinTable = Time([&] {
+    for (size_t i = 0; i < syllables.size(); i++) {
+      length += table->hanyuPinyinString(syllables[i], true, false).size();
+    }
+  });
+  double fromPinyinFunction = Time([&] {
+    for (size_t i = 0; i < pinyin.size(); i++) {
+      sum += BPMF::FromHanyuPinyin(pinyin[i]).absoluteOrder();
+    }
+  });
+  double fromPinyinTable = Time([&] {
+    for (size_t i = 0; i < pinyin.size(); i++) {
+      sum += table->syllableFromHanyuPinyin(pinyin[i]).absoluteOrder();
+    }
+  });
+  double phtFunction = Time([&] {
+    for (size_t i = 0; i < syllables.size(); i++) {
+      length += syllables[i].PHTString(true).size();
+    }
+  });
+  double phtTable = Time([&] {
+    for (size_t i = 0; i < syllables.size(); i++) {
+      length += table->PHTString(syllables[i], true).size();
+    }
+  });
+  double fromPHTFunction = Time([&] {
+    for (size_t i = 0; i < pht.size(); i++) {
+      sum += BPMF::FromPHT(pht[i]).absoluteOrder();
+    }
+  });
+  double fromPHTTable = Time([&] {
+    for (size_t i = 0; i < pht.size(); i++) {
+      sum += table->syllableFromPHT(pht[i]).absoluteOrder();
+    }
+  });
+
+  double n = syllables.size() / 1000.0;
+  printf("\n%-24s %10s %10s\n", "ns/syllable", "BPMF", "table");
+  printf("%-24s %10.1f %10.1f\n", "HanyuPinyinString()", pinyinFunction / n, pinyinTable / n);
+  printf("%-24s %10.1f %10.1f\n", "FromHanyuPinyin()", fromPinyinFunction / n, fromPinyinTable / n);
+  printf("%-24s %10.1f %10.1f\n", "PHTString()", phtFunction / n, phtTable / n);
+  printf("%-24s %10.1f %10.1f\n", "FromPHT()", fromPHTFunction / n, fromPHTTable / n);
+  if (!length || !sum) {
+    printf("(nothing romanized)\n");
+  }
+}
+
+// Composed syllables, 20 to a line, until the text is about 1 MB.
+std::string ComposedText() {
+  std::vector<BPMF> syllables = ValidSyllables();
+  std::string text;
+  for (size_t i = 0; text.size() < 1000000; i++) {
+    text += syllables[(i * 7919) % syllables.size()].composedString();
+    text += (i % 20 == 19) ? '\n' : ' ';
+  }
+  return text;
+}
+
+// Transliterates text with the per-syllable API: split, parse, romanize.
+void TransliterateSyllableBySyllable(const std::string& text,
+                                     std::string& output) {
+  size_t start = 0;
+  while (start < text.size()) {
+    size_t end = text.find_first_of(" \n", start);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    output += BPMF::FromComposedString(text.substr(start, end - start))
+                  .HanyuPinyinString(true, false);
+    if (end < text.size()) {
+      output += text[end];
+    }
+    start = end + 1;
+  }
+}
+
+void BenchmarkTransliteration() {
+  typedef BopomofoTransliterator T;
+  std::string composed = ComposedText();
+  std::string pinyin =
+      T(T::ComposedString, T::HanyuPinyin).transliterate(composed);
+
+  struct Case {
+    const char* name;
+    T::Form from;
+    T::Form to;
+    const std::string* input;
+  };
+  const Case cases[] = {
+      {"composed -> pinyin", T::ComposedString, T::HanyuPinyin, &composed},
+      {"composed -> PHT", T::ComposedString, T::PHT, &composed},
+      {"composed -> order", T::ComposedString, T::AbsoluteOrderString,
+       &composed},
+      {"pinyin -> composed", T::HanyuPinyin, T::ComposedString, &pinyin},
+      {"pinyin -> PHT", T::HanyuPinyin, T::PHT, &pinyin},
+  };
+
+  std::string output;
+  printf("\n%-24s %10s\n", "transliteration", "MB/s");
+
+  double bySyllable = Time([&] {
+    output.clear();
+    TransliterateSyllableBySyllable(composed, output);
+  });
+  printf("%-24s %10.1f\n", "per syllable (BPMF)", composed.size() / bySyllable);
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    T transliterator(cases[i].from, cases[i].to);
+    const std::string& input = *cases[i].input;
+    double time = Time([&] {
+      output.clear();
+      transliterator.transliterate(input.data(), input.size(), output);
+    });
+    printf("%-24s %10.1f\n", cases[i].name, input.size() / time);
+  }
+}
+
+void BenchmarkKeySequences() {
+  std::vector<BPMF> syllables = ValidSyllables();
+  const char* names[] = {"standard", "eten", "hsu", "eten26"};
+
+  printf("\n%-24s %10s %10s %10s\n", "ns/syllable", "heuristic", "automaton",
+         "typing");
+  for (size_t l = 0; l < sizeof(names) / sizeof(names[0]); l++) {
+    const BopomofoKeyboardLayout* layout =
+        BopomofoKeyboardLayout::LayoutForName(names[l]);
+    std::vector<std::string> sequences;
+    for (size_t i = 0; i < syllables.size(); i++) {
+      sequences.push_back(layout->keySequenceFromSyllable(syllables[i]));
+    }
+
+    BPMF::Component sum = 0;
+    double heuristic = Time([&] {
+      for (size_t i = 0; i < sequences.size(); i++) {
+        sum += layout->heuristicSyllableFromKeySequence(sequences[i])
+                   .absoluteOrder();
+      }
+    });
+    double automaton = Time([&] {
+      for (size_t i = 0; i < sequences.size(); i++) {
+        sum += layout->syllableFromKeySequence(sequences[i]).absoluteOrder();
+      }
+    });
+
+    // the reading buffer re-parses the whole sequence on every key
+    BopomofoReadingBuffer buffer(layout);
+    double typing = Time([&] {
+      for (size_t i = 0; i < sequences.size(); i++) {
+        buffer.clear();
+        for (size_t k = 0; k < sequences[i].size(); k++) {
+          buffer.combineKey(sequences[i][k]);
+        }
+        sum += buffer.syllable().absoluteOrder();
+      }
+    });
+
+    double n = sequences.size() / 1000.0;
+    printf("%-24s %10.1f %10.1f %10.1f\n", layout->name().c_str(),
+           heuristic / n, automaton / n, typing / n);
+    if (!sum) {
+      printf("(nothing parsed)\n");
+    }
+  }
+}
+
+}  // namespace
+
+int main() {
+  BenchmarkComposedStrings();
+  BenchmarkRomanization();
+  BenchmarkTransliteration();
+  BenchmarkKeySequences();
+  return 0;
+}
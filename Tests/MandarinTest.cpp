@@ -0,0 +1,335 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "AllocationCounter.h"
+#include "Mandarin.h"
+
+namespace {
+
+using namespace Formosa::Mandarin;
+
+const char* kLayoutNames[] = {"standard", "eten", "hsu", "eten26",
+                              "hanyupinyin"};
+const size_t kLayoutCount = sizeof(kLayoutNames) / sizeof(kLayoutNames[0]);
+
+// Everything a first use touches: the layouts, composing and parsing
+// syllables, and the syllable table.
+struct FirstUse {
+  const BopomofoKeyboardLayout* layouts[kLayoutCount];
+  std::string typed;
+  std::string reparsed;
+  const BopomofoSyllableTable* table;
+  std::string pinyin;
+};
+
+void UseTables(FirstUse& use) {
+  for (size_t i = 0; i < kLayoutCount; i++) {
+    use.layouts[i] = BopomofoKeyboardLayout::LayoutForName(kLayoutNames[i]);
+  }
+
+  BopomofoReadingBuffer buffer(BopomofoKeyboardLayout::StandardLayout());
+  buffer.combineKey('s');
+  buffer.combineKey('u');
+  buffer.combineKey('3');
+  use.typed = buffer.composedString();
+  use.reparsed = BPMF::FromComposedString(use.typed).composedString();
+  use.table = BopomofoSyllableTable::SharedTable();
+  use.pinyin = use.table->hanyuPinyinString(
+      BPMF::FromComposedString(use.typed), true, false);
+}
+
+// Races threads to the tables' first use, and exits with 0 if every
+// thread got what one thread gets afterwards.
+void RaceToFirstUse() {
+  const size_t threadCount = 16;
+  std::vector<FirstUse> uses(threadCount);
+  std::atomic<bool> go(false);
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < threadCount; t++) {
+    threads.push_back(std::thread([&uses, &go, t] {
+      while (!go) {
+      }
+      UseTables(uses[t]);
+    }));
+  }
+  go = true;
+  for (size_t t = 0; t < threadCount; t++) {
+    threads[t].join();
+  }
+
+  FirstUse expected;
+  UseTables(expected);
+  bool same = expected.typed == "ㄋㄧˇ" &&
+              expected.reparsed == expected.typed && expected.pinyin == "ni3";
+  for (size_t t = 0; t < threadCount; t++) {
+    for (size_t i = 0; i < kLayoutCount; i++) {
+      same = same && uses[t].layouts[i] &&
+             expected.layouts[i] == uses[t].layouts[i];
+    }
+    same = same && expected.typed == uses[t].typed &&
+           expected.reparsed == uses[t].reparsed &&
+           expected.table == uses[t].table &&
+           expected.pinyin == uses[t].pinyin;
+  }
+  std::exit(same ? 0 : 1);
+}
+
+// The race runs in a new process, so that the tables are used there for
+// the first time whatever the order of the tests or the filter; run it
+// under ThreadSanitizer to check the races.
+TEST(MandarinTest, TablesInitializeOnceUnderConcurrentFirstUse) {
+  GTEST_FLAG_SET(death_test_style, "threadsafe");
+  EXPECT_EXIT(RaceToFirstUse(), testing::ExitedWithCode(0), "");
+}
+
+TEST(MandarinTest, LayoutsOutliveFinalizeLayouts) {
+  const BopomofoKeyboardLayout* standard =
+      BopomofoKeyboardLayout::StandardLayout();
+  const BopomofoKeyboardLayout* eten = BopomofoKeyboardLayout::ETenLayout();
+
+  BopomofoKeyboardLayout::FinalizeLayouts();
+
+  EXPECT_EQ(standard, BopomofoKeyboardLayout::StandardLayout());
+  EXPECT_EQ(eten, BopomofoKeyboardLayout::ETenLayout());
+  EXPECT_EQ("Standard", standard->name());
+  EXPECT_EQ("ETen", eten->name());
+}
+
+const char* kConsonants[] = {"",  "ㄅ", "ㄆ", "ㄇ", "ㄈ", "ㄉ", "ㄊ", "ㄋ",
+                             "ㄌ", "ㄍ", "ㄎ", "ㄏ", "ㄐ", "ㄑ", "ㄒ", "ㄓ",
+                             "ㄔ", "ㄕ", "ㄖ", "ㄗ", "ㄘ", "ㄙ"};
+const char* kMiddleVowels[] = {"", "ㄧ", "ㄨ", "ㄩ"};
+const char* kVowels[] = {"",  "ㄚ", "ㄛ", "ㄜ", "ㄝ", "ㄞ", "ㄟ",
+                         "ㄠ", "ㄡ", "ㄢ", "ㄣ", "ㄤ", "ㄥ", "ㄦ"};
+const char* kTones[] = {"", "ˊ", "ˇ", "ˋ", "˙"};
+
+TEST(MandarinTest, ComposedStringsOfEveryComponentCombination) {
+  for (BPMF::Component c = 0; c < 22; c++) {
+    for (BPMF::Component m = 0; m < 4; m++) {
+      for (BPMF::Component v = 0; v < 14; v++) {
+        for (BPMF::Component t = 0; t < 5; t++) {
+          BPMF syllable(c | (m << 5) | (v << 7) | (t << 11));
+          std::string expected = std::string(kConsonants[c]) +
+                                 kMiddleVowels[m] + kVowels[v] + kTones[t];
+
+          ASSERT_EQ(expected, syllable.composedString());
+          ASSERT_EQ(syllable, BPMF::FromComposedString(expected)) << expected;
+        }
+      }
+    }
+  }
+}
+
+TEST(MandarinTest, FromComposedStringSkipsOtherCharacters) {
+  EXPECT_EQ(BPMF(BPMF::B | BPMF::A | BPMF::Tone4),
+            BPMF::FromComposedString("xㄅ中ㄚ😀ˋ"));
+
+  // later components of a kind replace earlier ones
+  EXPECT_EQ(BPMF(BPMF::P | BPMF::I), BPMF::FromComposedString("ㄅㄧㄆ"));
+
+  // other characters in the Bopomofo and modifier letter blocks
+  EXPECT_EQ(BPMF(BPMF::A), BPMF::FromComposedString("ㄪㄚ\xcb\x80"));
+
+  // truncated and stray bytes
+  EXPECT_EQ(BPMF(BPMF::B), BPMF::FromComposedString("ㄅ\xe3\x84"));
+  EXPECT_EQ(BPMF(BPMF::B), BPMF::FromComposedString("ㄅ\xcb"));
+  EXPECT_EQ(BPMF(BPMF::B), BPMF::FromComposedString("\x84ㄅ\xff"));
+  EXPECT_TRUE(BPMF::FromComposedString("").isEmpty());
+}
+
+// Every sequence of up to four keys, over the layout's keys and one key that
+// isn't in the layout, must parse the same with the automaton as with the
+// heuristics it was compiled from.
+void ExpectAutomatonMatchesHeuristics(const BopomofoKeyboardLayout* layout) {
+  std::string keys = "`";
+  for (int c = 1; c < 128; c++) {
+    if (layout->keyComponentCount((char)c)) {
+      keys += (char)c;
+    }
+  }
+
+  std::string sequence;
+  for (size_t length = 0; length <= 4; length++) {
+    size_t count = 1;
+    for (size_t i = 0; i < length; i++) {
+      count *= keys.size();
+    }
+
+    sequence.assign(length, ' ');
+    for (size_t n = 0; n < count; n++) {
+      for (size_t i = 0, m = n; i < length; i++, m /= keys.size()) {
+        sequence[i] = keys[m % keys.size()];
+      }
+      ASSERT_EQ(layout->heuristicSyllableFromKeySequence(sequence),
+                layout->syllableFromKeySequence(sequence))
+          << layout->name() << " \"" << sequence << "\"";
+    }
+  }
+}
+
+TEST(MandarinTest, KeySequenceAutomatonMatchesHeuristics) {
+  for (size_t l = 0; l < kLayoutCount - 1; l++) {
+    ExpectAutomatonMatchesHeuristics(
+        BopomofoKeyboardLayout::LayoutForName(kLayoutNames[l]));
+  }
+}
+
+TEST(MandarinTest, TypingAllocatesNothing) {
+  BopomofoReadingBuffer buffer(BopomofoKeyboardLayout::HsuLayout());
+  const char keys[] = "v!unf";
+
+  size_t allocationCount = g_allocationCount;
+  for (const char* k = keys; *k; k++) {
+    if (buffer.isValidKey(*k)) {
+      buffer.combineKey(*k);
+    }
+  }
+  BPMF typed = buffer.syllable();
+  buffer.backspace();
+  BPMF erased = buffer.syllable();
+  EXPECT_EQ(allocationCount, g_allocationCount);
+
+  EXPECT_EQ("ㄑㄩㄣˇ", typed.composedString());
+  EXPECT_EQ("ㄑㄩㄣ", erased.composedString());
+}
+
+TEST(MandarinTest, LayoutsFromAKeyMap) {
+  BopomofoKeyToComponentMap keys;
+  keys['a'] = std::vector<BPMF::Component>(1, BPMF::B);
+  keys['b'] = std::vector<BPMF::Component>(1, BPMF::A);
+  keys['c'] = std::vector<BPMF::Component>(1, BPMF::Tone3);
+  keys['d'] = std::vector<BPMF::Component>(1, BPMF::I);
+  keys['e'] = {BPMF::ER, BPMF::E};
+  keys['f'] = {BPMF::J, BPMF::M, BPMF::AN, BPMF::Tone4};
+  keys['g'] = std::vector<BPMF::Component>(1, BPMF::B | BPMF::A);
+  keys['h'] = std::vector<BPMF::Component>();
+  BopomofoKeyboardLayout layout(keys, "Custom");
+
+  EXPECT_EQ(1U, layout.keyComponentCount('a'));
+  EXPECT_EQ(4U, layout.keyComponentCount('f'));
+  EXPECT_EQ(0U, layout.keyComponentCount('h'));
+  EXPECT_EQ(0U, layout.keyComponentCount('z'));
+  EXPECT_EQ(4U, layout.keyToComponents('f').size());
+  EXPECT_EQ('a', layout.componentToKey(BPMF::B));
+  EXPECT_EQ('f', layout.componentToKey(BPMF::Tone4));
+  EXPECT_EQ('g', layout.componentToKey(BPMF::B | BPMF::A));
+  EXPECT_EQ(0, layout.componentToKey(BPMF::P));
+
+  BopomofoReadingBuffer buffer(&layout);
+  EXPECT_FALSE(buffer.isValidKey('h'));
+  buffer.combineKey('a');
+  buffer.combineKey('b');
+  buffer.combineKey('c');
+  EXPECT_EQ("ㄅㄚˇ", buffer.composedString());
+  EXPECT_EQ("abc", layout.keySequenceFromSyllable(buffer.syllable()));
+
+  ExpectAutomatonMatchesHeuristics(&layout);
+}
+
+// The table is generated from the BPMF functions, which stay as the
+// reference: every entry and every string it indexes must agree with them.
+TEST(MandarinTest, SyllableTableMatchesTheRomanizationFunctions) {
+  const BopomofoSyllableTable* table = BopomofoSyllableTable::SharedTable();
+  for (size_t order = 0; order < BopomofoSyllableTable::Size; order++) {
+    BPMF syllable = BPMF::FromAbsoluteOrder((short)order);
+    for (int tone = 0; tone < 2; tone++) {
+      for (int v = 0; v < 2; v++) {
+        std::string pinyin = syllable.HanyuPinyinString(tone, v);
+        ASSERT_EQ(pinyin, table->hanyuPinyinString(syllable, tone, v));
+        ASSERT_EQ(BPMF::FromHanyuPinyin(pinyin),
+                  table->syllableFromHanyuPinyin(pinyin))
+            << pinyin;
+      }
+
+      std::string pht = syllable.PHTString(tone);
+      ASSERT_EQ(pht, table->PHTString(syllable, tone));
+      ASSERT_EQ(BPMF::FromPHT(pht), table->syllableFromPHT(pht)) << pht;
+    }
+  }
+}
+
+TEST(MandarinTest, SyllableTableFallsBackForStringsItNeverGenerated) {
+  const BopomofoSyllableTable* table = BopomofoSyllableTable::SharedTable();
+  const char* pinyin[] = {"ZHUANG4", "ba1", "lve", "xyz", "zh", ""};
+  for (size_t i = 0; i < sizeof(pinyin) / sizeof(pinyin[0]); i++) {
+    EXPECT_EQ(BPMF::FromHanyuPinyin(pinyin[i]),
+              table->syllableFromHanyuPinyin(pinyin[i]))
+        << pinyin[i];
+    EXPECT_EQ(BPMF::FromPHT(pinyin[i]), table->syllableFromPHT(pinyin[i]))
+        << pinyin[i];
+  }
+  EXPECT_EQ(BPMF(BPMF::ZH | BPMF::U | BPMF::ANG | BPMF::Tone4),
+            table->syllableFromHanyuPinyin("ZHUANG4"));
+
+  // a consonant past S has no absolute order of its own
+  EXPECT_EQ("", table->hanyuPinyinString(BPMF(BPMF::S + 1), true, false));
+  EXPECT_EQ("", table->PHTString(BPMF(BPMF::S + 1), true));
+}
+
+TEST(MandarinTest, TransliteratorConvertsBetweenForms) {
+  typedef BopomofoTransliterator T;
+  const std::string composed = "ㄋㄧˇ ㄏㄠˇ\nㄓㄨㄤˋ  ㄌㄩˋ\tㄓ";
+
+  EXPECT_EQ("ni3 hao3\nzhuang4  lü4\tzhi",
+            T(T::ComposedString, T::HanyuPinyin).transliterate(composed));
+  EXPECT_EQ("ni hao\nzhuang  lv\tzhi",
+            T(T::ComposedString, T::HanyuPinyin, false, true)
+                .transliterate(composed));
+  EXPECT_EQ("ni3 hao3\nchuang4  luu4\tchih",
+            T(T::ComposedString, T::PHT).transliterate(composed));
+  EXPECT_EQ("ㄋㄧ ㄏㄠ\nㄓㄨㄤ  ㄌㄩ\tㄓ",
+            T(T::ComposedString, T::ComposedString, false)
+                .transliterate(composed));
+
+  const T::Form forms[] = {T::ComposedString, T::HanyuPinyin, T::PHT,
+                           T::AbsoluteOrderString};
+  for (size_t i = 0; i < 4; i++) {
+    std::string converted = T(T::ComposedString, forms[i]).transliterate(composed);
+    EXPECT_EQ(composed, T(forms[i], T::ComposedString).transliterate(converted))
+        << converted;
+  }
+}
+
+TEST(MandarinTest, TransliteratorReadsEveryComposedSyllable) {
+  typedef BopomofoTransliterator T;
+  T transliterator(T::ComposedString, T::AbsoluteOrderString);
+  for (size_t order = 1; order < BopomofoSyllableTable::Size; order++) {
+    BPMF syllable = BPMF::FromAbsoluteOrder((short)order);
+    ASSERT_EQ(syllable.absoluteOrderString(),
+              transliterator.transliterate(syllable.composedString()))
+        << syllable.composedString();
+  }
+}
+
+TEST(MandarinTest, TransliteratorCopiesWhatIsNotASyllable) {
+  typedef BopomofoTransliterator T;
+  EXPECT_EQ("中文 xㄅ ㄅx  \n", T(T::ComposedString, T::HanyuPinyin)
+                                       .transliterate("中文 xㄅ ㄅx  \n"));
+
+  // components out of order, or twice
+  EXPECT_EQ("ㄧㄅ ㄅㄆ ㄚˇˇ", T(T::ComposedString, T::HanyuPinyin)
+                                 .transliterate("ㄧㄅ ㄅㄆ ㄚˇˇ"));
+
+  // only the lower case forms that BPMF generates are recognized
+  EXPECT_EQ("ni3 Hao3 luu4 luu4 ba1 xyz",
+            T(T::HanyuPinyin, T::PHT)
+                .transliterate("ni3 Hao3 lv4 lü4 ba1 xyz"));
+
+  // 00 is the empty syllable; ~~ is past the last absolute order
+  EXPECT_EQ("00 ~~ 123", T(T::AbsoluteOrderString, T::HanyuPinyin)
+                              .transliterate("00 ~~ 123"));
+
+  // output is appended
+  std::string output = "> ";
+  const std::string input = "ㄅㄚ";
+  T(T::ComposedString, T::HanyuPinyin)
+      .transliterate(input.data(), input.length(), output);
+  EXPECT_EQ("> ba", output);
+}
+
+}  // namespace
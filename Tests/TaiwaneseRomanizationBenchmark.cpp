@@ -0,0 +1,381 @@
+// Times composing every syllable of the Taiwanese and Hakka syllable lists
+// in each romanization style and making their query data, composing single
+// vowels through the table and through the map lookup it is built from,
+// turning the composed text back into query form, and transliterating
+// running text. Not part of the test suite;
+// build the TaiwaneseRomanizationBenchmark target and run it directly, from
+// the top of the tree or with the directory of the syllable lists as its
+// argument.
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "TaiwaneseRomanization.h"
+#include "VowelHelper.h"
+
+namespace {
+
+using namespace Formosa::TaiwaneseRomanization;
+
+// Returns the time of one call in microseconds, averaged over a batch of
+// calls; the fastest of several batches is taken to keep out noise.
+template <typename F>
+double Time(F f) {
+  double best = 0.0;
+  for (int batch = 0; batch < 7; batch++) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    size_t iterations = 0;
+    double elapsed = 0.0;
+    do {
+      f();
+      iterations++;
+      elapsed = std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    } while (elapsed < 30000.0);
+
+    if (!batch || elapsed / iterations < best) {
+      best = elapsed / iterations;
+    }
+  }
+  return best;
+}
+
+std::vector<std::string> ReadLines(const std::string& path) {
+  std::vector<std::string> lines;
+  std::ifstream input(path.c_str());
+  std::string line;
+  while (std::getline(input, line)) {
+    if (!line.empty() && line[line.size() - 1] == '\r') {
+      line.erase(line.size() - 1);
+    }
+    if (!line.empty()) {
+      lines.push_back(line);
+    }
+  }
+  return lines;
+}
+
+struct Style {
+  const char* name;
+  SyllableType type;
+  bool forcePOJStyle;
+  bool usePOJLegacyOU;
+};
+
+// Types a syllable the way the syllable list tools do: a digit ends the
+// syllable with that tone.
+RomanizationSyllable Type(const std::string& text, const Style& style,
+                          unsigned int tone) {
+  RomanizationSyllable syllable;
+  syllable.setInputType(style.type);
+  syllable.setForcePOJStyle(style.forcePOJStyle);
+  syllable.setUsePOJLegacyOU(style.usePOJLegacyOU);
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] >= '0' && text[i] <= '9') {
+      tone = text[i] - '0';
+      break;
+    }
+    syllable.insertCharacterAtCursor(text[i]);
+  }
+  syllable.normalize(tone);
+  return syllable;
+}
+
+// Leaves the composed form of every syllable in composed.
+void BenchmarkSyllables(const std::string& directory,
+                        std::vector<std::string>& composed) {
+  // the Taiwanese list has no tones, so each syllable is typed in all nine
+  std::vector<std::string> taiwanese =
+      ReadLines(directory + "/TLSyllables.txt");
+  std::vector<std::string> hakka = ReadLines(directory + "/HakkaSyllables.txt");
+  if (taiwanese.empty() || hakka.empty()) {
+    printf("syllable lists not found in %s\n", directory.c_str());
+    return;
+  }
+
+  const Style taiwaneseStyles[] = {
+      {"POJ", POJSyllable, false, false},
+      {"POJ, legacy ou", POJSyllable, false, true},
+      {"TL", TLSyllable, false, false},
+      {"TL, POJ style", TLSyllable, true, false},
+      {"TL, POJ style, legacy ou", TLSyllable, true, true},
+  };
+  const Style hakkaStyles[] = {
+      {"Hakka PFS", HakkaPFSSyllable, false, false},
+      {"Hakka PFS, legacy ou", HakkaPFSSyllable, false, true},
+  };
+
+  struct Case {
+    const Style* style;
+    const std::vector<std::string>* syllables;
+    unsigned int tones;
+  };
+  std::vector<Case> cases;
+  for (size_t i = 0; i < sizeof(taiwaneseStyles) / sizeof(taiwaneseStyles[0]);
+       i++) {
+    cases.push_back({&taiwaneseStyles[i], &taiwanese, 9});
+  }
+  for (size_t i = 0; i < sizeof(hakkaStyles) / sizeof(hakkaStyles[0]); i++) {
+    cases.push_back({&hakkaStyles[i], &hakka, 1});
+  }
+
+  printf("%-28s %10s %10s %10s %10s %10s\n", "ns/syllable", "syllables",
+         "compose", "cursor", "query", "buffer");
+  for (size_t c = 0; c < cases.size(); c++) {
+    std::vector<RomanizationSyllable> syllables;
+    for (size_t i = 0; i < cases[c].syllables->size(); i++) {
+      for (unsigned int tone = 1; tone <= cases[c].tones; tone++) {
+        syllables.push_back(
+            Type((*cases[c].syllables)[i], *cases[c].style, tone));
+        composed.push_back(syllables.back().composedForm());
+      }
+    }
+
+    size_t length = 0;
+    double compose = Time([&] {
+      for (size_t i = 0; i < syllables.size(); i++) {
+        length += syllables[i].composedForm().size();
+      }
+    });
+    double cursor = Time([&] {
+      for (size_t i = 0; i < syllables.size(); i++) {
+        length += syllables[i].cursor();
+      }
+    });
+
+    double query = Time([&] {
+      for (size_t i = 0; i < syllables.size(); i++) {
+        length += syllables[i].normalizedQueryData().size();
+      }
+    });
+    char buffer[RomanizationSyllable::MaxQueryDataLength];
+    double queryIntoBuffer = Time([&] {
+      for (size_t i = 0; i < syllables.size(); i++) {
+        length += syllables[i].writeNormalizedQueryData(buffer);
+      }
+    });
+
+    double n = syllables.size() / 1000.0;
+    printf("%-28s %10zu %10.1f %10.1f %10.1f %10.1f\n",
+           cases[c].style->name, syllables.size(), compose / n, cursor / n,
+           query / n, queryIntoBuffer / n);
+    if (!length) {
+      printf("(nothing composed)\n");
+    }
+  }
+}
+
+void BenchmarkVowels() {
+  const char* vowels[] = {"a",  "e",  "i",  "m",  "n",  "o",  "u",
+                          "A",  "O",  "nn", "ou", "oo", "Ou", "ii"};
+  const size_t count = sizeof(vowels) / sizeof(vowels[0]);
+  std::vector<std::string> strings(vowels, vowels + count);
+
+  size_t length = 0;
+  double byMap = Time([&] {
+    for (size_t i = 0; i < count; i++) {
+      for (unsigned int tone = 0; tone <= 9; tone++) {
+        length +=
+            VowelHelper::referenceSymbolForVowel(strings[i], tone, true, true,
+                                                 false, false)
+                .size();
+      }
+    }
+  });
+  double byString = Time([&] {
+    for (size_t i = 0; i < count; i++) {
+      for (unsigned int tone = 0; tone <= 9; tone++) {
+        length += VowelHelper::symbolForVowel(strings[i], tone, true, true,
+                                              false, false)
+                      .size();
+      }
+    }
+  });
+  double bySlice = Time([&] {
+    for (size_t i = 0; i < count; i++) {
+      for (unsigned int tone = 0; tone <= 9; tone++) {
+        length += VowelHelper::composedVowel(strings[i].data(),
+                                             strings[i].size(), tone, true,
+                                             true, false, false)
+                      .length;
+      }
+    }
+  });
+
+  double n = count * 10 / 1000.0;
+  printf("\n%-28s %10s %10s %10s\n", "ns/vowel", "map", "string", "slice");
+  printf("%-28s %10.1f %10.1f %10.1f\n", "POJ", byMap / n, byString / n,
+         bySlice / n);
+  if (!length) {
+    printf("(nothing composed)\n");
+  }
+}
+
+void BenchmarkQueryForms(const std::vector<std::string>& composed) {
+  if (composed.empty()) {
+    return;
+  }
+
+  // the composed syllables, over and over, as a text of a few megabytes
+  std::string text;
+  while (text.size() < 4 * 1024 * 1024) {
+    for (size_t i = 0; i < composed.size(); i++) {
+      text += composed[i];
+      text += (i % 8) ? '-' : ' ';
+    }
+  }
+  std::vector<char> buffer(text.size() + 1);
+
+  size_t length = 0;
+  double stateWalk = Time([&] {
+    length += VowelHelper::referenceQueryFormFromComposedForm(text).size();
+  });
+  double toString = Time(
+      [&] { length += VowelHelper::queryFormFromComposedForm(text).size(); });
+  double toBuffer = Time([&] {
+    length += VowelHelper::queryFormFromComposedForm(text.data(), text.size(),
+                                                     buffer.data());
+  });
+
+  size_t syllableBytes = 0;
+  for (size_t i = 0; i < composed.size(); i++) {
+    syllableBytes += composed[i].size();
+  }
+  double syllableStateWalk = Time([&] {
+    for (size_t i = 0; i < composed.size(); i++) {
+      length +=
+          VowelHelper::referenceQueryFormFromComposedForm(composed[i]).size();
+    }
+  });
+  double syllableString = Time([&] {
+    for (size_t i = 0; i < composed.size(); i++) {
+      length += VowelHelper::queryFormFromComposedForm(composed[i]).size();
+    }
+  });
+  double syllableBuffer = Time([&] {
+    for (size_t i = 0; i < composed.size(); i++) {
+      length += VowelHelper::queryFormFromComposedForm(
+          composed[i].data(), composed[i].size(), buffer.data());
+    }
+  });
+
+  printf("\n%-28s %10s %10s %10s\n", "query form, MB/s", "states", "string",
+         "buffer");
+  printf("%-28s %10.1f %10.1f %10.1f\n", "whole text", text.size() / stateWalk,
+         text.size() / toString, text.size() / toBuffer);
+  printf("%-28s %10.1f %10.1f %10.1f\n", "syllable by syllable",
+         syllableBytes / syllableStateWalk, syllableBytes / syllableString,
+         syllableBytes / syllableBuffer);
+  if (!length) {
+    printf("(nothing decomposed)\n");
+  }
+}
+
+// Converts each syllable through syllables built for it, as the syllable
+// list tools do; the text is split into syllables beforehand.
+void TransliterateSyllableBySyllable(const std::vector<std::string>& syllables,
+                                     std::string& output) {
+  for (size_t i = 0; i < syllables.size(); i++) {
+    const std::string& text = syllables[i];
+    RomanizationSyllable source;
+    source.setInputType(TLSyllable);
+    for (size_t c = 0; c + 1 < text.size(); c++) {
+      source.insertCharacterAtCursor(text[c]);
+    }
+    unsigned int tone = text[text.size() - 1] - '0';
+    source.normalize(tone);
+    RomanizationSyllable converted = source.convertToPOJSyllable();
+    converted.normalize(tone);
+    output += converted.composedForm();
+    output += ' ';
+  }
+}
+
+void BenchmarkTransliteration(const std::string& directory) {
+  std::vector<std::string> taiwanese =
+      ReadLines(directory + "/TLSyllables.txt");
+  if (taiwanese.empty()) {
+    return;
+  }
+
+  // TL with tone numbers, in words of one to three syllables and sentences
+  // of eight words, each beginning with a capital; about a megabyte
+  std::vector<std::string> syllables;
+  std::string numbered;
+  size_t word = 0;
+  while (numbered.size() < 1024 * 1024) {
+    for (size_t i = 0; i < taiwanese.size(); i++) {
+      for (unsigned int tone = 1; tone <= 9; tone++) {
+        std::string syllable = taiwanese[i] + char('0' + tone);
+        if (!numbered.size() || numbered[numbered.size() - 2] == '.') {
+          syllable[0] = toupper(syllable[0]);
+        }
+        syllables.push_back(syllable);
+        numbered += syllable;
+
+        size_t position = syllables.size() % 6;
+        if (position == 1 || position == 3) {
+          numbered += '-';
+          continue;
+        }
+        numbered += (++word % 8) ? " " : ". ";
+      }
+    }
+  }
+
+  RomanizationTransliterator toComposedTL(TLSyllable, TLSyllable);
+  std::string tl = toComposedTL.transliterate(numbered);
+  RomanizationTransliterator toPOJ(TLSyllable, POJSyllable);
+  std::string poj = toPOJ.transliterate(tl);
+
+  struct Case {
+    const char* name;
+    SyllableType from;
+    SyllableType to;
+    bool forcePOJStyle;
+    const std::string* input;
+  } cases[] = {
+      {"TL numbers -> POJ", TLSyllable, POJSyllable, false, &numbered},
+      {"TL -> POJ", TLSyllable, POJSyllable, false, &tl},
+      {"POJ -> TL", POJSyllable, TLSyllable, false, &poj},
+      {"TL -> TL, POJ style", TLSyllable, TLSyllable, true, &tl},
+  };
+
+  std::string output;
+  printf("\n%-32s %10s\n", "transliteration", "MB/s");
+
+  double bySyllable = Time([&] {
+    output.clear();
+    TransliterateSyllableBySyllable(syllables, output);
+  });
+  printf("%-32s %10.1f\n", "TL numbers -> POJ, by syllable",
+         numbered.size() / bySyllable);
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    RomanizationTransliterator transliterator(cases[i].from, cases[i].to,
+                                              cases[i].forcePOJStyle);
+    const std::string& input = *cases[i].input;
+    double time = Time([&] {
+      output.clear();
+      transliterator.transliterate(input.data(), input.size(), output);
+    });
+    printf("%-32s %10.1f\n", cases[i].name, input.size() / time);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::string directory = argc > 1 ? argv[1] : "Tests/TestTaiwaneseLanguages";
+  std::vector<std::string> composed;
+  BenchmarkSyllables(directory, composed);
+  BenchmarkVowels();
+  BenchmarkQueryForms(composed);
+  BenchmarkTransliteration(directory);
+  return 0;
+}
@@ -1,8 +1,21 @@
 #include "gtest/gtest.h"
 
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include "AllocationCounter.h"
 #include "TaiwaneseRomanization.h"
 #include "VowelHelper.h"
 
+// The syllable lists and the query data made from them; the build passes
+// the directory, and the default works from the top of the tree.
+#ifndef TAIWANESE_ROMANIZATION_TEST_DATA
+#define TAIWANESE_ROMANIZATION_TEST_DATA "Tests/TestTaiwaneseLanguages"
+#endif
+
 namespace {
 
 Formosa::TaiwaneseRomanization::RomanizationSyllable Compose(std::string input,
@@ -57,6 +70,96 @@ std::string ComposeLegacyTLWithPOJStyleNN(std::string input, int tone = 0) {
   return syl.composedForm();
 }
 
+// Converts one syllable the way RomanizationTransliterator does, through
+// a syllable built for it at each step.
+std::string ConvertSyllable(const std::string& letters, unsigned int tone,
+                            Formosa::TaiwaneseRomanization::SyllableType from,
+                            Formosa::TaiwaneseRomanization::SyllableType to,
+                            bool forcePOJStyle = false) {
+  using namespace Formosa::TaiwaneseRomanization;
+  RomanizationSyllable source;
+  SyllableType sourceType = from;
+  if (from == TLPASyllable || from == DTSyllable) {
+    FreeFormSyllable freeForm;
+    for (char c : letters) {
+      freeForm.insertCharacterAt(freeForm.numberOfCodepoints(), c);
+    }
+    source = from == TLPASyllable ? freeForm.convertToTLFromTLPA(tone)
+                                  : freeForm.convertToTLFromDT(tone);
+    sourceType = TLSyllable;
+  } else {
+    source.setInputType(from);
+    for (char c : letters) {
+      source.insertCharacterAtCursor(c);
+    }
+    source.normalize(tone);
+  }
+
+  RomanizationSyllable converted = source;
+  if (to != sourceType) {
+    converted = to == POJSyllable ? source.convertToPOJSyllable()
+                                  : source.convertToTLSyllable();
+  }
+  converted.setForcePOJStyle(forcePOJStyle);
+  converted.normalize(tone);
+  return converted.composedForm();
+}
+
+// Everything a first use of VowelHelper's tables touches.
+struct VowelTableUse {
+  std::string composed;
+  std::string uppercased;
+  std::string queryForm;
+};
+
+void UseVowelTables(VowelTableUse& use) {
+  using Formosa::TaiwaneseRomanization::VowelHelper;
+  use.composed = VowelHelper::symbolForVowel("ou", 5, true);
+  use.uppercased = VowelHelper::uppercasedVowelFromVowel(use.composed);
+  use.queryForm = VowelHelper::queryFormFromComposedForm("t\u00e1ng");
+}
+
+// Races threads to the tables' first use, and exits with 0 if every
+// thread got what one thread gets afterwards.
+void RaceToFirstUse() {
+  const size_t threadCount = 16;
+  std::vector<VowelTableUse> uses(threadCount);
+  std::atomic<bool> go(false);
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < threadCount; t++) {
+    threads.push_back(std::thread([&uses, &go, t] {
+      while (!go) {
+      }
+      UseVowelTables(uses[t]);
+    }));
+  }
+  go = true;
+  for (size_t t = 0; t < threadCount; t++) {
+    threads[t].join();
+  }
+
+  VowelTableUse expected;
+  UseVowelTables(expected);
+  bool same = expected.composed == "o\u0358\u0302" &&
+              expected.uppercased == "O\u0358\u0302" &&
+              expected.queryForm == "tang2";
+  for (size_t t = 0; t < threadCount; t++) {
+    same = same && expected.composed == uses[t].composed &&
+           expected.uppercased == uses[t].uppercased &&
+           expected.queryForm == uses[t].queryForm;
+  }
+  std::exit(same ? 0 : 1);
+}
+
+// The race runs in a new process, so that the tables are used there for
+// the first time whatever the order of the tests or the filter; run it
+// under ThreadSanitizer to check the races.
+TEST(TaiwaneseRomanizationTest, TablesInitializeOnceUnderConcurrentFirstUse) {
+  GTEST_FLAG_SET(death_test_style, "threadsafe");
+  EXPECT_EXIT(RaceToFirstUse(), testing::ExitedWithCode(0), "");
+}
+
 TEST(TaiwaneseRomanizationTest, BasicTest) {
   EXPECT_EQ(1, 1);
 }
@@ -174,4 +277,394 @@ TEST(TaiweneseRomanizationTest, UppercaseRegressionTest) {
       ComposeLegacyTLWithPOJStyleNN("Oo9"));
 }
 
+TEST(TaiwaneseRomanizationTest, ComposedVowelTableMatchesTheMapLookup) {
+  using Formosa::TaiwaneseRomanization::VowelHelper;
+
+  // Every spelling of up to two letters from the vowels and a few others,
+  // plus some that are too long to be a vowel.
+  const std::string letters = "aeimnoquzAEIMNOQUZbx";
+  std::vector<std::string> vowels = {"", "oou", "nnn", "iii"};
+  for (char c : letters) {
+    vowels.push_back(std::string(1, c));
+    for (char d : letters) {
+      vowels.push_back(std::string(1, c) + d);
+    }
+  }
+
+  for (const std::string& vowel : vowels) {
+    for (unsigned int tone = 0; tone <= 10; tone++) {
+      for (int flags = 0; flags < 16; flags++) {
+        std::string expected = VowelHelper::referenceSymbolForVowel(
+            vowel, tone, flags & 1, flags & 2, flags & 4, flags & 8);
+        VowelHelper::ComposedVowel composed = VowelHelper::composedVowel(
+            vowel.data(), vowel.length(), tone, flags & 1, flags & 2,
+            flags & 4, flags & 8);
+        ASSERT_EQ(expected, std::string(composed.data, composed.length))
+            << vowel << " " << tone << " " << flags;
+        EXPECT_EQ(expected, VowelHelper::symbolForVowel(vowel, tone, flags & 1,
+                                                        flags & 2, flags & 4,
+                                                        flags & 8));
+
+        unsigned int codepoints = 0;
+        for (char c : expected) {
+          codepoints += (c & 0xc0) != 0x80;
+        }
+        EXPECT_EQ(codepoints, composed.codepoints);
+      }
+    }
+  }
+}
+
+TEST(TaiwaneseRomanizationTest, ComposedLengthCountsCodepoints) {
+  Formosa::TaiwaneseRomanization::RomanizationSymbol
+      ou("Ou", Formosa::TaiwaneseRomanization::POJSyllable);
+  ou.setTone(5);
+  EXPECT_EQ("O\u0358\u0302", ou.composedForm());
+  EXPECT_EQ(3, ou.composedLength());
+
+  Formosa::TaiwaneseRomanization::RomanizationSymbol
+      h("h", Formosa::TaiwaneseRomanization::POJSyllable);
+  EXPECT_EQ("h", h.composedForm());
+  EXPECT_EQ(1, h.composedLength());
+
+  std::string composed = "t";
+  ou.appendComposedForm(composed);
+  EXPECT_EQ("tO\u0358\u0302", composed);
+}
+
+TEST(TaiwaneseRomanizationTest, SymbolsKeepTheirLettersAndCase) {
+  using Formosa::TaiwaneseRomanization::POJSyllable;
+  using Formosa::TaiwaneseRomanization::RomanizationSymbol;
+
+  for (int c = 1; c < 256; c++) {
+    std::string letter(1, (char)c);
+    RomanizationSymbol symbol(letter, POJSyllable);
+    EXPECT_EQ(letter, symbol.symbol());
+    EXPECT_EQ(std::string(1, (char)tolower(c)), symbol.symbolInLowerCase());
+    EXPECT_EQ((unsigned int)tolower(c), symbol.symbolID());
+    EXPECT_EQ(toupper(c) == c, symbol.isUpperCase());
+  }
+
+  for (const char* letters : {"nn", "nN", "Nn", "NN", "ou", "oU", "Ou", "OU",
+                              "oo", "oO", "Oo", "OO", "ii", "iI", "Ii", "II"}) {
+    RomanizationSymbol symbol(letters, POJSyllable);
+    EXPECT_EQ(letters, symbol.symbol());
+    EXPECT_EQ(2, symbol.length());
+    EXPECT_EQ(isupper(letters[0]) != 0, symbol.isUpperCase());
+  }
+  EXPECT_EQ(RomanizationSymbol::NNSymbol,
+            RomanizationSymbol("Nn", POJSyllable).symbolID());
+  EXPECT_EQ("ou", RomanizationSymbol("OU", POJSyllable).symbolInLowerCase());
+
+  // Strings that make no symbol give the empty symbol, and setting one
+  // leaves the symbol as it is.
+  RomanizationSymbol ng("ng", POJSyllable);
+  EXPECT_EQ(RomanizationSymbol::NoSymbol, ng.symbolID());
+  EXPECT_EQ("", ng.symbol());
+  EXPECT_FALSE(ng.isUpperCase());
+
+  RomanizationSymbol o("O", POJSyllable);
+  EXPECT_EQ("O", o.setSymbol("abc"));
+  EXPECT_TRUE(o.appendLetter('u'));
+  EXPECT_EQ("Ou", o.symbol());
+  EXPECT_FALSE(o.appendLetter('u'));
+  EXPECT_EQ('O', o.letterAt(0));
+  EXPECT_EQ('u', o.letterAt(1));
+}
+
+TEST(TaiwaneseRomanizationTest, TypingAndConvertingAllocateNothing) {
+  using Formosa::TaiwaneseRomanization::RomanizationSyllable;
+
+  RomanizationSyllable tl;
+  RomanizationSyllable poj;
+  tl.setInputType(Formosa::TaiwaneseRomanization::TLSyllable);
+  std::string composed;
+  composed.reserve(64);
+
+  // The first round sets up the vowel tables.
+  for (int round = 0; round < 2; round++) {
+    size_t allocationCount = g_allocationCount;
+    tl.clear();
+    for (const char* c = "Tsioh"; *c; c++) {
+      tl.insertCharacterAtCursor(*c);
+    }
+    tl.normalize(8);
+    tl.convertToPOJSyllable(poj);
+    poj.normalize(8);
+    composed.clear();
+    poj.appendComposedForm(composed);
+    if (round) {
+      EXPECT_EQ(allocationCount, g_allocationCount);
+    }
+  }
+  EXPECT_EQ("Chio̍h", composed);
+}
+
+TEST(TaiwaneseRomanizationTest, TypingIntoAFullSyllableFails) {
+  Formosa::TaiwaneseRomanization::RomanizationSyllable syl;
+  for (unsigned int i = 0;
+       i < Formosa::TaiwaneseRomanization::RomanizationSyllable::MaxSymbols;
+       i++) {
+    EXPECT_TRUE(syl.insertCharacterAtCursor(i % 2 ? 'a' : 't'));
+  }
+  EXPECT_FALSE(syl.insertCharacterAtCursor('t'));
+  EXPECT_TRUE(syl.removeCharacterAtRightOfCursor());
+  EXPECT_TRUE(syl.insertCharacterAtCursor('a'));
+  EXPECT_EQ(Formosa::TaiwaneseRomanization::RomanizationSyllable::MaxSymbols,
+            syl.numberOfCodepoints());
+}
+
+TEST(TaiwaneseRomanizationTest, QueryFormTableMatchesTheStateWalk) {
+  using Formosa::TaiwaneseRomanization::VowelHelper;
+
+  // Pieces of composed text: every composed vowel, its first bytes alone,
+  // and letters, digits and punctuation between them.
+  std::vector<std::string> pieces = {"t", "ng", "h", "-", " ", "5", "\xcc"};
+  for (const char* vowel : {"a", "e", "i", "m", "n", "o", "u", "A", "O",
+                            "nn", "ou", "oo", "Ou", "OO", "ii", "II"}) {
+    for (unsigned int tone = 0; tone <= 9; tone++) {
+      for (int flags = 0; flags < 16; flags++) {
+        std::string composed = VowelHelper::symbolForVowel(
+            vowel, tone, flags & 1, flags & 2, flags & 4, flags & 8);
+        pieces.push_back(composed);
+        for (size_t length = 1; length < composed.length(); length++) {
+          pieces.push_back(composed.substr(0, length));
+        }
+      }
+    }
+  }
+
+  unsigned int seed = 1;
+  for (int n = 0; n < 20000; n++) {
+    std::string composed;
+    for (int count = n % 6; count >= 0; count--) {
+      seed = seed * 1103515245 + 12345;
+      composed += pieces[(seed >> 8) % pieces.size()];
+    }
+
+    std::string expected =
+        VowelHelper::referenceQueryFormFromComposedForm(composed);
+    ASSERT_EQ(expected, VowelHelper::queryFormFromComposedForm(composed))
+        << composed;
+
+    std::vector<char> buffer(composed.length() + 1);
+    size_t length = VowelHelper::queryFormFromComposedForm(
+        composed.data(), composed.length(), buffer.data());
+    EXPECT_EQ(expected, std::string(buffer.data(), length));
+  }
+}
+
+TEST(TaiwaneseRomanizationTest, QueryFormIntoABuffer) {
+  using Formosa::TaiwaneseRomanization::VowelHelper;
+  const std::string composed = "L\u00e2ng-\u00f3\u0358";
+  char buffer[32];
+  size_t length = VowelHelper::queryFormFromComposedForm(
+      composed.data(), composed.length(), buffer);
+  EXPECT_EQ(VowelHelper::referenceQueryFormFromComposedForm(composed),
+            std::string(buffer, length));
+  EXPECT_EQ("Lang-oo2", std::string(buffer, length));
+
+  EXPECT_EQ(0, VowelHelper::queryFormFromComposedForm("", 0, buffer));
+  EXPECT_EQ("", VowelHelper::queryFormFromComposedForm(""));
+}
+
+// NormalizedQueryData.txt has, for each syllable in TLSyllables.txt typed
+// as TL, TL in POJ style, and POJ, and for each syllable in
+// HakkaSyllables.txt, the query data at final tones 0 to 9, as written by
+// the string-based normalization this replaced.
+TEST(TaiwaneseRomanizationTest, NormalizedQueryDataMatchesTheGoldenFile) {
+  using namespace Formosa::TaiwaneseRomanization;
+  std::string path =
+      std::string(TAIWANESE_ROMANIZATION_TEST_DATA) + "/NormalizedQueryData.txt";
+  std::ifstream input(path.c_str());
+  ASSERT_TRUE(input.good()) << path;
+
+  char query[RomanizationSyllable::MaxQueryDataLength];
+  size_t lines = 0;
+  std::string line;
+  while (std::getline(input, line)) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    for (size_t comma; (comma = line.find(',', start)) != std::string::npos;
+         start = comma + 1) {
+      fields.push_back(line.substr(start, comma - start));
+    }
+    fields.push_back(line.substr(start));
+    ASSERT_EQ(12, fields.size()) << line;
+    const std::string& letters = fields[0];
+    const std::string& style = fields[1];
+
+    RomanizationSyllable syl;
+    if (style == "hakka") {
+      syl.setInputType(HakkaPFSSyllable);
+      for (char c : letters) {
+        if (isdigit((unsigned char)c)) {
+          syl.normalize(c - '0');
+          break;
+        }
+        syl.insertCharacterAtCursor(c);
+      }
+    } else {
+      syl.setInputType(TLSyllable);
+      for (char c : letters) {
+        syl.insertCharacterAtCursor(c);
+      }
+      if (style == "tl-poj-style") {
+        syl.setForcePOJStyle(true);
+      } else if (style == "poj") {
+        RomanizationSyllable converted;
+        syl.convertToPOJSyllable(converted);
+        size_t length = converted.writeNormalizedQueryData(query);
+        syl.clear();
+        syl.setInputType(POJSyllable);
+        for (size_t i = 0; i < length; i++) {
+          syl.insertCharacterAtCursor(query[i]);
+        }
+      }
+    }
+
+    for (unsigned int tone = 0; tone <= 9; tone++) {
+      size_t allocationCount = g_allocationCount;
+      size_t length = syl.writeNormalizedQueryData(query, tone);
+      EXPECT_EQ(allocationCount, g_allocationCount);
+      EXPECT_EQ(fields[2 + tone], std::string(query, length))
+          << letters << " " << style << " " << tone;
+      EXPECT_EQ(fields[2 + tone], syl.normalizedQueryData(tone));
+    }
+    lines++;
+  }
+  EXPECT_EQ(3807, lines);
+}
+
+TEST(TaiwaneseRomanizationTest, TransliteratorMatchesSyllableConversion) {
+  using namespace Formosa::TaiwaneseRomanization;
+  // each romanization's own initials; words with others are copied
+  const std::vector<const char*> pojInitials = {
+      "",  "p",  "ph", "b", "m",  "t",  "th",  "n", "l",
+      "k", "kh", "g",  "ng", "h", "ch", "chh", "j", "s"};
+  const std::vector<const char*> tlInitials = {
+      "",  "p",  "ph", "b", "m",  "t",  "th",  "n", "l",
+      "k", "kh", "g",  "ng", "h", "ts", "tsh", "j", "s"};
+  const std::vector<const char*> tlpaInitials = {
+      "",  "p",  "ph", "b", "m", "t", "th", "n", "l",
+      "k", "kh", "g",  "ng", "h", "c", "ch", "j", "s"};
+  const std::vector<const char*> dtInitials = {
+      "",  "b", "p",  "bh", "m", "d", "t", "n", "l",
+      "g", "k", "gh", "ng", "h", "z", "c", "s", "r"};
+  const char* finals[] = {"a",   "ai",  "au",  "am",   "an",  "ang", "ap",
+                          "at",  "ak",  "ah",  "e",    "eh",  "i",   "ia",
+                          "iau", "ian", "iang", "iok", "ing", "ik",  "inn",
+                          "ainn", "oo", "ou",  "ouh",  "ong", "o",   "oa",
+                          "oe",  "u",   "ua",  "uai",  "ue",  "ui",  "un",
+                          "m",   "ng",  "ere", "or",   "en",  "et"};
+  struct {
+    SyllableType from;
+    SyllableType to;
+    bool forcePOJStyle;
+    const std::vector<const char*>& initials;
+  } pairs[] = {
+      {POJSyllable, POJSyllable, false, pojInitials},
+      {POJSyllable, TLSyllable, false, pojInitials},
+      {TLSyllable, POJSyllable, false, tlInitials},
+      {TLSyllable, TLSyllable, false, tlInitials},
+      {TLSyllable, TLSyllable, true, tlInitials},
+      {TLPASyllable, TLSyllable, false, tlpaInitials},
+      {DTSyllable, POJSyllable, false, dtInitials},
+  };
+
+  for (const auto& pair : pairs) {
+    RomanizationTransliterator transliterator(pair.from, pair.to,
+                                              pair.forcePOJStyle);
+    for (const char* initial : pair.initials) {
+      for (const char* final : finals) {
+        // DT writes TL's oo as o
+        if (pair.from == DTSyllable && std::string(final) == "oo") {
+          continue;
+        }
+        for (unsigned int tone = 1; tone <= 9; tone++) {
+          std::string letters = std::string(initial) + final;
+          letters[0] = tone % 3 ? letters[0] : toupper(letters[0]);
+          std::string expected = ConvertSyllable(letters, tone, pair.from,
+                                                 pair.to, pair.forcePOJStyle);
+          std::string numbered = letters + char('0' + tone);
+          ASSERT_EQ(expected, transliterator.transliterate(numbered))
+              << pair.from << " " << pair.to << " " << numbered;
+
+          // the same syllable composed in its own romanization
+          if (pair.from == TLSyllable || pair.from == POJSyllable) {
+            std::string composed =
+                ConvertSyllable(letters, tone, pair.from, pair.from);
+            EXPECT_EQ(expected, transliterator.transliterate(composed))
+                << pair.from << " " << pair.to << " " << composed;
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(TaiwaneseRomanizationTest, TransliteratorConvertsRunningText) {
+  using namespace Formosa::TaiwaneseRomanization;
+  RomanizationTransliterator pojToTL(POJSyllable, TLSyllable);
+  EXPECT_EQ("T\u00e2i-u\u00e2n s\u012b tsi\u030dt \u00ea t\u0113-h\u00e2ng. "
+            "\u53f0\u7063 2024!",
+            pojToTL.transliterate(
+                "T\u00e2i-o\u00e2n s\u012b chi\u030dt \u00ea "
+                "t\u0113-h\u00e2ng. \u53f0\u7063 2024!"));
+  EXPECT_EQ("T\u00e2i-u\u00e2n s\u012b tsi\u030dt",
+            pojToTL.transliterate("Tai5-oan5 si7 chit8"));
+  EXPECT_EQ("\u00f2o ti\u00e0nn",
+            pojToTL.transliterate("\u00f2\u0358 ti\u00e0\u207f"));
+
+  RomanizationTransliterator tlToPOJ(TLSyllable, POJSyllable);
+  EXPECT_EQ("CHI\u030dT-\u00ca, ho\u0358\u0304 (x)",
+            tlToPOJ.transliterate("TSI\u030dT-\u00ca, hoo7 (x)"));
+  EXPECT_EQ("\u00e0\u0301\u0301",
+            tlToPOJ.transliterate("\u00e0\u0301\u0301"));
+  EXPECT_EQ("", tlToPOJ.transliterate(""));
+
+  RomanizationTransliterator pojToPOJ(POJSyllable, POJSyllable);
+  EXPECT_EQ("T\u00e2i-o\u00e2n-l\u00e2ng",
+            pojToPOJ.transliterate("Tai5-oan5-lang5"));
+
+  // a plain oo is the same with a tone number or a tone mark, and only
+  // the dot of o͘, or the old middle dot, makes it o͘
+  EXPECT_EQ(pojToPOJ.transliterate("hoo5"),
+            pojToPOJ.transliterate("h\u00f4o"));
+  EXPECT_EQ(pojToPOJ.transliterate("hoo7"),
+            pojToPOJ.transliterate("h\u014do"));
+  EXPECT_EQ("ho\u0358\u0302", pojToPOJ.transliterate("h\u00f4\u0358"));
+  EXPECT_EQ("ho\u0358\u0302", pojToPOJ.transliterate("ho\u00b75"));
+  EXPECT_EQ(pojToTL.transliterate("hoo5"), pojToTL.transliterate("h\u00f4o"));
+
+  EXPECT_FALSE(RomanizationTransliterator::canTransliterate(TLSyllable,
+                                                            DTSyllable));
+  EXPECT_FALSE(RomanizationTransliterator::canTransliterate(HakkaPFSSyllable,
+                                                            TLSyllable));
+  RomanizationTransliterator tlToDT(TLSyllable, DTSyllable);
+  EXPECT_EQ("tai5", tlToDT.transliterate("tai5"));
+}
+
+TEST(TaiwaneseRomanizationTest, TransliteratorCopiesWordsThatAreNoSyllable) {
+  using namespace Formosa::TaiwaneseRomanization;
+  RomanizationTransliterator pojToTL(POJSyllable, TLSyllable);
+  RomanizationTransliterator tlToPOJ(TLSyllable, POJSyllable);
+  RomanizationTransliterator dtToTL(DTSyllable, TLSyllable);
+  const char* texts[] = {"Hello world, church", "XYZ", "zoo qa",
+                         "The quick brown fox jumps over the lazy dog"};
+  for (const char* text : texts) {
+    EXPECT_EQ(text, pojToTL.transliterate(text));
+    EXPECT_EQ(text, tlToPOJ.transliterate(text));
+    EXPECT_EQ(text, dtToTL.transliterate(text));
+  }
+
+  // the syllables around such words are still converted
+  EXPECT_EQ("T\u00e2i-u\u00e2n church",
+            pojToTL.transliterate("Tai5-oan5 church"));
+  EXPECT_EQ("chi\u030dt \u00ea zu\u00e1",
+            tlToPOJ.transliterate("tsi\u030dt \u00ea zu\u00e1"));
+  EXPECT_EQ("hm\u0304 sng n\u0302g ha\u207fh",
+            tlToPOJ.transliterate("hm7 sng1 ng5 hannh4"));
+}
+
 }
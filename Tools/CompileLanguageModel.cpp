@@ -0,0 +1,74 @@
+//
+// CompileLanguageModel.cpp
+//
+// Copyright (c) 2007-2010 Lukhnos D. Liu (http://lukhnos.org)
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+// Compiles a text lexicon ("key value score" lines, and optionally
+// "preceedingKey preceedingValue key value score" bigram lines) into the
+// binary form MappedLanguageModel opens.
+
+#include <fstream>
+#include <iostream>
+#include "MappedLanguageModel.h"
+
+using namespace std;
+using namespace Formosa::Gramambular;
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3) {
+        cerr << "usage: " << argv[0] << " source.txt output.lm" << endl;
+        return 1;
+    }
+
+    ifstream source(argv[1]);
+    if (!source) {
+        cerr << "cannot open: " << argv[1] << endl;
+        return 1;
+    }
+
+    ofstream binary(argv[2], ios::binary);
+    if (!binary) {
+        cerr << "cannot create: " << argv[2] << endl;
+        return 1;
+    }
+
+    string error;
+    if (!MappedLanguageModel::Compile(source, binary, error)) {
+        cerr << argv[1] << ": " << error << endl;
+        return 1;
+    }
+
+    binary.close();
+
+    MappedLanguageModel lm;
+    if (!lm.open(argv[2])) {
+        cerr << "cannot open the compiled model: " << argv[2] << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,109 @@
+//
+// ConvertReadings.cpp
+//
+// Copyright (c) 2007-2010 Lukhnos D. Liu (http://lukhnos.org)
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+// Converts sentences of readings, one per line with the readings separated
+// by spaces, with a compiled language model (see CompileLanguageModel), and
+// writes the converted sentences in the same order.
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include "MappedLanguageModel.h"
+#include "ParallelConverter.h"
+
+using namespace std;
+using namespace Formosa::Gramambular;
+
+// the lines read and converted at a time
+static const size_t LinesPerBatch = 4096;
+
+int main(int argc, char *argv[])
+{
+    // 0 for a thread per core
+    size_t threadCount = 1;
+    string separator = "-";
+    string modelPath;
+
+    for (int i = 1 ; i < argc ; i++) {
+        string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            threadCount = (size_t)atoi(argv[++i]);
+        }
+        else if (arg == "-s" && i + 1 < argc) {
+            separator = argv[++i];
+        }
+        else if (modelPath.empty() && arg.size() && arg[0] != '-') {
+            modelPath = arg;
+        }
+        else {
+            modelPath.clear();
+            break;
+        }
+    }
+
+    if (modelPath.empty()) {
+        cerr << "usage: " << argv[0] << " [-j threads] [-s separator] model.lm < readings.txt" << endl;
+        return 1;
+    }
+
+    // one model, read by every thread
+    MappedLanguageModel model;
+    if (!model.open(modelPath)) {
+        cerr << "cannot open: " << modelPath << endl;
+        return 1;
+    }
+
+    ParallelConverter converter(&model, separator, threadCount);
+
+    vector<vector<string> > sentences(LinesPerBatch);
+    vector<string> results;
+    string line;
+    string reading;
+
+    while (cin) {
+        size_t count = 0;
+        while (count < LinesPerBatch && getline(cin, line)) {
+            vector<string>& readings = sentences[count++];
+            readings.clear();
+            istringstream lineStream(line);
+            while (lineStream >> reading) {
+                readings.push_back(reading);
+            }
+        }
+
+        // a short last batch leaves the lines after it as they were
+        converter.convert(sentences, count, results);
+
+        for (size_t l = 0 ; l < count ; l++) {
+            cout << results[l] << '\n';
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+//
+// TransliterateRomanization.cpp
+//
+// Copyright (c) 2007-2010 Lukhnos D. Liu (http://lukhnos.org)
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+
+// Converts running text from one Taiwanese romanization to another, reading
+// standard input and writing standard output; see RomanizationTransliterator
+// for what is converted and what is copied.
+
+#include <iostream>
+#include <string>
+#include "TaiwaneseRomanization.h"
+
+using namespace std;
+using namespace Formosa::TaiwaneseRomanization;
+
+// the text read and converted at a time; a chunk always ends with a line
+static const size_t BytesPerChunk = 64 * 1024;
+
+static bool SyllableTypeFromName(const string& name, SyllableType& type)
+{
+    if (name == "poj") {
+        type = POJSyllable;
+    }
+    else if (name == "tl") {
+        type = TLSyllable;
+    }
+    else if (name == "tlpa") {
+        type = TLPASyllable;
+    }
+    else if (name == "dt") {
+        type = DTSyllable;
+    }
+    else if (name == "hakka") {
+        type = HakkaPFSSyllable;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    SyllableType from = TLSyllable;
+    SyllableType to = POJSyllable;
+    bool forcePOJStyle = false;
+    bool usePOJLegacyOU = false;
+    bool valid = true;
+
+    for (int i = 1 ; i < argc && valid ; i++) {
+        string arg = argv[i];
+        if (arg == "-f" && i + 1 < argc) {
+            valid = SyllableTypeFromName(argv[++i], from);
+        }
+        else if (arg == "-t" && i + 1 < argc) {
+            valid = SyllableTypeFromName(argv[++i], to);
+        }
+        else if (arg == "-p") {
+            forcePOJStyle = true;
+        }
+        else if (arg == "-l") {
+            usePOJLegacyOU = true;
+        }
+        else {
+            valid = false;
+        }
+    }
+
+    if (!valid || !RomanizationTransliterator::canTransliterate(from, to)) {
+        cerr << "usage: " << argv[0] << " [-f from] [-t to] [-p] [-l] < input.txt" << endl;
+        cerr << "  from: poj, tl (default), tlpa, dt, hakka" << endl;
+        cerr << "  to: poj (default), tl; or hakka from hakka" << endl;
+        cerr << "  -p: write TL with POJ style o\xcd\x98 and \xe2\x81\xbf" << endl;
+        cerr << "  -l: write the legacy POJ o\xcd\x98 with the tone mark first" << endl;
+        return 1;
+    }
+
+    RomanizationTransliterator transliterator(from, to, forcePOJStyle, usePOJLegacyOU);
+
+    string chunk;
+    string output;
+    string line;
+    while (cin) {
+        chunk.clear();
+        while (chunk.size() < BytesPerChunk && getline(cin, line)) {
+            chunk += line;
+
+            // getline stops at the end of the input without a newline
+            if (!cin.eof()) {
+                chunk += '\n';
+            }
+        }
+
+        output.clear();
+        transliterator.transliterate(chunk.data(), chunk.size(), output);
+        cout << output;
+    }
+
+    return 0;
+}